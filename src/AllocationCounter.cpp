@@ -0,0 +1,73 @@
+#include "AllocationCounter.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+    std::atomic<bool> counting{false};
+    std::atomic<size_t> allocations{0};
+    std::atomic<size_t> allocatedBytes{0};
+
+    void record(size_t size) {
+        if (!counting.load(std::memory_order_relaxed)) return;
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void* allocate(size_t size) {
+        record(size);
+        void* pointer = std::malloc(size ? size : 1);
+        if (!pointer) throw std::bad_alloc();
+        return pointer;
+    }
+
+    void* allocateAligned(size_t size, std::align_val_t alignment) {
+        record(size);
+        size_t align = std::max(size_t(alignment), sizeof(void*));
+#ifdef _WIN32
+        // aligned_alloc в MSVC и MinGW нет; такие блоки освобождает только _aligned_free
+        void* pointer = _aligned_malloc(size ? size : 1, align);
+#else
+        void* pointer = std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+        if (!pointer) throw std::bad_alloc();
+        return pointer;
+    }
+
+    void freeAligned(void* pointer) {
+#ifdef _WIN32
+        _aligned_free(pointer);
+#else
+        std::free(pointer);
+#endif
+    }
+}
+
+namespace AllocationCounter {
+    void enable(bool on) { counting.store(on, std::memory_order_relaxed); }
+    size_t count() { return allocations.load(std::memory_order_relaxed); }
+    size_t bytes() { return allocatedBytes.load(std::memory_order_relaxed); }
+    void reset() {
+        allocations.store(0, std::memory_order_relaxed);
+        allocatedBytes.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Массивные и nothrow-формы в стандартной библиотеке выражены через эти
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { freeAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { freeAligned(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { freeAligned(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { freeAligned(pointer); }
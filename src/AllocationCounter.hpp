@@ -0,0 +1,34 @@
+#ifndef ALLOCATIONCOUNTER_HPP
+#define ALLOCATIONCOUNTER_HPP
+
+#include <atomic>
+#include <cstddef>
+
+// Счётчик вызовов глобального operator new (замена operator new в
+// AllocationCounter.cpp). Пока счёт выключен, замена стоит одну
+// relaxed-загрузку флага.
+namespace AllocationCounter {
+    void enable(bool on);
+    // Выделения с момента последнего reset() при включённом счёте
+    size_t count();
+    size_t bytes();
+    void reset();
+}
+
+// Считает выделения в пределах области видимости
+class AllocationScope {
+public:
+    AllocationScope() {
+        AllocationCounter::reset();
+        AllocationCounter::enable(true);
+    }
+    ~AllocationScope() { AllocationCounter::enable(false); }
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+    size_t count() const { return AllocationCounter::count(); }
+    size_t bytes() const { return AllocationCounter::bytes(); }
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Линейный распределитель поверх крупных блоков. Память отдаётся сдвигом
+// указателя и не освобождается поштучно: reset() разом возвращает всё,
+// сохраняя блоки, так что следующий цикл заполнения (кадр, новое состояние
+// кэша) не обращается к operator new, пока укладывается в прежний объём.
+// Не потокобезопасен. Объекты в арене должны быть тривиально разрушаемыми.
+class Arena {
+public:
+    explicit Arena(size_t slabBytes = size_t(1) << 20) : slabBytes(slabBytes) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        for (;;) {
+            if (current < slabs.size()) {
+                Slab& slab = slabs[current];
+                uintptr_t base = reinterpret_cast<uintptr_t>(slab.data.get());
+                size_t start = size_t((base + offset + alignment - 1) / alignment * alignment - base);
+                if (start + bytes <= slab.size) {
+                    offset = start + bytes;
+                    used += bytes;
+                    return slab.data.get() + start;
+                }
+                // Блок исчерпан (или слишком мал для запроса) — следующий
+                current++;
+                offset = 0;
+                continue;
+            }
+            size_t size = std::max(slabBytes, bytes + alignment);
+            slabs.push_back(Slab{std::unique_ptr<char[]>(new char[size]), size});
+            reserved += size;
+        }
+    }
+
+    // Конструирует T в арене; деструктор вызван не будет
+    template <typename T>
+    T* create() {
+        return new (allocate(sizeof(T), alignof(T))) T();
+    }
+
+    template <typename T>
+    T* createArray(size_t count) {
+        T* items = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; i++) new (items + i) T();
+        return items;
+    }
+
+    // Всё выделенное становится недействительным; блоки остаются за ареной
+    void reset() {
+        current = 0;
+        offset = 0;
+        used = 0;
+    }
+
+    size_t usedBytes() const { return used; }
+    size_t reservedBytes() const { return reserved; }
+
+private:
+    struct Slab {
+        std::unique_ptr<char[]> data;
+        size_t size = 0;
+    };
+
+    size_t slabBytes;
+    std::vector<Slab> slabs;
+    size_t current = 0;
+    size_t offset = 0;
+    size_t used = 0;
+    size_t reserved = 0;
+};
+
+#endif
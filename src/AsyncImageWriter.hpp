@@ -0,0 +1,195 @@
+#ifndef ASYNCIMAGEWRITER_HPP
+#define ASYNCIMAGEWRITER_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ImageEncoder.hpp"
+#include "ImageUtils.hpp"
+
+// Кодирование и запись кадров в фоновом потоке. submit только копирует
+// пиксели в один из заранее выделенных буферов; если все буферы заняты
+// (диск или кодировщик не успевают), кадр отбрасывается и учитывается в
+// dropped(), а вызывающий поток не ждёт.
+//
+// Кадр — RGBA8 со строками снизу вверх, как его отдаёт GpuReadback.
+class AsyncImageWriter {
+public:
+    explicit AsyncImageWriter(int bufferCount = 4) : frames(size_t(std::max(1, bufferCount))) {
+        for (size_t i = 0; i < frames.size(); i++) freeFrames.push_back(i);
+        queue.reserve(frames.size());
+        worker = std::thread(&AsyncImageWriter::workerLoop, this);
+    }
+
+    ~AsyncImageWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        worker.join();
+        if (droppedFrames) std::cout << "Image writer dropped " << droppedFrames << " frames" << std::endl;
+    }
+
+    AsyncImageWriter(const AsyncImageWriter&) = delete;
+    AsyncImageWriter& operator=(const AsyncImageWriter&) = delete;
+
+    // Одиночный снимок: output/screenshot_<время>.<формат>
+    bool submitScreenshot(const unsigned char* rgba, int width, int height, ImageFormat format) {
+        return submit(rgba, width, height, format, -1);
+    }
+
+    // Кадр последовательности: <каталог startSequence>/frame_<index>.<формат>
+    bool submitSequenceFrame(const unsigned char* rgba, int width, int height, ImageFormat format,
+                             long long index) {
+        return submit(rgba, width, height, format, index);
+    }
+
+    // Новый каталог output/capture_<время> для следующих кадров последовательности
+    bool startSequence(const std::string& directory = "output") {
+        std::string path = directory + "/capture_" + ImageUtils::getTimestamp();
+        if (!ImageUtils::createDirectory(directory) || !ImageUtils::createDirectory(path)) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        sequenceDirectory = path;
+        return true;
+    }
+
+    const std::string& currentSequence() const { return sequenceDirectory; }
+
+    // Ждёт, пока все поставленные кадры будут записаны
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idleCondition.wait(lock, [this] { return queue.empty() && !writing; });
+    }
+
+    size_t written() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return writtenFrames;
+    }
+
+    size_t dropped() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return droppedFrames;
+    }
+
+private:
+    struct Frame {
+        std::vector<unsigned char> rgba;
+        int width = 0, height = 0;
+        ImageFormat format = ImageFormat::PNG;
+        long long sequenceIndex = -1;  // -1 — одиночный снимок
+        std::string directory;
+    };
+
+    std::vector<Frame> frames;
+    std::vector<size_t> freeFrames;
+    std::vector<size_t> queue;  // очередь записи, не длиннее frames
+    std::string sequenceDirectory;
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable idleCondition;
+    bool stopping = false;
+    bool writing = false;
+    size_t writtenFrames = 0;
+    size_t droppedFrames = 0;
+    std::thread worker;
+
+    bool submit(const unsigned char* rgba, int width, int height, ImageFormat format, long long index) {
+        size_t slot;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (freeFrames.empty() || (index >= 0 && sequenceDirectory.empty())) {
+                droppedFrames++;
+                return false;
+            }
+            slot = freeFrames.back();
+            freeFrames.pop_back();
+        }
+
+        // Копирование идёт без блокировки: буфер уже принадлежит вызывающему
+        Frame& frame = frames[slot];
+        frame.rgba.resize(size_t(width) * height * 4);
+        std::memcpy(frame.rgba.data(), rgba, frame.rgba.size());
+        frame.width = width;
+        frame.height = height;
+        frame.format = format;
+        frame.sequenceIndex = index;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (index >= 0) frame.directory = sequenceDirectory;
+            queue.push_back(slot);
+        }
+        condition.notify_one();
+        return true;
+    }
+
+    void workerLoop() {
+        std::vector<unsigned char> rgb;
+        std::vector<unsigned char> converted;
+        std::vector<unsigned char> encoded;
+        std::unique_ptr<ImageEncoder> encoders[int(ImageFormat::PNG) + 1];
+
+        for (;;) {
+            size_t slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                slot = queue.front();
+                queue.erase(queue.begin());
+                writing = true;
+            }
+
+            const Frame& frame = frames[slot];
+            toRgbTopDown(frame, rgb);
+            bool ok;
+            if (frame.sequenceIndex < 0) {
+                ok = ImageUtils::saveImage(rgb, frame.width, frame.height, "output", "screenshot", {frame.format});
+            } else {
+                auto& encoder = encoders[int(frame.format)];
+                if (!encoder) encoder = ImageEncoder::create(frame.format);
+                const unsigned char* input = rgb.data();
+                OutputLayout layout = encoder->inputLayout();
+                if (layout.order != ChannelOrder::RGB || layout.bottomUp || layout.rowAlignment != 1) {
+                    ImageUtils::convertLayout(rgb, frame.width, frame.height, layout, converted);
+                    input = converted.data();
+                }
+                encoder->encode(input, frame.width, frame.height, encoded);
+                char name[32];
+                std::snprintf(name, sizeof(name), "/frame_%06lld.", frame.sequenceIndex);
+                ok = ImageUtils::writeFile(frame.directory + name + encoder->extension(), encoded);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                freeFrames.push_back(slot);
+                if (ok) writtenFrames++;
+                writing = false;
+            }
+            idleCondition.notify_all();
+        }
+    }
+
+    static void toRgbTopDown(const Frame& frame, std::vector<unsigned char>& rgb) {
+        rgb.resize(size_t(frame.width) * frame.height * 3);
+        for (int y = 0; y < frame.height; y++) {
+            const unsigned char* src = frame.rgba.data() + size_t(frame.height - 1 - y) * frame.width * 4;
+            unsigned char* dst = rgb.data() + size_t(y) * frame.width * 3;
+            for (int x = 0; x < frame.width; x++) {
+                dst[x * 3 + 0] = src[x * 4 + 0];
+                dst[x * 3 + 1] = src[x * 4 + 1];
+                dst[x * 3 + 2] = src[x * 4 + 2];
+            }
+        }
+    }
+};
+
+#endif
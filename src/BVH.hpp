@@ -0,0 +1,392 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+#include "Vector3.hpp"
+#include "Ray.hpp"
+#include "ThreadPool.hpp"
+
+struct AABB {
+    Vector3 min;
+    Vector3 max;
+
+    AABB() : min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+    AABB(const Vector3& min, const Vector3& max) : min(min), max(max) {}
+
+    void grow(const Vector3& p) {
+        min = Vector3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+        max = Vector3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    }
+
+    void grow(const AABB& b) {
+        min = Vector3(std::min(min.x, b.min.x), std::min(min.y, b.min.y), std::min(min.z, b.min.z));
+        max = Vector3(std::max(max.x, b.max.x), std::max(max.y, b.max.y), std::max(max.z, b.max.z));
+    }
+
+    bool isEmpty() const { return min.x > max.x; }
+
+    Vector3 centroid() const { return (min + max) * 0.5f; }
+
+    float surfaceArea() const {
+        if (isEmpty()) return 0.0f;
+        Vector3 e = max - min;
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // Slab-тест; возвращает расстояние входа или FLT_MAX при промахе
+    float intersect(const Ray& ray, const Vector3& invDir, float tMin, float tMax) const {
+        float tx1 = (min.x - ray.origin.x) * invDir.x, tx2 = (max.x - ray.origin.x) * invDir.x;
+        float ty1 = (min.y - ray.origin.y) * invDir.y, ty2 = (max.y - ray.origin.y) * invDir.y;
+        float tz1 = (min.z - ray.origin.z) * invDir.z, tz2 = (max.z - ray.origin.z) * invDir.z;
+        float tNear = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), tMin));
+        float tFar = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), tMax));
+        return tNear <= tFar ? tNear : FLT_MAX;
+    }
+};
+
+// Узел хранится плоско: у внутреннего узла дети лежат подряд (leftFirst, leftFirst + 1),
+// у листа count > 0 и примитивы primIndices[leftFirst .. leftFirst + count)
+struct BVHNode {
+    AABB bounds;
+    int leftFirst = 0;
+    int count = 0;
+
+    bool isLeaf() const { return count > 0; }
+};
+
+// BVH над произвольными AABB. Поддерживает refit снизу вверх (целиком параллельно
+// по уровням или только по цепочкам от изменённых примитивов) и оценку качества дерева
+// по SAH, чтобы решать, когда refit уже недостаточно и нужна полная перестройка.
+class BVH {
+public:
+    std::vector<BVHNode> nodes;
+    std::vector<int> primIndices;
+    std::vector<int> parents;
+    std::vector<int> primLeaf;
+    // Индексы узлов, сгруппированные по глубине: levelStart[d] .. levelStart[d + 1]
+    std::vector<int> levelOrder;
+    std::vector<int> levelStart;
+    float buildCost = 0.0f;
+
+    static constexpr int MaxLeafSize = 4;
+    static constexpr int BinCount = 12;
+    // Глубже узлы не делятся, даже если SAH выгоднее разбить: на вырожденных
+    // входах (скопления, экспоненциальные масштабы) дерево иначе не ограничено.
+    // Обход кладёт в стек не больше одного узла на уровень (occluded — плюс
+    // один), поэтому стек фиксированного размера переполниться не может.
+    static constexpr int MaxDepth = 64;
+    static constexpr int StackSize = MaxDepth + 2;
+
+    int primitiveCount() const { return int(primLeaf.size()); }
+    bool isEmpty() const { return nodes.empty(); }
+    int maxDepth() const { return int(levelStart.size()) - 2; }
+
+    void clear() {
+        nodes.clear();
+        primIndices.clear();
+        parents.clear();
+        primLeaf.clear();
+        levelOrder.clear();
+        levelStart.clear();
+        buildCost = 0.0f;
+    }
+
+    void build(const std::vector<AABB>& primBounds) {
+        clear();
+        int n = int(primBounds.size());
+        primLeaf.assign(n, -1);
+        if (n == 0) return;
+
+        primIndices.resize(n);
+        std::vector<Vector3> centroids(n);
+        for (int i = 0; i < n; i++) {
+            primIndices[i] = i;
+            centroids[i] = primBounds[i].centroid();
+        }
+
+        nodes.reserve(2 * n);
+        parents.reserve(2 * n);
+        nodes.emplace_back();
+        parents.push_back(-1);
+        nodes[0].leftFirst = 0;
+        nodes[0].count = n;
+
+        std::vector<int> depth(1, 0);
+        std::vector<int> stack{0};
+        while (!stack.empty()) {
+            int nodeIndex = stack.back();
+            stack.pop_back();
+
+            BVHNode& node = nodes[nodeIndex];
+            node.bounds = AABB();
+            AABB centroidBounds;
+            for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+                node.bounds.grow(primBounds[primIndices[i]]);
+                centroidBounds.grow(centroids[primIndices[i]]);
+            }
+
+            int mid = -1;
+            if (node.count > MaxLeafSize && depth[nodeIndex] < MaxDepth) {
+                mid = splitBinned(node, centroidBounds, primBounds, centroids);
+            }
+
+            if (mid < 0) {
+                for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+                    primLeaf[primIndices[i]] = nodeIndex;
+                }
+                continue;
+            }
+
+            int first = node.leftFirst;
+            int count = node.count;
+            int left = int(nodes.size());
+            nodes.emplace_back();
+            nodes.emplace_back();
+            parents.push_back(nodeIndex);
+            parents.push_back(nodeIndex);
+            depth.push_back(depth[nodeIndex] + 1);
+            depth.push_back(depth[nodeIndex] + 1);
+
+            nodes[left].leftFirst = first;
+            nodes[left].count = mid - first;
+            nodes[left + 1].leftFirst = mid;
+            nodes[left + 1].count = first + count - mid;
+            nodes[nodeIndex].leftFirst = left;
+            nodes[nodeIndex].count = 0;
+
+            stack.push_back(left);
+            stack.push_back(left + 1);
+        }
+
+        buildLevels(depth);
+        buildCost = cost();
+    }
+
+    // Полный refit: уровни обрабатываются от самого глубокого к корню,
+    // узлы одного уровня независимы и обновляются параллельно
+    void refit(const std::vector<AABB>& primBounds) {
+        ThreadPool& pool = ThreadPool::shared();
+        for (int level = int(levelStart.size()) - 2; level >= 0; level--) {
+            int levelBegin = levelStart[level];
+            int levelEnd = levelStart[level + 1];
+            pool.parallelFor(levelBegin, levelEnd, 1024, [&](int chunkBegin, int chunkEnd) {
+                for (int i = chunkBegin; i < chunkEnd; i++) {
+                    refitNode(levelOrder[i], primBounds);
+                }
+            });
+        }
+    }
+
+    // Частичный refit: поднимаемся от листьев изменённых примитивов к корню.
+    // При большой доле изменений выгоднее полный параллельный refit.
+    void refit(const std::vector<AABB>& primBounds, const std::vector<int>& dirtyPrims) {
+        if (dirtyPrims.size() * 8 > primLeaf.size()) {
+            refit(primBounds);
+            return;
+        }
+        for (int prim : dirtyPrims) {
+            int nodeIndex = primLeaf[prim];
+            while (nodeIndex >= 0) {
+                AABB before = nodes[nodeIndex].bounds;
+                refitNode(nodeIndex, primBounds);
+                const AABB& after = nodes[nodeIndex].bounds;
+                // Если рамка не изменилась, выше тоже ничего не поменяется
+                if (before.min.x == after.min.x && before.min.y == after.min.y &&
+                    before.min.z == after.min.z && before.max.x == after.max.x &&
+                    before.max.y == after.max.y && before.max.z == after.max.z) {
+                    break;
+                }
+                nodeIndex = parents[nodeIndex];
+            }
+        }
+    }
+
+    // SAH-стоимость дерева, нормированная на площадь корня
+    float cost() const {
+        if (nodes.empty()) return 0.0f;
+        const float traversalCost = 1.0f;
+        const float intersectCost = 1.0f;
+        float sum = 0.0f;
+        for (const auto& node : nodes) {
+            float area = node.bounds.surfaceArea();
+            sum += node.isLeaf() ? area * intersectCost * float(node.count)
+                                 : area * traversalCost;
+        }
+        float rootArea = nodes[0].bounds.surfaceArea();
+        return rootArea > 0.0f ? sum / rootArea : 0.0f;
+    }
+
+    // Ближайшее пересечение. hitPrimitive(prim, tMax) проверяет примитив
+    // и при более близком попадании уменьшает tMax, возвращая true.
+    template <typename HitFn>
+    bool intersect(const Ray& ray, float tMin, float& tMax, HitFn&& hitPrimitive) const {
+        if (nodes.empty()) return false;
+        Vector3 invDir(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+        if (nodes[0].bounds.intersect(ray, invDir, tMin, tMax) == FLT_MAX) return false;
+
+        bool hitAny = false;
+        int stack[StackSize];
+        int stackSize = 0;
+        int nodeIndex = 0;
+        for (;;) {
+            const BVHNode& node = nodes[nodeIndex];
+            if (node.isLeaf()) {
+                for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+                    if (hitPrimitive(primIndices[i], tMax)) hitAny = true;
+                }
+            } else {
+                int near = node.leftFirst;
+                int far = node.leftFirst + 1;
+                float tNear = nodes[near].bounds.intersect(ray, invDir, tMin, tMax);
+                float tFar = nodes[far].bounds.intersect(ray, invDir, tMin, tMax);
+                if (tFar < tNear) {
+                    std::swap(near, far);
+                    std::swap(tNear, tFar);
+                }
+                if (tNear != FLT_MAX) {
+                    if (tFar != FLT_MAX) stack[stackSize++] = far;
+                    nodeIndex = near;
+                    continue;
+                }
+            }
+            // Достаём следующий узел, отбрасывая те, что дальше найденного попадания
+            bool found = false;
+            while (stackSize > 0) {
+                nodeIndex = stack[--stackSize];
+                if (nodes[nodeIndex].bounds.intersect(ray, invDir, tMin, tMax) != FLT_MAX) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) break;
+        }
+        return hitAny;
+    }
+
+    // Любое пересечение на [tMin, tMax] — для теневых лучей
+    template <typename AnyHitFn>
+    bool occluded(const Ray& ray, float tMin, float tMax, AnyHitFn&& hitPrimitive) const {
+        if (nodes.empty()) return false;
+        Vector3 invDir(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+
+        int stack[StackSize];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0) {
+            const BVHNode& node = nodes[stack[--stackSize]];
+            if (node.bounds.intersect(ray, invDir, tMin, tMax) == FLT_MAX) continue;
+            if (node.isLeaf()) {
+                for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+                    if (hitPrimitive(primIndices[i], tMin, tMax)) return true;
+                }
+            } else {
+                stack[stackSize++] = node.leftFirst;
+                stack[stackSize++] = node.leftFirst + 1;
+            }
+        }
+        return false;
+    }
+
+private:
+    void refitNode(int nodeIndex, const std::vector<AABB>& primBounds) {
+        BVHNode& node = nodes[nodeIndex];
+        AABB bounds;
+        if (node.isLeaf()) {
+            for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+                bounds.grow(primBounds[primIndices[i]]);
+            }
+        } else {
+            bounds.grow(nodes[node.leftFirst].bounds);
+            bounds.grow(nodes[node.leftFirst + 1].bounds);
+        }
+        node.bounds = bounds;
+    }
+
+    // Binned SAH по центроидам; возвращает границу разбиения в primIndices или -1,
+    // если выгоднее оставить лист
+    int splitBinned(const BVHNode& node, const AABB& centroidBounds,
+                    const std::vector<AABB>& primBounds, const std::vector<Vector3>& centroids) {
+        Vector3 extent = centroidBounds.max - centroidBounds.min;
+        int axis = 0;
+        if (extent.y > extent.x) axis = 1;
+        if (extent.z > (axis == 0 ? extent.x : extent.y)) axis = 2;
+
+        float axisMin = axis == 0 ? centroidBounds.min.x : axis == 1 ? centroidBounds.min.y : centroidBounds.min.z;
+        float axisExtent = axis == 0 ? extent.x : axis == 1 ? extent.y : extent.z;
+        if (axisExtent <= 0.0f) {
+            // Все центроиды совпадают — делим пополам, чтобы листья оставались маленькими
+            return node.leftFirst + node.count / 2;
+        }
+
+        auto component = [axis](const Vector3& v) { return axis == 0 ? v.x : axis == 1 ? v.y : v.z; };
+        float scale = float(BinCount) / axisExtent;
+
+        AABB binBounds[BinCount];
+        int binCount[BinCount] = {};
+        for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+            int prim = primIndices[i];
+            int bin = std::min(BinCount - 1, int((component(centroids[prim]) - axisMin) * scale));
+            binCount[bin]++;
+            binBounds[bin].grow(primBounds[prim]);
+        }
+
+        float leftArea[BinCount - 1], rightArea[BinCount - 1];
+        int leftCount[BinCount - 1], rightCount[BinCount - 1];
+        AABB leftBox, rightBox;
+        int leftSum = 0, rightSum = 0;
+        for (int i = 0; i < BinCount - 1; i++) {
+            leftSum += binCount[i];
+            leftBox.grow(binBounds[i]);
+            leftCount[i] = leftSum;
+            leftArea[i] = leftBox.surfaceArea();
+
+            rightSum += binCount[BinCount - 1 - i];
+            rightBox.grow(binBounds[BinCount - 1 - i]);
+            rightCount[BinCount - 2 - i] = rightSum;
+            rightArea[BinCount - 2 - i] = rightBox.surfaceArea();
+        }
+
+        int bestSplit = -1;
+        float bestCost = FLT_MAX;
+        for (int i = 0; i < BinCount - 1; i++) {
+            if (leftCount[i] == 0 || rightCount[i] == 0) continue;
+            float splitCost = leftArea[i] * leftCount[i] + rightArea[i] * rightCount[i];
+            if (splitCost < bestCost) {
+                bestCost = splitCost;
+                bestSplit = i;
+            }
+        }
+
+        float leafCost = node.bounds.surfaceArea() * float(node.count);
+        if (bestSplit < 0 || (bestCost >= leafCost && node.count <= 2 * MaxLeafSize)) {
+            return bestSplit < 0 ? node.leftFirst + node.count / 2 : -1;
+        }
+
+        auto begin = primIndices.begin() + node.leftFirst;
+        auto end = begin + node.count;
+        auto mid = std::partition(begin, end, [&](int prim) {
+            int bin = std::min(BinCount - 1, int((component(centroids[prim]) - axisMin) * scale));
+            return bin <= bestSplit;
+        });
+        return int(mid - primIndices.begin());
+    }
+
+    void buildLevels(const std::vector<int>& depth) {
+        int maxDepth = 0;
+        for (int d : depth) maxDepth = std::max(maxDepth, d);
+
+        levelStart.assign(maxDepth + 2, 0);
+        for (int d : depth) levelStart[d + 1]++;
+        for (int d = 0; d <= maxDepth; d++) levelStart[d + 1] += levelStart[d];
+
+        levelOrder.resize(depth.size());
+        std::vector<int> cursor(levelStart.begin(), levelStart.end() - 1);
+        for (int i = 0; i < int(depth.size()); i++) {
+            levelOrder[cursor[depth[i]]++] = i;
+        }
+    }
+};
+
+#endif
@@ -25,6 +25,11 @@ public:
     }
 
     Camera(const Vector3& position, const Vector3& lookAt,
+           float vfov, float aspectRatio)
+            : Camera(position, lookAt, Vector3(0, 1, 0), vfov, aspectRatio) {}
+
+    // up задаёт «верх» кадра; нужен, когда камера смотрит вдоль оси Y
+    Camera(const Vector3& position, const Vector3& lookAt, const Vector3& up,
            float vfov, float aspectRatio) {
         float theta = vfov * 3.14159265359f / 180.0f;
         float halfHeight = tan(theta / 2.0f);
@@ -36,7 +41,6 @@ public:
         Vector3 w = (lookAt - position).normalize();  // <- ИЗМЕНИТЬ НА lookAt - position
 
         // Вспомогательные векторы
-        Vector3 up = Vector3(0, 1, 0);
         Vector3 u = up.cross(w).normalize();  // Правое направление
         Vector3 v = w.cross(u);               // Верхнее направление
 
@@ -48,6 +52,29 @@ public:
         lowerLeftCorner = position - u * halfWidth - v * halfHeight + w;
     }
 
+    // Грань кубической карты из position в порядке GL_TEXTURE_CUBE_MAP_POSITIVE_X + face
+    // (+X, -X, +Y, -Y, +Z, -Z). При строках буфера сверху вниз грань
+    // загружается в glTexImage2D как есть.
+    static Camera cubemapFace(const Vector3& position, int face) {
+        static const Vector3 directions[6] = {
+                Vector3(1, 0, 0), Vector3(-1, 0, 0), Vector3(0, 1, 0),
+                Vector3(0, -1, 0), Vector3(0, 0, 1), Vector3(0, 0, -1)};
+        static const Vector3 ups[6] = {
+                Vector3(0, 1, 0), Vector3(0, 1, 0), Vector3(0, 0, -1),
+                Vector3(0, 0, 1), Vector3(0, 1, 0), Vector3(0, 1, 0)};
+        return Camera(position, position + directions[face], ups[face], 90.0f, 1.0f);
+    }
+
+    // Стереопара с параллельными осями: глаза разнесены на eyeSeparation
+    // вдоль горизонтали кадра, обе камеры смотрят в одном направлении
+    static void stereoPair(const Vector3& position, const Vector3& lookAt, float eyeSeparation,
+                           float vfov, float aspectRatio, Camera& left, Camera& right) {
+        Camera center(position, lookAt, vfov, aspectRatio);
+        Vector3 offset = center.horizontal.normalize() * (eyeSeparation * 0.5f);
+        left = Camera(position - offset, lookAt - offset, vfov, aspectRatio);
+        right = Camera(position + offset, lookAt + offset, vfov, aspectRatio);
+    }
+
     Ray getRay(float u, float v) const {
         return Ray(position,
                    lowerLeftCorner + horizontal * u + vertical * v - position);
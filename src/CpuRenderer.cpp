@@ -0,0 +1,423 @@
+#include "CpuRenderer.hpp"
+#include "ThreadPool.hpp"
+#include "RenderTrace.hpp"
+#include "Sampler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+Vector3 CpuRenderer::traceRay(const Ray& ray, const Scene& scene, int depth) const {
+    if (depth > 3) return scene.backgroundColor;
+
+    HitRecord hit = scene.intersect(ray);
+    if (!hit.hit) return scene.backgroundColor;
+
+    return shade(ray, hit, scene);
+}
+
+namespace {
+
+// Может ли у какого-нибудь материала сцены быть блик. Облака и сетки
+// экземпляров не перебираются — для них считается, что может.
+bool sceneHasSpecular(const Scene& scene) {
+    if (!scene.clouds.empty() || !scene.groups.empty()) return true;
+    for (const Sphere& sphere : scene.spheres) {
+        if (sphere.material.specular != 0.0f) return true;
+    }
+    for (const Mesh& mesh : scene.meshes) {
+        if (mesh.material.specular != 0.0f) return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+Vector3 CpuRenderer::shade(const Ray& ray, const HitRecord& hit, const Scene& scene) const {
+    switch (shadowMode(scene)) {
+        case ShadowMode::None: return shadeKernel<-1, ShadowMode::None, true>(ray, hit, scene);
+        case ShadowMode::Cached: return shadeKernel<-1, ShadowMode::Cached, true>(ray, hit, scene);
+        default: return shadeKernel<-1, ShadowMode::Traced, true>(ray, hit, scene);
+    }
+}
+
+template <int LightCount, CpuRenderer::ShadowMode Shadows, bool Specular>
+Vector3 CpuRenderer::shadeKernel(const Ray& ray, const HitRecord& hit, const Scene& scene) const {
+    Vector3 viewDir = (ray.origin - hit.point).normalize();
+    Vector3 color(0, 0, 0);
+
+    color = color + hit.material.color * hit.material.ambient;
+
+    // Для сфер видимость источников берётся из кэша, если он подготовлен
+    bool cached = Shadows == ShadowMode::Cached && hit.sphere >= 0;
+    uint32_t lightMask = cached ? shadingCache.lightMask(scene, hit.sphere, hit.normal) : 0;
+
+    const int lightCount = LightCount >= 0 ? LightCount : int(scene.lights.size());
+    for (int i = 0; i < lightCount; i++) {
+        const Light& light = scene.lights[i];
+        if constexpr (Shadows != ShadowMode::None) {
+            bool shadowed = cached ? !(lightMask & (1u << i)) : scene.isInShadow(hit.point, light.position);
+            if (shadowed) {
+                continue;
+            }
+        }
+
+        Vector3 lightDir = (light.position - hit.point).normalize();
+
+        float diffuseIntensity = std::max(0.0f, hit.normal.dot(lightDir));
+        Vector3 diffuse = hit.material.color * hit.material.diffuse *
+                          diffuseIntensity * light.color * light.intensity;
+        color = color + diffuse;
+
+        // Нулевой блик ничего не добавляет — pow не считается
+        if (Specular && hit.material.specular != 0.0f) {
+            Vector3 reflectDir = lightDir.reflect(hit.normal) * -1.0f;
+            float specularIntensity = std::pow(std::max(0.0f, viewDir.dot(reflectDir)),
+                                               hit.material.shininess);
+            Vector3 specular = light.color * hit.material.specular *
+                               specularIntensity * light.intensity;
+            color = color + specular;
+        }
+    }
+
+    return color;
+}
+
+CpuRenderer::ShadowMode CpuRenderer::shadowMode(const Scene& scene) const {
+    if (!shadows) return ShadowMode::None;
+    return cacheShading && shadingCache.validFor(scene) ? ShadowMode::Cached : ShadowMode::Traced;
+}
+
+// Вызывается после shadingCache.prepare: от него зависит режим теней
+CpuRenderer::ShadeKernel CpuRenderer::selectShadeKernel(const Scene& scene) const {
+    using Row = ShadeKernel[4];  // 1, 2, 4 и любое число источников
+    static constexpr Row kernels[3][2] = {
+            {{&CpuRenderer::shadeKernel<1, ShadowMode::None, false>, &CpuRenderer::shadeKernel<2, ShadowMode::None, false>,
+              &CpuRenderer::shadeKernel<4, ShadowMode::None, false>, &CpuRenderer::shadeKernel<-1, ShadowMode::None, false>},
+             {&CpuRenderer::shadeKernel<1, ShadowMode::None, true>, &CpuRenderer::shadeKernel<2, ShadowMode::None, true>,
+              &CpuRenderer::shadeKernel<4, ShadowMode::None, true>, &CpuRenderer::shadeKernel<-1, ShadowMode::None, true>}},
+            {{&CpuRenderer::shadeKernel<1, ShadowMode::Traced, false>, &CpuRenderer::shadeKernel<2, ShadowMode::Traced, false>,
+              &CpuRenderer::shadeKernel<4, ShadowMode::Traced, false>, &CpuRenderer::shadeKernel<-1, ShadowMode::Traced, false>},
+             {&CpuRenderer::shadeKernel<1, ShadowMode::Traced, true>, &CpuRenderer::shadeKernel<2, ShadowMode::Traced, true>,
+              &CpuRenderer::shadeKernel<4, ShadowMode::Traced, true>, &CpuRenderer::shadeKernel<-1, ShadowMode::Traced, true>}},
+            {{&CpuRenderer::shadeKernel<1, ShadowMode::Cached, false>, &CpuRenderer::shadeKernel<2, ShadowMode::Cached, false>,
+              &CpuRenderer::shadeKernel<4, ShadowMode::Cached, false>, &CpuRenderer::shadeKernel<-1, ShadowMode::Cached, false>},
+             {&CpuRenderer::shadeKernel<1, ShadowMode::Cached, true>, &CpuRenderer::shadeKernel<2, ShadowMode::Cached, true>,
+              &CpuRenderer::shadeKernel<4, ShadowMode::Cached, true>, &CpuRenderer::shadeKernel<-1, ShadowMode::Cached, true>}},
+    };
+    size_t lights = scene.lights.size();
+    int column = lights == 1 ? 0 : lights == 2 ? 1 : lights == 4 ? 2 : 3;
+    return kernels[int(shadowMode(scene))][sceneHasSpecular(scene)][column];
+}
+
+template <typename RenderAt>
+void CpuRenderer::forEachTile(const Scene& scene, int count, const int* nodeBegin, const RenderAt& renderAt) const {
+    ThreadPool& pool = ThreadPool::shared();
+    if (!nodeBegin) {
+        pool.parallelFor(0, count, 1, [&](int begin, int end) {
+            for (int k = begin; k < end; k++) renderAt(k, scene);
+        });
+        return;
+    }
+
+    updateReplicas(scene);
+    pool.parallelForNodes(nodeBegin, 1, [&](int begin, int end) {
+        auto start = std::chrono::steady_clock::now();
+        int node = pool.currentNode();
+        const Scene& local = nodeScene(scene, node);
+        long long pixels = 0;
+        for (int k = begin; k < end; k++) pixels += renderAt(k, local);
+
+        NodeCounters& counters = nodeCounters[node];
+        counters.tiles.fetch_add(end - begin, std::memory_order_relaxed);
+        counters.pixels.fetch_add(pixels, std::memory_order_relaxed);
+        if (begin < nodeBegin[node] || begin >= nodeBegin[node + 1]) {
+            counters.remoteTiles.fetch_add(end - begin, std::memory_order_relaxed);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        counters.busyNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                                           std::memory_order_relaxed);
+    });
+}
+
+void CpuRenderer::render(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                         int samplesPerPixel) const {
+    RenderView view;
+    view.camera = camera;
+    view.frame = &frame;
+    renderViews(scene, &view, 1, samplesPerPixel);
+}
+
+void CpuRenderer::renderViews(const Scene& scene, const RenderView* views, int viewCount,
+                              int samplesPerPixel) const {
+    if (int(viewBins.size()) < viewCount) viewBins.resize(viewCount);
+    viewports.resize(viewCount);
+    tileStart.resize(viewCount + 1);
+
+#ifdef RAYTRACER_TRACE
+    RenderTrace::instance().beginFrame(tileSize);
+#endif
+
+    if (cacheShading) shadingCache.prepare(scene);
+    ShadeKernel shadeHit = selectShadeKernel(scene);
+
+    // Списки кандидатов строятся по тем же тайлам, что и рендер, поэтому
+    // у каждого тайла ровно один список
+    bool binned = binPrimaryRays && !scene.spheres.empty();
+    tileStart[0] = 0;
+    for (int v = 0; v < viewCount; v++) {
+        const RenderView& view = views[v];
+        Viewport& viewport = viewports[v];
+        viewport.x = view.x;
+        viewport.y = view.y;
+        viewport.width = view.width > 0 ? view.width : view.frame->width;
+        viewport.height = view.height > 0 ? view.height : view.frame->height;
+        if (binned) viewBins[v].build(scene, view.camera, viewport.width, viewport.height, tileSize);
+        int tilesX = (viewport.width + tileSize - 1) / tileSize;
+        int tilesY = (viewport.height + tileSize - 1) / tileSize;
+        tileStart[v + 1] = tileStart[v] + tilesX * tilesY;
+    }
+
+    // Полосы узлов — целые строки тайлов, общий счёт строк по всем видам
+    int nodeBegin[NumaTopology::MaxNodes + 1];
+    if (numaAware) {
+        int rows = 0;
+        for (int v = 0; v < viewCount; v++) rows += (viewports[v].height + tileSize - 1) / tileSize;
+        ThreadPool& pool = ThreadPool::shared();
+        pool.splitByNodes(rows, nodeBegin);
+        for (int i = 0; i <= pool.nodeCount(); i++) {
+            int row = nodeBegin[i], v = 0;
+            for (;; v++) {
+                int tilesX = (viewports[v].width + tileSize - 1) / tileSize;
+                int tilesY = (viewports[v].height + tileSize - 1) / tileSize;
+                if (row < tilesY || v == viewCount - 1) {
+                    nodeBegin[i] = std::min(tileStart[v] + row * tilesX, tileStart[viewCount]);
+                    break;
+                }
+                row -= tilesY;
+            }
+        }
+    }
+
+    forEachTile(scene, tileStart[viewCount], numaAware ? nodeBegin : nullptr,
+                [&](int tile, const Scene& local) {
+        int v = int(std::upper_bound(tileStart.begin(), tileStart.begin() + viewCount, tile) - tileStart.begin()) - 1;
+        const Viewport& viewport = viewports[v];
+        int index = tile - tileStart[v];
+        int tilesX = (viewport.width + tileSize - 1) / tileSize;
+        int x0 = (index % tilesX) * tileSize;
+        int y0 = (index / tilesX) * tileSize;
+        int x1 = std::min(x0 + tileSize, viewport.width);
+        int y1 = std::min(y0 + tileSize, viewport.height);
+        TRACE_TILE((viewport.x + x0) / tileSize, (viewport.y + y0) / tileSize);
+        renderTile(local, views[v].camera, *views[v].frame, viewport, x0, y0, x1, y1, samplesPerPixel,
+                   binned ? &viewBins[v] : nullptr, shadeHit);
+        return (x1 - x0) * (y1 - y0);
+    });
+}
+
+int CpuRenderer::renderIncremental(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                                   DirtyRegions& regions, int samplesPerPixel) const {
+    const std::vector<int>* tiles = &allTiles;
+    if (regions.update(scene, camera, frame.width, frame.height, tileSize)) {
+        tiles = &regions.collectDirtyTiles(scene);
+    } else {
+        allTiles.resize(regions.tileCount());
+        std::iota(allTiles.begin(), allTiles.end(), 0);
+    }
+    if (tiles->empty()) return 0;
+    renderTileList(scene, camera, frame, *tiles, samplesPerPixel, &regions, nullptr);
+    return int(tiles->size());
+}
+
+void CpuRenderer::renderTiles(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                              const std::vector<int>& tiles, int samplesPerPixel,
+                              const std::function<void(int)>& tileDone) const {
+    if (tiles.empty()) return;
+    renderTileList(scene, camera, frame, tiles, samplesPerPixel, nullptr, tileDone ? &tileDone : nullptr);
+}
+
+void CpuRenderer::renderTileList(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                                 const std::vector<int>& tiles, int samplesPerPixel, DirtyRegions* regions,
+                                 const std::function<void(int)>* tileDone) const {
+#ifdef RAYTRACER_TRACE
+    RenderTrace::instance().beginFrame(tileSize);
+#endif
+
+    if (cacheShading) shadingCache.prepare(scene);
+    ShadeKernel shadeHit = selectShadeKernel(scene);
+    bool binned = binPrimaryRays && !scene.spheres.empty();
+    if (binned) tileListBins.build(scene, camera, frame.width, frame.height, tileSize);
+
+    const Viewport viewport = {0, 0, frame.width, frame.height};
+    const int tilesX = (frame.width + tileSize - 1) / tileSize;
+
+    // Список тайлов упорядочен, поэтому полоса строк узла — отрезок списка
+    int nodeBegin[NumaTopology::MaxNodes + 1];
+    if (numaAware) {
+        ThreadPool& pool = ThreadPool::shared();
+        pool.splitByNodes((frame.height + tileSize - 1) / tileSize, nodeBegin);
+        for (int i = 0; i <= pool.nodeCount(); i++) {
+            nodeBegin[i] = int(std::lower_bound(tiles.begin(), tiles.end(), nodeBegin[i] * tilesX) - tiles.begin());
+        }
+    }
+
+    forEachTile(scene, int(tiles.size()), numaAware ? nodeBegin : nullptr, [&](int k, const Scene& local) {
+        int tile = tiles[k];
+        int x0 = (tile % tilesX) * tileSize;
+        int y0 = (tile / tilesX) * tileSize;
+        int x1 = std::min(x0 + tileSize, frame.width);
+        int y1 = std::min(y0 + tileSize, frame.height);
+        TRACE_TILE(x0 / tileSize, y0 / tileSize);
+        AABB* hits = nullptr;
+        if (regions) {
+            hits = &regions->tileHits(tile);
+            *hits = AABB();
+        }
+        renderTile(local, camera, frame, viewport, x0, y0, x1, y1, samplesPerPixel,
+                   binned ? &tileListBins : nullptr, shadeHit, hits);
+        if (tileDone) (*tileDone)(tile);
+        return (x1 - x0) * (y1 - y0);
+    });
+}
+
+const Scene& CpuRenderer::nodeScene(const Scene& scene, int node) const {
+    return node < int(replicas.size()) && replicas[node] ? *replicas[node] : scene;
+}
+
+// Копия для узла создаётся потоком этого узла, чтобы её страницы легли в
+// его память. Сцена только читается, поэтому копии равноценны оригиналу.
+// Облака (SphereCloud) общие: их данные отображены из файла.
+void CpuRenderer::updateReplicas(const Scene& scene) const {
+    ThreadPool& pool = ThreadPool::shared();
+    int nodes = pool.nodeCount();
+    if (nodes == 1) {
+        replicas.clear();
+        return;
+    }
+    if (int(replicas.size()) == nodes && replicaSource == &scene && replicaRevision == scene.getRevision()) return;
+
+    replicas.resize(nodes);
+    int nodeBegin[NumaTopology::MaxNodes + 1];
+    for (int i = 0; i <= nodes; i++) nodeBegin[i] = i;
+    pool.parallelForNodes(nodeBegin, 1, [&](int begin, int end) {
+        for (int node = begin; node < end; node++) replicas[node] = std::make_unique<Scene>(scene);
+    });
+    replicaSource = &scene;
+    replicaRevision = scene.getRevision();
+}
+
+void CpuRenderer::resizeFrame(FrameBuffer& frame, int width, int height, bool withAux) const {
+    if (!numaAware) {
+        frame.resize(width, height, withAux);
+        return;
+    }
+    if (frame.width == width && frame.height == height && frame.hasAux == withAux) return;
+
+    // Те же полосы строк тайлов, что и в renderViews для одного вида
+    frame.allocate(width, height, withAux);
+    ThreadPool& pool = ThreadPool::shared();
+    int nodeBegin[NumaTopology::MaxNodes + 1];
+    pool.splitByNodes((height + tileSize - 1) / tileSize, nodeBegin);
+    pool.parallelForNodes(nodeBegin, 1, [&](int begin, int end) {
+        frame.clearRows(begin * tileSize, std::min(end * tileSize, height));
+    });
+}
+
+CpuRenderer::NodeStats CpuRenderer::nodeStats(int node) const {
+    const NodeCounters& counters = nodeCounters[node];
+    NodeStats stats;
+    stats.tiles = counters.tiles.load(std::memory_order_relaxed);
+    stats.pixels = counters.pixels.load(std::memory_order_relaxed);
+    stats.remoteTiles = counters.remoteTiles.load(std::memory_order_relaxed);
+    stats.busySeconds = double(counters.busyNanoseconds.load(std::memory_order_relaxed)) * 1e-9;
+    return stats;
+}
+
+void CpuRenderer::resetNodeStats() {
+    for (NodeCounters& counters : nodeCounters) {
+        counters.tiles.store(0, std::memory_order_relaxed);
+        counters.pixels.store(0, std::memory_order_relaxed);
+        counters.remoteTiles.store(0, std::memory_order_relaxed);
+        counters.busyNanoseconds.store(0, std::memory_order_relaxed);
+    }
+}
+
+void CpuRenderer::renderTile(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                             const Viewport& viewport, int x0, int y0, int x1, int y1,
+                             int samplesPerPixel, const PrimaryVisibility* bins, ShadeKernel shadeHit,
+                             AABB* hitBounds) const {
+    const int width = viewport.width;
+    const int height = viewport.height;
+    const size_t planeSize = frame.pixelCount();
+    const float invSamples = 1.0f / float(samplesPerPixel);
+    Sampler sampler(samplerType, samplerSeed);
+
+    // Слишком длинный список выгоднее обойти через BVH сцены
+    const SphereCandidate* candidates = nullptr;
+    int candidateCount = 0;
+    if (bins) {
+        int tile = bins->tileOf(x0, y0);
+        candidateCount = bins->candidateCount(tile);
+        if (candidateCount <= bins->maxCandidates || !scene.hasSphereAcceleration()) {
+            candidates = bins->candidatesOf(tile);
+        } else {
+            bins = nullptr;
+        }
+    }
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            size_t idx = size_t(viewport.y + y) * frame.width + viewport.x + x;
+            Vector3 color, normal, albedo;
+            float depth = 0.0f;
+
+            for (int s = 0; s < samplesPerPixel; s++) {
+                // Один сэмпл берётся в углу пикселя, как и в GPU-версии;
+                // при нескольких — сдвиг внутри пикселя из sampler
+                float jx = 0.0f, jy = 0.0f;
+                if (samplesPerPixel > 1) {
+                    sampler.startPixel(x, y, uint32_t(s));
+                    sampler.get2D(jx, jy);
+                }
+                float u = (float(x) + jx) / float(width);
+                float v = (float(height - 1 - y) + jy) / float(height);
+
+                Ray ray = camera.getRay(u, v);
+                TRACE_COUNT(raysCast, 1);
+                HitRecord hit = bins ? scene.intersectCandidates(ray, candidates, candidateCount)
+                                     : scene.intersect(ray);
+                if (hit.hit) {
+                    if (hitBounds) hitBounds->grow(hit.point);
+                    color = color + (this->*shadeHit)(ray, hit, scene);
+                    normal = normal + hit.normal;
+                    albedo = albedo + hit.material.color;
+                    depth += hit.t;
+                } else {
+                    color = color + scene.backgroundColor;
+                    albedo = albedo + scene.backgroundColor;
+                    depth += hit.t;
+                }
+            }
+
+            color = color * invSamples;
+            frame.color[idx] = color.x;
+            frame.color[idx + planeSize] = color.y;
+            frame.color[idx + 2 * planeSize] = color.z;
+
+            if (frame.hasAux) {
+                normal = normal * invSamples;
+                albedo = albedo * invSamples;
+                frame.normal[idx] = normal.x;
+                frame.normal[idx + planeSize] = normal.y;
+                frame.normal[idx + 2 * planeSize] = normal.z;
+                frame.albedo[idx] = albedo.x;
+                frame.albedo[idx + planeSize] = albedo.y;
+                frame.albedo[idx + 2 * planeSize] = albedo.z;
+                frame.depth[idx] = depth * invSamples;
+            }
+        }
+    }
+}
@@ -0,0 +1,160 @@
+#ifndef CPURENDERER_HPP
+#define CPURENDERER_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Scene.hpp"
+#include "Camera.hpp"
+#include "FrameBuffer.hpp"
+#include "Sampler.hpp"
+#include "PrimaryVisibility.hpp"
+#include "ShadingCache.hpp"
+#include "DirtyRegions.hpp"
+#include "NumaTopology.hpp"
+
+// Один вид пакетного рендера: камера и прямоугольник в буфере frame, куда
+// пишется изображение. Нулевые width и height — весь буфер. Несколько видов
+// могут делить один буфер (стереопара бок о бок).
+struct RenderView {
+    Camera camera;
+    FrameBuffer* frame = nullptr;
+    int x = 0, y = 0;
+    int width = 0, height = 0;
+};
+
+// Трассировка на CPU без зависимости от OpenGL.
+// Кадр делится на тайлы, которые параллельно обрабатываются в ThreadPool::shared().
+// Буферы кадра принадлежат экземпляру, поэтому один экземпляр рендерит из
+// одного потока за раз; параллельным вызывающим (демон) — по экземпляру.
+class CpuRenderer {
+public:
+    int tileSize = 16;
+    // Точки сэмплирования внутри пикселя при samplesPerPixel > 1
+    SamplerType samplerType = SamplerType::Sobol;
+    uint32_t samplerSeed = 0;
+    // Первичные лучи проверяют только сферы, чья проекция задевает их тайл
+    bool binPrimaryRays = true;
+    // Тени на сферах берутся из shadingCache, пока сцена не меняется;
+    // освещение по кадру считается без теневых лучей
+    bool cacheShading = false;
+    mutable ShadingCache shadingCache;
+    // Теневые лучи; без них — быстрый предпросмотр
+    bool shadows = true;
+    // Режим для машин с несколькими узлами NUMA (пул закреплён через
+    // ThreadPool::pinToNodes): кадр режется на полосы строк тайлов по узлам,
+    // потоки узла читают свою копию сцены, а resizeFrame кладёт полосы
+    // буфера в память их узлов. Копии обновляются по Scene::getRevision.
+    bool numaAware = false;
+
+    // Работа узла в NUMA-режиме с последнего resetNodeStats
+    struct NodeStats {
+        long long tiles = 0;
+        long long pixels = 0;
+        long long remoteTiles = 0;  // взято из полосы другого узла
+        double busySeconds = 0.0;   // сумма по потокам узла
+    };
+
+    Vector3 traceRay(const Ray& ray, const Scene& scene, int depth = 0) const;
+
+    // Освещение по Фонгу в уже найденной точке попадания
+    Vector3 shade(const Ray& ray, const HitRecord& hit, const Scene& scene) const;
+
+    // Рендер в линейный буфер размера frame.width x frame.height.
+    // При frame.hasAux дополнительно заполняются нормаль, альбедо и глубина
+    // первого попадания (усреднённые по сэмплам пикселя).
+    void render(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                int samplesPerPixel = 1) const;
+
+    // Несколько видов одной сцены за один проход: тайлы всех видов идут
+    // в один parallelFor, подготовка сцены (кэш теней, BVH) общая.
+    // Буферы видов должны быть уже нужного размера.
+    void renderViews(const Scene& scene, const RenderView* views, int viewCount,
+                     int samplesPerPixel = 1) const;
+
+    // Повторный кадр после правки сцены: трассируются только тайлы, которые
+    // могли измениться с прошлого вызова с тем же regions, остальное
+    // остаётся в frame. Первый вызов, смена камеры или размера — полный кадр.
+    // Возвращает число перерисованных тайлов.
+    int renderIncremental(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                          DirtyRegions& regions, int samplesPerPixel = 1) const;
+
+    // Только тайлы tiles (индексы по возрастанию в сетке tileSize по frame),
+    // остальное в frame не трогается. tileDone(tile), если задан, вызывается
+    // из потока, закончившего тайл, сразу после его записи в frame.
+    // Пиксели тайла те же, что дал бы render с теми же настройками.
+    void renderTiles(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                     const std::vector<int>& tiles, int samplesPerPixel = 1,
+                     const std::function<void(int)>& tileDone = {}) const;
+
+    // frame.resize для последующего render; в NUMA-режиме строки каждой
+    // полосы первыми записывают потоки её узла
+    void resizeFrame(FrameBuffer& frame, int width, int height, bool withAux) const;
+
+    NodeStats nodeStats(int node) const;
+    void resetNodeStats();
+
+private:
+    struct Viewport {
+        int x, y, width, height;
+    };
+
+    // Варианты shade, собранные под конфигурацию сцены: число источников
+    // известно при компиляции (-1 — любое), ненужные ветви вырезаны.
+    // Вариант выбирается раз в кадр в selectShadeKernel.
+    enum class ShadowMode { None, Traced, Cached };
+    using ShadeKernel = Vector3 (CpuRenderer::*)(const Ray&, const HitRecord&, const Scene&) const;
+
+    template <int LightCount, ShadowMode Shadows, bool Specular>
+    Vector3 shadeKernel(const Ray& ray, const HitRecord& hit, const Scene& scene) const;
+    ShadowMode shadowMode(const Scene& scene) const;
+    ShadeKernel selectShadeKernel(const Scene& scene) const;
+
+    struct alignas(64) NodeCounters {
+        std::atomic<long long> tiles{0};
+        std::atomic<long long> pixels{0};
+        std::atomic<long long> remoteTiles{0};
+        std::atomic<long long> busyNanoseconds{0};
+    };
+
+    // Состояние пакета renderViews; живёт между кадрами. Не thread_local:
+    // тайлы читают его из потоков пула
+    mutable std::vector<PrimaryVisibility> viewBins;  // списки кандидатов первичных лучей
+    mutable std::vector<Viewport> viewports;
+    mutable std::vector<int> tileStart;  // первый тайл каждого вида
+    // То же для renderIncremental и renderTiles
+    mutable PrimaryVisibility tileListBins;
+    mutable std::vector<int> allTiles;
+
+    // Копии сцены по узлам; при одном узле копий нет
+    mutable std::vector<std::unique_ptr<Scene>> replicas;
+    mutable const Scene* replicaSource = nullptr;
+    mutable unsigned long long replicaRevision = 0;
+    mutable NodeCounters nodeCounters[NumaTopology::MaxNodes];
+
+    // Сцена, которую читают потоки узла node
+    const Scene& nodeScene(const Scene& scene, int node) const;
+    void updateReplicas(const Scene& scene) const;
+
+    // Общая часть renderIncremental и renderTiles; regions, если задан,
+    // получает границы попаданий тайлов
+    void renderTileList(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                        const std::vector<int>& tiles, int samplesPerPixel, DirtyRegions* regions,
+                        const std::function<void(int)>* tileDone) const;
+
+    // Вызывает renderAt(k, nodeScene) для k в [0, count) в пуле. В
+    // NUMA-режиме k из [nodeBegin[i], nodeBegin[i + 1]) — полоса узла i;
+    // renderAt возвращает число пикселей для счётчиков
+    template <typename RenderAt>
+    void forEachTile(const Scene& scene, int count, const int* nodeBegin, const RenderAt& renderAt) const;
+
+    // x0..x1, y0..y1 — в координатах вида. hitBounds, если задан,
+    // расширяется точками первичных попаданий
+    void renderTile(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                    const Viewport& viewport, int x0, int y0, int x1, int y1,
+                    int samplesPerPixel, const PrimaryVisibility* bins, ShadeKernel shadeHit,
+                    AABB* hitBounds = nullptr) const;
+};
+
+#endif
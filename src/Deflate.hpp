@@ -0,0 +1,376 @@
+#ifndef DEFLATE_HPP
+#define DEFLATE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <vector>
+
+// Самодостаточный DEFLATE-кодер (RFC 1951): LZ77 на хеш-цепочках и блоки
+// с динамическими кодами Хаффмана. Каждый вызов compress() сжимает независимый
+// кусок; если кусок не последний, он завершается пустым stored-блоком для
+// выравнивания на байт, поэтому куски, сжатые параллельно, можно просто склеить.
+class Deflate {
+public:
+    int maxChainLength = 24;
+
+    void compress(const unsigned char* data, size_t size, bool isFinal,
+                  std::vector<unsigned char>& out) {
+        bitBuffer = 0;
+        bitCount = 0;
+        output = &out;
+
+        head.assign(HashSize, -1);
+        prev.assign(std::min(size, size_t(WindowSize)), -1);
+
+        size_t pos = 0;
+        do {
+            tokens.clear();
+            pos = tokenize(data, size, pos);
+            bool lastBlock = isFinal && pos >= size;
+            writeDynamicBlock(lastBlock);
+        } while (pos < size);
+
+        if (!isFinal) {
+            // Пустой stored-блок: выравнивание на байт для склейки со следующим куском
+            writeBits(0, 1);
+            writeBits(0, 2);
+        }
+        flushBits();
+        if (!isFinal) {
+            out.push_back(0x00);
+            out.push_back(0x00);
+            out.push_back(0xFF);
+            out.push_back(0xFF);
+        }
+    }
+
+    static uint32_t adler32(const unsigned char* data, size_t size, uint32_t adler = 1) {
+        uint32_t a = adler & 0xFFFF;
+        uint32_t b = adler >> 16;
+        while (size > 0) {
+            size_t n = std::min(size, size_t(5552));
+            size -= n;
+            for (size_t i = 0; i < n; i++) {
+                a += data[i];
+                b += a;
+            }
+            data += n;
+            a %= AdlerBase;
+            b %= AdlerBase;
+        }
+        return (b << 16) | a;
+    }
+
+    // Adler-32 конкатенации по контрольным суммам частей (как adler32_combine в zlib)
+    static uint32_t adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2) {
+        uint32_t rem = uint32_t(length2 % AdlerBase);
+        uint32_t sum1 = adler1 & 0xFFFF;
+        uint32_t sum2 = uint32_t((uint64_t(rem) * sum1) % AdlerBase);
+        sum1 += (adler2 & 0xFFFF) + AdlerBase - 1;
+        sum2 += (adler1 >> 16) + (adler2 >> 16) + AdlerBase - rem;
+        if (sum1 >= AdlerBase) sum1 -= AdlerBase;
+        if (sum1 >= AdlerBase) sum1 -= AdlerBase;
+        if (sum2 >= 2 * AdlerBase) sum2 -= 2 * AdlerBase;
+        if (sum2 >= AdlerBase) sum2 -= AdlerBase;
+        return sum1 | (sum2 << 16);
+    }
+
+private:
+    static constexpr uint32_t AdlerBase = 65521;
+    static constexpr int WindowSize = 32768;
+    static constexpr int HashBits = 15;
+    static constexpr int HashSize = 1 << HashBits;
+    static constexpr int MinMatch = 3;
+    static constexpr int MaxMatch = 258;
+    static constexpr size_t MaxBlockTokens = 1 << 16;
+
+    // Токен: литерал (length == 0) или совпадение длины length на расстоянии distance
+    struct Token {
+        uint16_t length;
+        uint16_t literalOrDistance;
+    };
+
+    std::vector<int> head;
+    std::vector<int> prev;
+    std::vector<Token> tokens;
+    std::vector<unsigned char>* output = nullptr;
+    uint64_t bitBuffer = 0;
+    int bitCount = 0;
+
+    static const uint16_t* lengthBase() {
+        static const uint16_t table[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                           35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        return table;
+    }
+    static const uint8_t* lengthExtra() {
+        static const uint8_t table[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                          3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        return table;
+    }
+    static const uint16_t* distanceBase() {
+        static const uint16_t table[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                           257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                           8193, 12289, 16385, 24577};
+        return table;
+    }
+    static const uint8_t* distanceExtra() {
+        static const uint8_t table[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                          7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+        return table;
+    }
+
+    static int lengthCode(int length) {
+        int code = 28;
+        while (lengthBase()[code] > length) code--;
+        return code;
+    }
+
+    static int distanceCode(int distance) {
+        int code = 29;
+        while (distanceBase()[code] > distance) code--;
+        return code;
+    }
+
+    static uint32_t hash3(const unsigned char* p) {
+        uint32_t v = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16);
+        return (v * 2654435761u) >> (32 - HashBits);
+    }
+
+    void insertHash(const unsigned char* data, size_t size, size_t pos) {
+        if (pos + MinMatch > size) return;
+        uint32_t h = hash3(data + pos);
+        prev[pos % prev.size()] = head[h];
+        head[h] = int(pos);
+    }
+
+    // Жадный LZ77 до MaxBlockTokens токенов; возвращает новую позицию
+    size_t tokenize(const unsigned char* data, size_t size, size_t pos) {
+        while (pos < size && tokens.size() < MaxBlockTokens) {
+            int bestLength = 0;
+            int bestDistance = 0;
+
+            if (pos + MinMatch <= size) {
+                uint32_t h = hash3(data + pos);
+                int candidate = head[h];
+                int chain = maxChainLength;
+                size_t maxLength = std::min(size_t(MaxMatch), size - pos);
+                while (candidate >= 0 && chain-- > 0) {
+                    size_t distance = pos - size_t(candidate);
+                    if (distance > size_t(WindowSize) || distance == 0) break;
+                    const unsigned char* a = data + candidate;
+                    const unsigned char* b = data + pos;
+                    if (a[bestLength] == b[bestLength]) {
+                        size_t length = 0;
+                        while (length < maxLength && a[length] == b[length]) length++;
+                        if (int(length) > bestLength) {
+                            bestLength = int(length);
+                            bestDistance = int(distance);
+                            if (length == maxLength) break;
+                        }
+                    }
+                    int next = prev[size_t(candidate) % prev.size()];
+                    if (next >= candidate) break;
+                    candidate = next;
+                }
+            }
+
+            if (bestLength >= MinMatch) {
+                tokens.push_back(Token{uint16_t(bestLength), uint16_t(bestDistance)});
+                for (int i = 0; i < bestLength; i++) insertHash(data, size, pos + i);
+                pos += bestLength;
+            } else {
+                tokens.push_back(Token{0, data[pos]});
+                insertHash(data, size, pos);
+                pos++;
+            }
+        }
+        return pos;
+    }
+
+    void writeBits(uint32_t value, int count) {
+        bitBuffer |= uint64_t(value) << bitCount;
+        bitCount += count;
+        while (bitCount >= 8) {
+            output->push_back(static_cast<unsigned char>(bitBuffer));
+            bitBuffer >>= 8;
+            bitCount -= 8;
+        }
+    }
+
+    void flushBits() {
+        if (bitCount > 0) output->push_back(static_cast<unsigned char>(bitBuffer));
+        bitBuffer = 0;
+        bitCount = 0;
+    }
+
+    // Длины кодов Хаффмана, ограниченные maxLength: при переполнении частоты
+    // сглаживаются и дерево строится заново
+    static void buildLengths(const std::vector<uint32_t>& freqs, int maxLength,
+                             std::vector<uint8_t>& lengths) {
+        size_t n = freqs.size();
+        lengths.assign(n, 0);
+        std::vector<uint32_t> f(freqs);
+
+        for (;;) {
+            struct Node { uint64_t weight; int left; int right; };
+            std::vector<Node> nodes;
+            using Entry = std::pair<uint64_t, int>;
+            std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+            for (size_t i = 0; i < n; i++) {
+                if (f[i] > 0) {
+                    nodes.push_back(Node{f[i], -1, int(i)});
+                    heap.push(Entry(f[i], int(nodes.size()) - 1));
+                }
+            }
+            if (nodes.empty()) return;
+            if (nodes.size() == 1) {
+                lengths[nodes[0].right] = 1;
+                return;
+            }
+            while (heap.size() > 1) {
+                Entry a = heap.top(); heap.pop();
+                Entry b = heap.top(); heap.pop();
+                nodes.push_back(Node{a.first + b.first, a.second, b.second});
+                heap.push(Entry(a.first + b.first, int(nodes.size()) - 1));
+            }
+
+            int longest = 0;
+            std::vector<std::pair<int, int>> stack{{heap.top().second, 0}};
+            while (!stack.empty()) {
+                auto [node, depth] = stack.back();
+                stack.pop_back();
+                if (nodes[node].left < 0) {
+                    lengths[nodes[node].right] = uint8_t(depth);
+                    longest = std::max(longest, depth);
+                } else {
+                    stack.push_back({nodes[node].left, depth + 1});
+                    stack.push_back({nodes[node].right, depth + 1});
+                }
+            }
+            if (longest <= maxLength) return;
+
+            for (auto& value : f) {
+                if (value > 0) value = (value >> 1) | 1;
+            }
+            lengths.assign(n, 0);
+        }
+    }
+
+    // Канонические коды, уже развёрнутые для записи младшим битом вперёд
+    static void buildCodes(const std::vector<uint8_t>& lengths, std::vector<uint16_t>& codes) {
+        int count[16] = {};
+        for (uint8_t length : lengths) count[length]++;
+        count[0] = 0;
+        int next[16] = {};
+        int code = 0;
+        for (int bits = 1; bits < 16; bits++) {
+            code = (code + count[bits - 1]) << 1;
+            next[bits] = code;
+        }
+        codes.assign(lengths.size(), 0);
+        for (size_t i = 0; i < lengths.size(); i++) {
+            int length = lengths[i];
+            if (length == 0) continue;
+            int c = next[length]++;
+            int reversed = 0;
+            for (int b = 0; b < length; b++) reversed |= ((c >> b) & 1) << (length - 1 - b);
+            codes[i] = uint16_t(reversed);
+        }
+    }
+
+    void writeDynamicBlock(bool lastBlock) {
+        std::vector<uint32_t> litFreq(286, 0);
+        std::vector<uint32_t> distFreq(30, 0);
+        for (const Token& token : tokens) {
+            if (token.length == 0) {
+                litFreq[token.literalOrDistance]++;
+            } else {
+                litFreq[257 + lengthCode(token.length)]++;
+                distFreq[distanceCode(token.literalOrDistance)]++;
+            }
+        }
+        litFreq[256] = 1;
+        // Хотя бы один код расстояния, даже если совпадений нет
+        if (std::all_of(distFreq.begin(), distFreq.end(), [](uint32_t v) { return v == 0; })) {
+            distFreq[0] = 1;
+        }
+
+        std::vector<uint8_t> litLengths, distLengths;
+        buildLengths(litFreq, 15, litLengths);
+        buildLengths(distFreq, 15, distLengths);
+
+        int hlit = 286;
+        while (hlit > 257 && litLengths[hlit - 1] == 0) hlit--;
+        int hdist = 30;
+        while (hdist > 1 && distLengths[hdist - 1] == 0) hdist--;
+
+        // RLE длин кодов символами 16/17/18
+        std::vector<uint8_t> all(litLengths.begin(), litLengths.begin() + hlit);
+        all.insert(all.end(), distLengths.begin(), distLengths.begin() + hdist);
+        std::vector<std::pair<uint8_t, uint8_t>> rle;
+        for (size_t i = 0; i < all.size();) {
+            size_t run = 1;
+            while (i + run < all.size() && all[i + run] == all[i]) run++;
+            if (all[i] == 0 && run >= 3) {
+                size_t n = std::min(run, size_t(138));
+                rle.push_back(n >= 11 ? std::make_pair(uint8_t(18), uint8_t(n - 11))
+                                      : std::make_pair(uint8_t(17), uint8_t(n - 3)));
+                i += n;
+            } else if (all[i] != 0 && run >= 4) {
+                rle.push_back({all[i], 0});
+                size_t n = std::min(run - 1, size_t(6));
+                rle.push_back({16, uint8_t(n - 3)});
+                i += 1 + n;
+            } else {
+                rle.push_back({all[i], 0});
+                i++;
+            }
+        }
+
+        std::vector<uint32_t> clFreq(19, 0);
+        for (auto& item : rle) clFreq[item.first]++;
+        std::vector<uint8_t> clLengths;
+        buildLengths(clFreq, 7, clLengths);
+        std::vector<uint16_t> clCodes;
+        buildCodes(clLengths, clCodes);
+
+        static const uint8_t clOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        int hclen = 19;
+        while (hclen > 4 && clLengths[clOrder[hclen - 1]] == 0) hclen--;
+
+        writeBits(lastBlock ? 1 : 0, 1);
+        writeBits(2, 2);
+        writeBits(hlit - 257, 5);
+        writeBits(hdist - 1, 5);
+        writeBits(hclen - 4, 4);
+        for (int i = 0; i < hclen; i++) writeBits(clLengths[clOrder[i]], 3);
+        for (auto& item : rle) {
+            writeBits(clCodes[item.first], clLengths[item.first]);
+            if (item.first == 16) writeBits(item.second, 2);
+            else if (item.first == 17) writeBits(item.second, 3);
+            else if (item.first == 18) writeBits(item.second, 7);
+        }
+
+        std::vector<uint16_t> litCodes, distCodes;
+        buildCodes(litLengths, litCodes);
+        buildCodes(distLengths, distCodes);
+
+        for (const Token& token : tokens) {
+            if (token.length == 0) {
+                writeBits(litCodes[token.literalOrDistance], litLengths[token.literalOrDistance]);
+            } else {
+                int lc = lengthCode(token.length);
+                writeBits(litCodes[257 + lc], litLengths[257 + lc]);
+                writeBits(token.length - lengthBase()[lc], lengthExtra()[lc]);
+                int dc = distanceCode(token.literalOrDistance);
+                writeBits(distCodes[dc], distLengths[dc]);
+                writeBits(token.literalOrDistance - distanceBase()[dc], distanceExtra()[dc]);
+            }
+        }
+        writeBits(litCodes[256], litLengths[256]);
+    }
+};
+
+#endif
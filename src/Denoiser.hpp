@@ -0,0 +1,275 @@
+#ifndef DENOISER_HPP
+#define DENOISER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "FrameBuffer.hpp"
+#include "ThreadPool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DENOISER_SSE2 1
+#endif
+
+// Edge-avoiding à-trous wavelet фильтр (Dammertz et al.) по вспомогательным буферам.
+// Цвет перед фильтрацией делится на альбедо, чтобы сохранить границы материалов,
+// веса соседей гасятся разницей цвета, нормалей, альбедо и относительной глубины.
+// Строки обрабатываются параллельно, внутренняя часть строки — по 4 пикселя в SSE2.
+class Denoiser {
+public:
+    int iterations = 5;
+    float colorSigma = 0.6f;   // уменьшается вдвое на каждой итерации
+    float normalSigma = 0.3f;
+    float depthSigma = 0.03f;  // относительно глубины центрального пикселя
+    float albedoSigma = 0.1f;
+
+    // Фильтрует frame.color на месте; требует frame.hasAux
+    void denoise(FrameBuffer& frame) {
+        if (!frame.hasAux || frame.width == 0 || frame.height == 0) return;
+
+        const int width = frame.width;
+        const int height = frame.height;
+        const size_t planeSize = frame.pixelCount();
+
+        ping.resize(planeSize * 3);
+        pong.resize(planeSize * 3);
+        albedoClamped.resize(planeSize * 3);
+
+        ThreadPool& pool = ThreadPool::shared();
+        pool.parallelFor(0, height, 16, [&](int begin, int end) {
+            for (size_t i = size_t(begin) * width; i < size_t(end) * width; i++) {
+                for (int c = 0; c < 3; c++) {
+                    float a = std::max(frame.albedo[i + c * planeSize], MinAlbedo);
+                    albedoClamped[i + c * planeSize] = a;
+                    ping[i + c * planeSize] = frame.color[i + c * planeSize] / a;
+                }
+            }
+        });
+
+        Params params;
+        params.invNormal = 1.0f / (normalSigma * normalSigma);
+        params.invAlbedo = 1.0f / (albedoSigma * albedoSigma);
+
+        float sigma = colorSigma;
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            params.step = 1 << iteration;
+            params.invColor = 1.0f / (sigma * sigma);
+            params.invDepth = 1.0f / (depthSigma * depthSigma * float(params.step * params.step));
+            sigma *= 0.5f;
+
+            pool.parallelFor(0, height, 8, [&](int begin, int end) {
+                for (int y = begin; y < end; y++) {
+                    filterRow(frame, params, ping.data(), pong.data(), y);
+                }
+            });
+            std::swap(ping, pong);
+        }
+
+        pool.parallelFor(0, height, 16, [&](int begin, int end) {
+            for (size_t i = size_t(begin) * width; i < size_t(end) * width; i++) {
+                for (int c = 0; c < 3; c++) {
+                    frame.color[i + c * planeSize] = ping[i + c * planeSize] *
+                                                     albedoClamped[i + c * planeSize];
+                }
+            }
+        });
+    }
+
+private:
+    static constexpr float MinAlbedo = 0.01f;
+
+    struct Params {
+        int step = 1;
+        float invColor = 1.0f;
+        float invNormal = 1.0f;
+        float invDepth = 1.0f;
+        float invAlbedo = 1.0f;
+    };
+
+    std::vector<float> ping;
+    std::vector<float> pong;
+    std::vector<float> albedoClamped;
+
+    // B3-сплайн 1/16, 1/4, 3/8, 1/4, 1/16
+    static float kernelWeight(int i) {
+        static const float kernel[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+        return kernel[i];
+    }
+
+    // exp(-x) для x >= 0 через 2^x с полиномом для дробной части
+    static float fastExpNeg(float x) {
+        float y = -std::min(x, 87.0f) * 1.44269504f;
+        float fi = std::floor(y);
+        float f = y - fi;
+        float p = 1.0f + f * (0.69314718f + f * (0.24022651f + f * (0.05550411f +
+                  f * (0.00961813f + f * 0.00133336f))));
+        int32_t bits = (int32_t(fi) + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+        return p * scale;
+    }
+
+#ifdef DENOISER_SSE2
+    static __m128 fastExpNeg(__m128 x) {
+        const __m128 one = _mm_set1_ps(1.0f);
+        __m128 y = _mm_mul_ps(_mm_min_ps(x, _mm_set1_ps(87.0f)), _mm_set1_ps(-1.44269504f));
+        __m128 fi = _mm_cvtepi32_ps(_mm_cvttps_epi32(y));
+        fi = _mm_sub_ps(fi, _mm_and_ps(_mm_cmpgt_ps(fi, y), one));
+        __m128 f = _mm_sub_ps(y, fi);
+        __m128 p = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(0.00133336f)), _mm_set1_ps(0.00961813f));
+        p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(0.05550411f));
+        p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(0.24022651f));
+        p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(0.69314718f));
+        p = _mm_add_ps(_mm_mul_ps(f, p), one);
+        __m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(fi), _mm_set1_epi32(127)), 23);
+        return _mm_mul_ps(p, _mm_castsi128_ps(bits));
+    }
+#endif
+
+    void filterRow(const FrameBuffer& frame, const Params& params,
+                   const float* src, float* dst, int y) const {
+        const int width = frame.width;
+        const int height = frame.height;
+        const int step = params.step;
+
+        int rows[5];
+        for (int k = 0; k < 5; k++) {
+            rows[k] = std::clamp(y + (k - 2) * step, 0, height - 1) * width;
+        }
+
+        // SIMD только там, где все 5 столбцов ядра внутри изображения
+        int x = 0;
+        int border = std::min(width, 2 * step);
+        for (; x < border; x++) filterPixel(frame, params, src, dst, rows, x, y);
+#ifdef DENOISER_SSE2
+        for (; x + 3 + 2 * step < width; x += 4) {
+            filterSpan4(frame, params, src, dst, rows, x, y);
+        }
+#endif
+        for (; x < width; x++) filterPixel(frame, params, src, dst, rows, x, y);
+    }
+
+    void filterPixel(const FrameBuffer& frame, const Params& params,
+                     const float* src, float* dst, const int* rows, int x, int y) const {
+        const int width = frame.width;
+        const size_t planeSize = frame.pixelCount();
+        const float* nx = frame.normal.data();
+        const float* ny = nx + planeSize;
+        const float* nz = ny + planeSize;
+        const float* ar = frame.albedo.data();
+        const float* ag = ar + planeSize;
+        const float* ab = ag + planeSize;
+        const float* depth = frame.depth.data();
+
+        size_t p = size_t(y) * width + x;
+        float cr = src[p], cg = src[p + planeSize], cb = src[p + 2 * planeSize];
+        float dp = std::max(depth[p], 1e-3f);
+        float invDepth = params.invDepth / (dp * dp);
+
+        float sumR = 0.0f, sumG = 0.0f, sumB = 0.0f, sumW = 0.0f;
+        for (int ky = 0; ky < 5; ky++) {
+            for (int kx = 0; kx < 5; kx++) {
+                int qx = std::clamp(x + (kx - 2) * params.step, 0, width - 1);
+                size_t q = size_t(rows[ky]) + qx;
+                float qr = src[q], qg = src[q + planeSize], qb = src[q + 2 * planeSize];
+
+                float dr = qr - cr, dg = qg - cg, db = qb - cb;
+                float dnx = nx[q] - nx[p], dny = ny[q] - ny[p], dnz = nz[q] - nz[p];
+                float dar = ar[q] - ar[p], dag = ag[q] - ag[p], dab = ab[q] - ab[p];
+                float dd = depth[q] - depth[p];
+
+                float e = (dr * dr + dg * dg + db * db) * params.invColor +
+                          (dnx * dnx + dny * dny + dnz * dnz) * params.invNormal +
+                          (dar * dar + dag * dag + dab * dab) * params.invAlbedo +
+                          dd * dd * invDepth;
+                float w = kernelWeight(kx) * kernelWeight(ky) * fastExpNeg(e);
+
+                sumR += qr * w;
+                sumG += qg * w;
+                sumB += qb * w;
+                sumW += w;
+            }
+        }
+
+        float inv = 1.0f / sumW;
+        dst[p] = sumR * inv;
+        dst[p + planeSize] = sumG * inv;
+        dst[p + 2 * planeSize] = sumB * inv;
+    }
+
+#ifdef DENOISER_SSE2
+    void filterSpan4(const FrameBuffer& frame, const Params& params,
+                     const float* src, float* dst, const int* rows, int x, int y) const {
+        const int width = frame.width;
+        const size_t planeSize = frame.pixelCount();
+        const float* nx = frame.normal.data();
+        const float* ny = nx + planeSize;
+        const float* nz = ny + planeSize;
+        const float* ar = frame.albedo.data();
+        const float* ag = ar + planeSize;
+        const float* ab = ag + planeSize;
+        const float* depth = frame.depth.data();
+
+        size_t p = size_t(y) * width + x;
+        __m128 cr = _mm_loadu_ps(src + p);
+        __m128 cg = _mm_loadu_ps(src + p + planeSize);
+        __m128 cb = _mm_loadu_ps(src + p + 2 * planeSize);
+        __m128 pnx = _mm_loadu_ps(nx + p), pny = _mm_loadu_ps(ny + p), pnz = _mm_loadu_ps(nz + p);
+        __m128 par = _mm_loadu_ps(ar + p), pag = _mm_loadu_ps(ag + p), pab = _mm_loadu_ps(ab + p);
+        __m128 pd = _mm_loadu_ps(depth + p);
+        __m128 dpc = _mm_max_ps(pd, _mm_set1_ps(1e-3f));
+        __m128 invDepth = _mm_div_ps(_mm_set1_ps(params.invDepth), _mm_mul_ps(dpc, dpc));
+        __m128 invColor = _mm_set1_ps(params.invColor);
+        __m128 invNormal = _mm_set1_ps(params.invNormal);
+        __m128 invAlbedo = _mm_set1_ps(params.invAlbedo);
+
+        __m128 sumR = _mm_setzero_ps(), sumG = _mm_setzero_ps();
+        __m128 sumB = _mm_setzero_ps(), sumW = _mm_setzero_ps();
+
+        auto sq = [](__m128 a, __m128 b) {
+            __m128 d = _mm_sub_ps(a, b);
+            return _mm_mul_ps(d, d);
+        };
+
+        for (int ky = 0; ky < 5; ky++) {
+            for (int kx = 0; kx < 5; kx++) {
+                size_t q = size_t(rows[ky]) + x + (kx - 2) * params.step;
+                __m128 qr = _mm_loadu_ps(src + q);
+                __m128 qg = _mm_loadu_ps(src + q + planeSize);
+                __m128 qb = _mm_loadu_ps(src + q + 2 * planeSize);
+
+                __m128 colorDist = _mm_add_ps(_mm_add_ps(sq(qr, cr), sq(qg, cg)), sq(qb, cb));
+                __m128 normalDist = _mm_add_ps(_mm_add_ps(sq(_mm_loadu_ps(nx + q), pnx),
+                                                          sq(_mm_loadu_ps(ny + q), pny)),
+                                               sq(_mm_loadu_ps(nz + q), pnz));
+                __m128 albedoDist = _mm_add_ps(_mm_add_ps(sq(_mm_loadu_ps(ar + q), par),
+                                                          sq(_mm_loadu_ps(ag + q), pag)),
+                                               sq(_mm_loadu_ps(ab + q), pab));
+                __m128 depthDist = sq(_mm_loadu_ps(depth + q), pd);
+
+                // Тот же порядок сложения, что в скалярной версии: результат побитно совпадает
+                __m128 e = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(colorDist, invColor),
+                                                            _mm_mul_ps(normalDist, invNormal)),
+                                                 _mm_mul_ps(albedoDist, invAlbedo)),
+                                      _mm_mul_ps(depthDist, invDepth));
+                __m128 w = _mm_mul_ps(_mm_set1_ps(kernelWeight(kx) * kernelWeight(ky)), fastExpNeg(e));
+
+                sumR = _mm_add_ps(sumR, _mm_mul_ps(qr, w));
+                sumG = _mm_add_ps(sumG, _mm_mul_ps(qg, w));
+                sumB = _mm_add_ps(sumB, _mm_mul_ps(qb, w));
+                sumW = _mm_add_ps(sumW, w);
+            }
+        }
+
+        __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), sumW);
+        _mm_storeu_ps(dst + p, _mm_mul_ps(sumR, inv));
+        _mm_storeu_ps(dst + p + planeSize, _mm_mul_ps(sumG, inv));
+        _mm_storeu_ps(dst + p + 2 * planeSize, _mm_mul_ps(sumB, inv));
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef DIRTYREGIONS_HPP
+#define DIRTYREGIONS_HPP
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "Scene.hpp"
+#include "Camera.hpp"
+#include "PrimaryVisibility.hpp"
+
+// Объём, который изменился между кадрами: прежнее или новое положение
+// сферы либо экземпляра (ограничивающий шар) и тайлы его проекции
+struct DirtyVolume {
+    Vector3 center;
+    float radius = 0.0f;
+    TileRect tiles;
+    // false, если у объекта сменился только материал: тени от него те же
+    bool castsShadow = true;
+};
+
+// Отслеживание изменений сцены для инкрементального перерендера. Пиксель
+// может измениться, только если его первичный луч задевает прежнее или
+// новое положение объекта (проекция объёма), или если точка попадания
+// лежит в прежней или новой тени объекта от какого-нибудь источника.
+// Трассировщик не пускает отражённых лучей, поэтому других путей нет.
+//
+// Тень шара от точечного источника — конус за шаром; тайл проверяется по
+// шару, описанному вокруг точек первичных попаданий этого тайла в прошлом
+// кадре. Эти границы ведёт рендер (tileHits).
+class DirtyRegions {
+public:
+    // Запас вокруг точек попадания тайла: кэш теней (ShadingCache) берёт
+    // видимость источника из центра текселя, а не из самой точки
+    float receiverMargin = 0.05f;
+
+    // Сравнивает сцену и вид со снимком прошлого вызова и запоминает новое
+    // состояние. false — кадр нужно перерисовать целиком: первый вызов,
+    // сменились камера, размер, источники, фон или геометрия кроме сфер и
+    // экземпляров (сетки и группы — по getRevision(), облака — по указателю).
+    // Иначе changes() — изменившиеся объёмы (возможно, ни одного).
+    bool update(const Scene& scene, const Camera& camera, int width, int height, int tileSize) {
+        volumes.clear();
+        bool sameView = valid && &scene == snapshotScene && width == this->width && height == this->height &&
+                        tileSize == this->tileSize && sameCamera(camera, this->camera);
+        if (sameView && scene.getRevision() == revision) return true;
+
+        projection = TileProjection(camera, width, height, tileSize);
+        bool partial = sameView && scene.lights == lights && scene.backgroundColor == background &&
+                       sameGeometry(scene);
+        if (partial) {
+            diffSpheres(scene);
+            diffInstances(scene);
+        }
+
+        // Снимок; при неизменном числе объектов память не выделяется
+        snapshotScene = &scene;
+        revision = scene.getRevision();
+        this->camera = camera;
+        this->width = width;
+        this->height = height;
+        this->tileSize = tileSize;
+        spheres.assign(scene.spheres.begin(), scene.spheres.end());
+        instances.resize(scene.instances.size());
+        for (size_t i = 0; i < scene.instances.size(); i++) instances[i] = snapshotOf(scene, scene.instances[i]);
+        lights.assign(scene.lights.begin(), scene.lights.end());
+        background = scene.backgroundColor;
+        meshRevisions.resize(scene.meshes.size());
+        for (size_t i = 0; i < scene.meshes.size(); i++) meshRevisions[i] = scene.meshes[i].getRevision();
+        groupRevisions.resize(scene.groups.size());
+        for (size_t i = 0; i < scene.groups.size(); i++) groupRevisions[i] = scene.groups[i].getRevision();
+        clouds.resize(scene.clouds.size());
+        for (size_t i = 0; i < scene.clouds.size(); i++) clouds[i] = scene.clouds[i].get();
+        if (int(tileHitBounds.size()) != projection.tilesX * projection.tilesY) {
+            tileHitBounds.assign(projection.tilesX * projection.tilesY, AABB());
+            partial = false;
+        }
+        valid = true;
+        return partial;
+    }
+
+    // Забыть снимок: следующий update() потребует полный кадр
+    void invalidate() { valid = false; }
+
+    const std::vector<DirtyVolume>& changes() const { return volumes; }
+
+    int tilesX() const { return projection.tilesX; }
+    int tilesY() const { return projection.tilesY; }
+    int tileCount() const { return int(tileHitBounds.size()); }
+
+    // Границы точек первичных попаданий тайла в последнем кадре, где он
+    // трассировался; пустые, если все лучи ушли в фон
+    AABB& tileHits(int tile) { return tileHitBounds[tile]; }
+
+    // Тайлы, которые могли измениться, по changes() и tileHits()
+    const std::vector<int>& collectDirtyTiles(const Scene& scene) {
+        dirty.clear();
+        for (int ty = 0; ty < projection.tilesY; ty++) {
+            for (int tx = 0; tx < projection.tilesX; tx++) {
+                int tile = ty * projection.tilesX + tx;
+                if (tileMayChange(scene, tx, ty, tileHitBounds[tile])) dirty.push_back(tile);
+            }
+        }
+        return dirty;
+    }
+
+    // Может ли точка из шара (receiver, receiverRadius) оказаться в тени
+    // шара (center, radius) от точечного источника light. Тень лежит в
+    // конусе с вершиной в источнике, касающемся шара, дальше плоскости
+    // касания; проверка консервативна.
+    static bool shadowMayReach(const Vector3& light, const Vector3& center, float radius,
+                               const Vector3& receiver, float receiverRadius) {
+        Vector3 axis = center - light;
+        float lightDistance = axis.length();
+        if (lightDistance <= radius) return true;  // источник внутри шара
+        axis = axis * (1.0f / lightDistance);
+        float sinAngle = radius / lightDistance;
+        float cosAngle = std::sqrt(1.0f - sinAngle * sinAngle);
+
+        Vector3 toReceiver = receiver - light;
+        float along = toReceiver.dot(axis);
+        // Плоскость касания отстоит от источника на lightDistance * cos^2
+        if (along + receiverRadius < lightDistance * cosAngle * cosAngle) return false;
+        float across = (toReceiver - axis * along).length();
+        // Расстояние до поверхности конуса; за вершиной ближайшая точка — сама вершина
+        float gap = along * cosAngle + across * sinAngle >= 0.0f ? across * cosAngle - along * sinAngle
+                                                                  : toReceiver.length();
+        return gap <= receiverRadius;
+    }
+
+private:
+    struct InstanceSnapshot {
+        float transform[3][4];
+        int group = 0;
+        bool overrideMaterial = false;
+        Material material;
+        Vector3 center;
+        float radius = 0.0f;
+    };
+
+    bool valid = false;
+    const Scene* snapshotScene = nullptr;
+    unsigned long long revision = 0;
+    Camera camera;
+    int width = 0, height = 0, tileSize = 0;
+    TileProjection projection;
+    std::vector<Sphere> spheres;
+    std::vector<InstanceSnapshot> instances;
+    std::vector<Light> lights;
+    Vector3 background;
+    std::vector<unsigned long long> meshRevisions;
+    std::vector<unsigned long long> groupRevisions;
+    std::vector<const SphereCloud*> clouds;
+
+    std::vector<DirtyVolume> volumes;
+    std::vector<AABB> tileHitBounds;
+    std::vector<int> dirty;
+
+    // Сетки, группы и облака не разбираются на объёмы: любая их правка
+    // означает полный кадр
+    bool sameGeometry(const Scene& scene) const {
+        if (scene.meshes.size() != meshRevisions.size() || scene.groups.size() != groupRevisions.size() ||
+            scene.clouds.size() != clouds.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < scene.meshes.size(); i++) {
+            if (scene.meshes[i].getRevision() != meshRevisions[i]) return false;
+        }
+        for (size_t i = 0; i < scene.groups.size(); i++) {
+            if (scene.groups[i].getRevision() != groupRevisions[i]) return false;
+        }
+        for (size_t i = 0; i < scene.clouds.size(); i++) {
+            if (scene.clouds[i].get() != clouds[i]) return false;
+        }
+        return true;
+    }
+
+    static bool sameCamera(const Camera& a, const Camera& b) {
+        return a.position == b.position && a.lowerLeftCorner == b.lowerLeftCorner &&
+               a.horizontal == b.horizontal && a.vertical == b.vertical;
+    }
+
+    void addVolume(const Vector3& center, float radius, bool castsShadow) {
+        DirtyVolume volume;
+        volume.center = center;
+        volume.radius = radius;
+        volume.tiles = projection.sphereTiles(center, radius);
+        volume.castsShadow = castsShadow;
+        volumes.push_back(volume);
+    }
+
+    void diffSpheres(const Scene& scene) {
+        size_t common = std::min(spheres.size(), scene.spheres.size());
+        for (size_t i = 0; i < common; i++) {
+            const Sphere& before = spheres[i];
+            const Sphere& after = scene.spheres[i];
+            bool moved = !(before.center == after.center) || before.radius != after.radius;
+            if (!moved && before.material == after.material) continue;
+            addVolume(before.center, before.radius, moved);
+            if (moved) addVolume(after.center, after.radius, true);
+        }
+        for (size_t i = common; i < spheres.size(); i++) addVolume(spheres[i].center, spheres[i].radius, true);
+        for (size_t i = common; i < scene.spheres.size(); i++) {
+            addVolume(scene.spheres[i].center, scene.spheres[i].radius, true);
+        }
+    }
+
+    static InstanceSnapshot snapshotOf(const Scene& scene, const Instance& instance) {
+        InstanceSnapshot snapshot;
+        std::memcpy(snapshot.transform, instance.objectToWorld.m, sizeof(snapshot.transform));
+        snapshot.group = instance.group;
+        snapshot.overrideMaterial = instance.overrideMaterial;
+        snapshot.material = instance.material;
+        AABB box = instance.objectToWorld.bounds(scene.groups[instance.group].bounds());
+        snapshot.center = box.centroid();
+        snapshot.radius = (box.max - box.min).length() * 0.5f;
+        return snapshot;
+    }
+
+    void diffInstances(const Scene& scene) {
+        size_t common = std::min(instances.size(), scene.instances.size());
+        for (size_t i = 0; i < common; i++) {
+            const InstanceSnapshot& before = instances[i];
+            InstanceSnapshot after = snapshotOf(scene, scene.instances[i]);
+            bool moved = std::memcmp(before.transform, after.transform, sizeof(before.transform)) != 0 ||
+                         before.group != after.group;
+            bool recolored = before.overrideMaterial != after.overrideMaterial ||
+                             !(before.material == after.material);
+            if (!moved && !recolored) continue;
+            addVolume(before.center, before.radius, moved);
+            if (moved) addVolume(after.center, after.radius, true);
+        }
+        for (size_t i = common; i < instances.size(); i++) {
+            addVolume(instances[i].center, instances[i].radius, true);
+        }
+        for (size_t i = common; i < scene.instances.size(); i++) {
+            InstanceSnapshot added = snapshotOf(scene, scene.instances[i]);
+            addVolume(added.center, added.radius, true);
+        }
+    }
+
+    bool tileMayChange(const Scene& scene, int tx, int ty, const AABB& hits) const {
+        for (const DirtyVolume& volume : volumes) {
+            if (volume.tiles.contains(tx, ty)) return true;
+        }
+        if (hits.isEmpty()) return false;
+        Vector3 receiver = hits.centroid();
+        float receiverRadius = (hits.max - hits.min).length() * 0.5f + receiverMargin;
+        for (const DirtyVolume& volume : volumes) {
+            if (!volume.castsShadow) continue;
+            for (const Light& light : scene.lights) {
+                if (shadowMayReach(light.position, volume.center, volume.radius, receiver, receiverRadius)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef FILEWATCHER_HPP
+#define FILEWATCHER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Следит за одним файлом без блокировки: changed() вызывается раз в кадр.
+// На Linux — inotify на каталог файла (редакторы обычно сохраняют через
+// переименование временного файла, и наблюдение за самим inode его бы
+// потеряло). В остальных случаях — опрос времени изменения и размера не
+// чаще pollInterval.
+class FileWatcher {
+public:
+    std::chrono::milliseconds pollInterval{250};
+
+    FileWatcher() = default;
+    explicit FileWatcher(const std::string& path) { watch(path); }
+    ~FileWatcher() { stop(); }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    bool watch(const std::string& path) {
+        stop();
+        std::filesystem::path file = std::filesystem::absolute(path);
+        watchedFile = file;
+        watchedPath = file.string();
+        fileName = file.filename().string();
+        remember();
+
+#ifdef __linux__
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd >= 0) {
+            std::string directory = file.parent_path().string();
+            watchDescriptor = inotify_add_watch(inotifyFd, directory.c_str(),
+                                                IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (watchDescriptor >= 0) return true;
+            ::close(inotifyFd);
+            inotifyFd = -1;
+        }
+        std::cerr << "inotify unavailable, polling " << watchedPath << std::endl;
+#endif
+        return true;
+    }
+
+    void stop() {
+#ifdef __linux__
+        if (inotifyFd >= 0) ::close(inotifyFd);
+        inotifyFd = -1;
+        watchDescriptor = -1;
+#endif
+    }
+
+    // true, если файл изменился с прошлого вызова
+    bool changed() {
+#ifdef __linux__
+        if (inotifyFd >= 0) {
+            bool touched = false;
+            alignas(inotify_event) char buffer[4096];
+            for (;;) {
+                ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+                if (length <= 0) break;
+                for (ssize_t offset = 0; offset < length;) {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                    if (event->len > 0 && fileName == event->name) touched = true;
+                    offset += ssize_t(sizeof(inotify_event) + event->len);
+                }
+            }
+            return touched;
+        }
+#endif
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastPoll < pollInterval) return false;
+        lastPoll = now;
+        auto previousTime = lastWriteTime;
+        auto previousSize = lastSize;
+        remember();
+        return lastWriteTime != previousTime || lastSize != previousSize;
+    }
+
+    const std::string& path() const { return watchedPath; }
+
+private:
+    std::filesystem::path watchedFile;  // чтобы опрос не собирал path из строки
+    std::string watchedPath;
+    std::string fileName;
+    std::filesystem::file_time_type lastWriteTime{};
+    std::uintmax_t lastSize = 0;
+    std::chrono::steady_clock::time_point lastPoll{};
+#ifdef __linux__
+    int inotifyFd = -1;
+    int watchDescriptor = -1;
+#endif
+
+    void remember() {
+        std::error_code error;
+        lastWriteTime = std::filesystem::last_write_time(watchedFile, error);
+        lastSize = std::filesystem::file_size(watchedFile, error);
+        if (error) lastSize = 0;
+    }
+};
+
+#endif
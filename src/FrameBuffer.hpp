@@ -0,0 +1,123 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <cstddef>
+
+// Аллокатор, который не обнуляет новые элементы vector::resize: страницы
+// свежего буфера остаются нетронутыми до первой записи
+template <typename T>
+struct UninitializedAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind {
+        using other = UninitializedAllocator<U>;
+    };
+
+    UninitializedAllocator() = default;
+    template <typename U>
+    UninitializedAllocator(const UninitializedAllocator<U>&) {}
+
+    template <typename U>
+    void construct(U* pointer) {
+        ::new (static_cast<void*>(pointer)) U;
+    }
+    template <typename U, typename... Args>
+    void construct(U* pointer, Args&&... args) {
+        ::new (static_cast<void*>(pointer)) U(std::forward<Args>(args)...);
+    }
+};
+
+// Линейный (до гамма-коррекции) float-буфер кадра.
+// Данные хранятся планарно: каждая компонента — отдельная плоскость width * height,
+// что удобно для SIMD-обработки соседних пикселей строки.
+class FrameBuffer {
+public:
+    int width = 0;
+    int height = 0;
+    bool hasAux = false;
+
+    using Plane = std::vector<float, UninitializedAllocator<float>>;
+
+    Plane color;   // R, G, B
+    Plane normal;  // X, Y, Z нормали первого попадания
+    Plane albedo;  // R, G, B цвета материала первого попадания
+    Plane depth;   // расстояние до первого попадания
+
+    FrameBuffer() {}
+    FrameBuffer(int width, int height, bool withAux = false) {
+        resize(width, height, withAux);
+    }
+
+    // Память переиспользуется, если размеры не изменились; новые элементы нулевые
+    void resize(int newWidth, int newHeight, bool withAux) {
+        width = newWidth;
+        height = newHeight;
+        hasAux = withAux;
+        size_t count = pixelCount();
+        grow(color, count * 3);
+        if (withAux) {
+            grow(normal, count * 3);
+            grow(albedo, count * 3);
+            grow(depth, count);
+        }
+    }
+
+    // Как resize, но без записи в память: при нехватке места плоскости
+    // выделяются заново (старое содержимое не копируется), и страницы
+    // достаются узлу NUMA того потока, что первым в них пишет. Содержимое
+    // не определено, пока строки не записаны рендером или clearRows.
+    // Свежие страницы гарантирует только mmap, то есть крупный буфер.
+    void allocate(int newWidth, int newHeight, bool withAux) {
+        width = newWidth;
+        height = newHeight;
+        hasAux = withAux;
+        size_t count = pixelCount();
+        reallocate(color, count * 3);
+        if (withAux) {
+            reallocate(normal, count * 3);
+            reallocate(albedo, count * 3);
+            reallocate(depth, count);
+        }
+    }
+
+    // Обнуляет строки [y0, y1) во всех плоскостях
+    void clearRows(int y0, int y1) {
+        size_t planeSize = pixelCount();
+        size_t begin = size_t(y0) * width, end = size_t(y1) * width;
+        for (int c = 0; c < 3; c++) {
+            std::fill(color.begin() + c * planeSize + begin, color.begin() + c * planeSize + end, 0.0f);
+        }
+        if (!hasAux) return;
+        for (int c = 0; c < 3; c++) {
+            std::fill(normal.begin() + c * planeSize + begin, normal.begin() + c * planeSize + end, 0.0f);
+            std::fill(albedo.begin() + c * planeSize + begin, albedo.begin() + c * planeSize + end, 0.0f);
+        }
+        std::fill(depth.begin() + begin, depth.begin() + end, 0.0f);
+    }
+
+    size_t pixelCount() const { return size_t(width) * size_t(height); }
+
+    float* colorPlane(int channel) { return color.data() + channel * pixelCount(); }
+    const float* colorPlane(int channel) const { return color.data() + channel * pixelCount(); }
+    float* normalPlane(int channel) { return normal.data() + channel * pixelCount(); }
+    const float* normalPlane(int channel) const { return normal.data() + channel * pixelCount(); }
+    float* albedoPlane(int channel) { return albedo.data() + channel * pixelCount(); }
+    const float* albedoPlane(int channel) const { return albedo.data() + channel * pixelCount(); }
+
+private:
+    static void grow(Plane& plane, size_t count) {
+        size_t previous = plane.size();
+        plane.resize(count);
+        if (count > previous) std::fill(plane.begin() + previous, plane.end(), 0.0f);
+    }
+
+    static void reallocate(Plane& plane, size_t count) {
+        if (plane.capacity() < count) Plane().swap(plane);
+        plane.resize(count);
+    }
+};
+
+#endif
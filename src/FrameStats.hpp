@@ -0,0 +1,114 @@
+#ifndef FRAMESTATS_HPP
+#define FRAMESTATS_HPP
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Скользящее окно последних значений с перцентилями
+class RollingStats {
+private:
+    std::vector<double> samples;
+    mutable std::vector<double> sorted;
+    size_t next = 0;
+    size_t count = 0;
+
+public:
+    explicit RollingStats(size_t window = 240) : samples(window, 0.0) {}
+
+    void add(double value) {
+        samples[next] = value;
+        next = (next + 1) % samples.size();
+        count = std::min(count + 1, samples.size());
+    }
+
+    bool empty() const { return count == 0; }
+
+    double percentile(double p) const {
+        if (count == 0) return 0.0;
+        sorted.assign(samples.begin(), samples.begin() + count);
+        size_t k = std::min(count - 1, size_t(p / 100.0 * double(count - 1) + 0.5));
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        return sorted[k];
+    }
+
+    double mean() const {
+        if (count == 0) return 0.0;
+        double sum = 0.0;
+        for (size_t i = 0; i < count; i++) sum += samples[i];
+        return sum / double(count);
+    }
+};
+
+// Времена одного кадра в миллисекундах; GPU-фазы приходят с задержкой в несколько кадров
+struct FrameTiming {
+    long long frame = 0;
+    double frameMs = 0.0;     // интервал между вызовами Renderer::render (CPU)
+    double uploadMs = 0.0;    // uploadSceneData (CPU)
+    double dispatchMs = 0.0;  // glDispatchCompute (GPU) или проход фрагментного трассировщика
+    double barrierMs = 0.0;   // glMemoryBarrier (GPU)
+    double drawMs = 0.0;      // вывод текстуры на экран (GPU)
+    float renderScale = 1.0f; // масштаб разрешения, с которым кадр трассировался
+};
+
+// Агрегирует FrameTiming: перцентили для заголовка окна и, по желанию, CSV
+class FrameStats {
+public:
+    RollingStats frameMs;
+    RollingStats uploadMs;
+    RollingStats dispatchMs;
+    RollingStats barrierMs;
+    RollingStats drawMs;
+
+    FrameTiming latest;
+    long long completedFrames = 0;
+
+    bool openCsv(const std::string& path) {
+        csv.open(path);
+        if (!csv.is_open()) {
+            std::cerr << "Failed to open stats file: " << path << std::endl;
+            return false;
+        }
+        csv << "frame,frame_ms,upload_ms,gpu_dispatch_ms,gpu_barrier_ms,gpu_draw_ms\n";
+        return true;
+    }
+
+    void add(const FrameTiming& timing) {
+        // У первого кадра нет предыдущего, интервал не определён
+        if (timing.frame > 0) frameMs.add(timing.frameMs);
+        uploadMs.add(timing.uploadMs);
+        dispatchMs.add(timing.dispatchMs);
+        barrierMs.add(timing.barrierMs);
+        drawMs.add(timing.drawMs);
+        latest = timing;
+        completedFrames++;
+
+        if (csv.is_open()) {
+            csv << timing.frame << ',' << timing.frameMs << ',' << timing.uploadMs << ','
+                << timing.dispatchMs << ',' << timing.barrierMs << ',' << timing.drawMs << '\n';
+        }
+    }
+
+    std::string summary() const {
+        char buffer[256];
+        summary(buffer, sizeof(buffer));
+        return buffer;
+    }
+
+    // Без выделения памяти, для заголовка окна в цикле кадров
+    void summary(char* buffer, size_t size) const {
+        std::snprintf(buffer, size,
+                      "frame p50 %.2f p95 %.2f p99 %.2f ms | upload %.3f ms | dispatch %.2f ms | draw %.2f ms",
+                      frameMs.percentile(50), frameMs.percentile(95), frameMs.percentile(99),
+                      uploadMs.percentile(50), dispatchMs.percentile(50), drawMs.percentile(50));
+    }
+
+private:
+    std::ofstream csv;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef GEOMETRYGROUP_HPP
+#define GEOMETRYGROUP_HPP
+
+#include <vector>
+#include "Sphere.hpp"
+#include "Mesh.hpp"
+#include "BVH.hpp"
+#include "Transform.hpp"
+#include "RenderTrace.hpp"
+
+// Геометрия, описанная один раз в собственной системе координат, со своим
+// BVH (нижний уровень). Сцена размещает её многократно через Instance.
+class GeometryGroup {
+public:
+    std::vector<Sphere> spheres;
+    std::vector<Mesh> meshes;
+
+    // То же, что Mesh::getRevision: меняется при build() и markChanged()
+    unsigned long long getRevision() const { return revision; }
+    void markChanged() { revision = nextGeometryRevision(); }
+
+    // Вызывается после заполнения spheres/meshes и после любых их изменений
+    void build() {
+        markChanged();
+        std::vector<AABB> sphereBounds(spheres.size());
+        localBounds = AABB();
+        for (size_t i = 0; i < spheres.size(); i++) {
+            Vector3 r(spheres[i].radius, spheres[i].radius, spheres[i].radius);
+            sphereBounds[i] = AABB(spheres[i].center - r, spheres[i].center + r);
+            localBounds.grow(sphereBounds[i]);
+        }
+        bvh.build(sphereBounds);
+        for (auto& mesh : meshes) {
+            if (mesh.accelerationStructure().isEmpty() && mesh.triangleCount() > 0) mesh.build();
+            localBounds.grow(mesh.bounds());
+        }
+    }
+
+    const AABB& bounds() const { return localBounds; }
+
+    // Ближайшее попадание в локальных координатах; при успехе сужает tMax
+    // и заполняет hit (точка и нормаль тоже локальные)
+    bool intersect(const Ray& ray, float tMin, float& tMax, HitRecord& hit) const {
+        int closestSphere = -1;
+        bvh.intersect(ray, tMin, tMax, [&](int prim, float& tFar) {
+            TRACE_COUNT(sphereTests, 1);
+            float t = spheres[prim].intersect(ray);
+            if (t > tMin && t < tFar) {
+                tFar = t;
+                closestSphere = prim;
+                return true;
+            }
+            return false;
+        });
+        if (closestSphere >= 0) {
+            hit.hit = true;
+            hit.t = tMax;
+            hit.point = ray.pointAt(tMax);
+            hit.normal = spheres[closestSphere].getNormal(hit.point);
+            hit.material = spheres[closestSphere].material;
+        }
+
+        bool found = closestSphere >= 0;
+        for (const auto& mesh : meshes) {
+            int triangle = mesh.intersect(ray, tMin, tMax);
+            if (triangle >= 0) {
+                found = true;
+                hit.hit = true;
+                hit.t = tMax;
+                hit.point = ray.pointAt(tMax);
+                hit.normal = mesh.getNormal(triangle, ray.direction);
+                hit.material = mesh.material;
+            }
+        }
+        return found;
+    }
+
+    bool occluded(const Ray& ray, float tMin, float tMax) const {
+        bool blocked = bvh.occluded(ray, tMin, tMax, [&](int prim, float lo, float hi) {
+            TRACE_COUNT(sphereTests, 1);
+            float t = spheres[prim].intersect(ray);
+            return t > lo && t < hi;
+        });
+        for (size_t i = 0; i < meshes.size() && !blocked; i++) {
+            blocked = meshes[i].occluded(ray, tMin, tMax);
+        }
+        return blocked;
+    }
+
+private:
+    BVH bvh;
+    AABB localBounds;
+    unsigned long long revision = nextGeometryRevision();
+};
+
+// Размещение группы в сцене: аффинное преобразование и, по желанию,
+// замена материала всей группы. Сама геометрия не копируется.
+struct Instance {
+    int group = 0;
+    Transform objectToWorld;
+    Transform worldToObject;
+    bool overrideMaterial = false;
+    Material material;
+
+    Instance() {}
+
+    Instance(int group, const Transform& transform)
+            : group(group), objectToWorld(transform), worldToObject(transform.inverse()) {}
+
+    Instance(int group, const Transform& transform, const Material& material)
+            : group(group), objectToWorld(transform), worldToObject(transform.inverse()),
+              overrideMaterial(true), material(material) {}
+
+    void setTransform(const Transform& transform) {
+        objectToWorld = transform;
+        worldToObject = transform.inverse();
+    }
+
+    // Луч в локальных координатах группы. Направление после преобразования
+    // нормализуется, поэтому расстояния пересчитываются множителем scale:
+    // tLocal = tWorld * scale
+    Ray toObject(const Ray& ray, float& scale) const {
+        Vector3 direction = worldToObject.vector(ray.direction);
+        scale = direction.length();
+        return Ray(worldToObject.point(ray.origin), direction);
+    }
+
+    bool intersect(const GeometryGroup& geometry, const Ray& ray, float tMin, float& tMax,
+                   HitRecord& hit) const {
+        float scale;
+        Ray local = toObject(ray, scale);
+        float localMax = tMax * scale;
+        HitRecord localHit;
+        if (!geometry.intersect(local, tMin * scale, localMax, localHit)) return false;
+
+        tMax = localMax / scale;
+        hit.hit = true;
+        hit.t = tMax;
+        hit.point = ray.pointAt(tMax);
+        hit.normal = worldToObject.transposedVector(localHit.normal).normalize();
+        hit.material = overrideMaterial ? material : localHit.material;
+        return true;
+    }
+
+    bool occluded(const GeometryGroup& geometry, const Ray& ray, float tMin, float tMax) const {
+        float scale;
+        Ray local = toObject(ray, scale);
+        return geometry.occluded(local, tMin * scale, tMax * scale);
+    }
+};
+
+#endif
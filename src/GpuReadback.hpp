@@ -0,0 +1,123 @@
+#ifndef GPUREADBACK_HPP
+#define GPUREADBACK_HPP
+
+#include "glad/glad.h"
+
+// Чтение кадра с GPU без остановки конвейера: копия в pixel-buffer object
+// ставится в очередь команд вместе с fence, а отображается в память только
+// тогда, когда fence уже сработал. Как и в GpuTimer, если все буферы кольца
+// ещё в пути, кадр просто не читается.
+//
+// Данные приходят как RGBA8, строки снизу вверх (порядок OpenGL).
+class GpuReadback {
+public:
+    static constexpr int Latency = 3;
+
+    GpuReadback() {
+        glGenBuffers(Latency, buffers);
+    }
+
+    ~GpuReadback() {
+        for (Slot& slot : slots) {
+            if (slot.fence) glDeleteSync(slot.fence);
+        }
+        glDeleteBuffers(Latency, buffers);
+    }
+
+    GpuReadback(const GpuReadback&) = delete;
+    GpuReadback& operator=(const GpuReadback&) = delete;
+
+    // Копия текстуры уровня 0 (например, результата compute-трассировки).
+    // Запись в неё через imageStore должна быть закрыта барьером
+    // GL_TEXTURE_UPDATE_BARRIER_BIT. tag возвращается в collect вместе с кадром.
+    bool requestTexture(GLuint texture, int width, int height, long long tag) {
+        Slot* slot = beginSlot(width, height, tag);
+        if (!slot) return false;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        endSlot(*slot);
+        return true;
+    }
+
+    // Копия текущего буфера чтения (в режиме фрагментного трассировщика —
+    // задний буфер окна до glfwSwapBuffers)
+    bool requestFramebuffer(int width, int height, long long tag) {
+        Slot* slot = beginSlot(width, height, tag);
+        if (!slot) return false;
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        endSlot(*slot);
+        return true;
+    }
+
+    // Отдаёт consume(rgba, width, height, tag) все готовые кадры, от старых к
+    // новым. Указатель действителен только внутри вызова.
+    template <typename Consume>
+    void collect(Consume&& consume) {
+        for (int k = 0; k < Latency; k++) {
+            int i = (current + k) % Latency;
+            Slot& slot = slots[i];
+            if (!slot.fence) continue;
+
+            GLenum status = glClientWaitSync(slot.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i]);
+            const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, byteSize(slot), GL_MAP_READ_BIT);
+            if (data) {
+                consume(static_cast<const unsigned char*>(data), slot.width, slot.height, slot.tag);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+
+    bool busy() const {
+        for (const Slot& slot : slots) {
+            if (slot.fence) return true;
+        }
+        return false;
+    }
+
+private:
+    struct Slot {
+        GLsync fence = nullptr;
+        int width = 0, height = 0;
+        GLsizeiptr capacity = 0;
+        long long tag = 0;
+    };
+
+    GLuint buffers[Latency] = {};
+    Slot slots[Latency];
+    int current = 0;
+
+    static GLsizeiptr byteSize(const Slot& slot) {
+        return GLsizeiptr(slot.width) * slot.height * 4;
+    }
+
+    Slot* beginSlot(int width, int height, long long tag) {
+        Slot& slot = slots[current];
+        if (slot.fence) return nullptr;
+        slot.width = width;
+        slot.height = height;
+        slot.tag = tag;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[current]);
+        // Память буфера пересоздаётся только при росте кадра
+        if (byteSize(slot) > slot.capacity) {
+            slot.capacity = byteSize(slot);
+            glBufferData(GL_PIXEL_PACK_BUFFER, slot.capacity, nullptr, GL_STREAM_READ);
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        return &slot;
+    }
+
+    void endSlot(Slot& slot) {
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        current = (current + 1) % Latency;
+    }
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef GPUTIMER_HPP
+#define GPUTIMER_HPP
+
+#include "glad/glad.h"
+#include "FrameStats.hpp"
+
+enum class GpuPhase {
+    Dispatch,
+    Barrier,
+    Draw,
+    Count
+};
+
+// Кольцо GL_TIME_ELAPSED-запросов на несколько кадров вперёд.
+// Результаты забираются только когда GL_QUERY_RESULT_AVAILABLE, поэтому
+// конвейер никогда не ждёт GPU; если кольцо занято, кадр просто не замеряется.
+class GpuTimer {
+public:
+    static constexpr int Latency = 4;
+    static constexpr int PhaseCount = int(GpuPhase::Count);
+
+    GpuTimer() {
+        glGenQueries(Latency * PhaseCount, &queries[0][0]);
+    }
+
+    ~GpuTimer() {
+        glDeleteQueries(Latency * PhaseCount, &queries[0][0]);
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // Начинает кадр; false, если свободного слота нет и кадр замерять не нужно
+    bool beginFrame(const FrameTiming& cpuTiming) {
+        Slot& slot = slots[current];
+        if (slot.pending) {
+            active = false;
+            return false;
+        }
+        slot.timing = cpuTiming;
+        for (int p = 0; p < PhaseCount; p++) slot.used[p] = false;
+        active = true;
+        return true;
+    }
+
+    void begin(GpuPhase phase) {
+        if (!active) return;
+        glBeginQuery(GL_TIME_ELAPSED, queries[current][int(phase)]);
+        slots[current].used[int(phase)] = true;
+    }
+
+    void end(GpuPhase phase) {
+        if (!active) return;
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    void endFrame() {
+        if (active) {
+            slots[current].pending = true;
+            current = (current + 1) % Latency;
+        }
+        active = false;
+    }
+
+    // Переносит в stats все кадры, результаты которых уже готовы
+    void collect(FrameStats* stats) {
+        // От самого старого слота к новому, чтобы кадры приходили по порядку
+        for (int k = 0; k < Latency; k++) {
+            int i = (current + k) % Latency;
+            Slot& slot = slots[i];
+            if (!slot.pending) continue;
+
+            bool ready = true;
+            for (int p = 0; p < PhaseCount && ready; p++) {
+                if (!slot.used[p]) continue;
+                GLint available = 0;
+                glGetQueryObjectiv(queries[i][p], GL_QUERY_RESULT_AVAILABLE, &available);
+                ready = available != 0;
+            }
+            if (!ready) continue;
+
+            double phaseMs[PhaseCount] = {};
+            for (int p = 0; p < PhaseCount; p++) {
+                if (!slot.used[p]) continue;
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(queries[i][p], GL_QUERY_RESULT, &elapsed);
+                phaseMs[p] = double(elapsed) * 1e-6;
+            }
+            slot.timing.dispatchMs = phaseMs[int(GpuPhase::Dispatch)];
+            slot.timing.barrierMs = phaseMs[int(GpuPhase::Barrier)];
+            slot.timing.drawMs = phaseMs[int(GpuPhase::Draw)];
+            slot.pending = false;
+            if (stats) stats->add(slot.timing);
+        }
+    }
+
+private:
+    struct Slot {
+        FrameTiming timing;
+        bool used[PhaseCount] = {};
+        bool pending = false;
+    };
+
+    GLuint queries[Latency][PhaseCount] = {};
+    Slot slots[Latency];
+    int current = 0;
+    bool active = false;
+};
+
+#endif
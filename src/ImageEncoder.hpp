@@ -0,0 +1,330 @@
+#ifndef IMAGEENCODER_HPP
+#define IMAGEENCODER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Deflate.hpp"
+#include "PostProcess.hpp"
+#include "ThreadPool.hpp"
+
+enum class ImageFormat {
+    PPM,
+    BMP,
+    QOI,
+    PNG
+};
+
+// Кодировщик 8-битного изображения в байты файла.
+// inputLayout() сообщает, в какой раскладке PostProcess должен подготовить пиксели.
+class ImageEncoder {
+public:
+    virtual ~ImageEncoder() {}
+
+    virtual const char* extension() const = 0;
+    virtual OutputLayout inputLayout() const { return OutputLayout::rgb(); }
+    virtual void encode(const unsigned char* pixels, int width, int height,
+                        std::vector<unsigned char>& out) const = 0;
+
+    static std::unique_ptr<ImageEncoder> create(ImageFormat format);
+
+    static const char* formatName(ImageFormat format) {
+        switch (format) {
+            case ImageFormat::PPM: return "PPM";
+            case ImageFormat::BMP: return "BMP";
+            case ImageFormat::QOI: return "QOI";
+            case ImageFormat::PNG: return "PNG";
+        }
+        return "?";
+    }
+
+protected:
+    static void putBigEndian32(std::vector<unsigned char>& out, uint32_t value) {
+        out.push_back(static_cast<unsigned char>(value >> 24));
+        out.push_back(static_cast<unsigned char>(value >> 16));
+        out.push_back(static_cast<unsigned char>(value >> 8));
+        out.push_back(static_cast<unsigned char>(value));
+    }
+
+    static void putLittleEndian32(std::vector<unsigned char>& out, uint32_t value) {
+        out.push_back(static_cast<unsigned char>(value));
+        out.push_back(static_cast<unsigned char>(value >> 8));
+        out.push_back(static_cast<unsigned char>(value >> 16));
+        out.push_back(static_cast<unsigned char>(value >> 24));
+    }
+};
+
+class PpmEncoder : public ImageEncoder {
+public:
+    const char* extension() const override { return "ppm"; }
+
+    void encode(const unsigned char* pixels, int width, int height,
+                std::vector<unsigned char>& out) const override {
+        std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        out.assign(header.begin(), header.end());
+        out.insert(out.end(), pixels, pixels + size_t(width) * height * 3);
+    }
+};
+
+class BmpEncoder : public ImageEncoder {
+public:
+    const char* extension() const override { return "bmp"; }
+    OutputLayout inputLayout() const override { return OutputLayout::bmp(); }
+
+    void encode(const unsigned char* pixels, int width, int height,
+                std::vector<unsigned char>& out) const override {
+        uint32_t imageSize = uint32_t(OutputLayout::bmp().rowStride(width) * height);
+        out.clear();
+        out.reserve(54 + imageSize);
+        out.push_back('B');
+        out.push_back('M');
+        putLittleEndian32(out, 54 + imageSize);
+        putLittleEndian32(out, 0);
+        putLittleEndian32(out, 54);
+        putLittleEndian32(out, 40);
+        putLittleEndian32(out, uint32_t(width));
+        putLittleEndian32(out, uint32_t(height));
+        out.push_back(1);
+        out.push_back(0);
+        out.push_back(24);
+        out.push_back(0);
+        putLittleEndian32(out, 0);
+        putLittleEndian32(out, imageSize);
+        for (int i = 0; i < 4; i++) putLittleEndian32(out, 0);
+        out.insert(out.end(), pixels, pixels + imageSize);
+    }
+};
+
+// QOI (https://qoiformat.org): однопроходное сжатие без потерь, ~3-4x на наших кадрах
+class QoiEncoder : public ImageEncoder {
+public:
+    const char* extension() const override { return "qoi"; }
+
+    void encode(const unsigned char* pixels, int width, int height,
+                std::vector<unsigned char>& out) const override {
+        size_t pixelCount = size_t(width) * height;
+        out.clear();
+        out.reserve(14 + pixelCount * 2 + 8);
+        out.push_back('q');
+        out.push_back('o');
+        out.push_back('i');
+        out.push_back('f');
+        putBigEndian32(out, uint32_t(width));
+        putBigEndian32(out, uint32_t(height));
+        out.push_back(3);  // RGB
+        out.push_back(0);  // sRGB с линейной альфой
+
+        struct Rgba { unsigned char r, g, b, a; };
+        Rgba index[64] = {};
+        Rgba previous{0, 0, 0, 255};
+        int run = 0;
+
+        for (size_t i = 0; i < pixelCount; i++) {
+            Rgba px{pixels[i * 3], pixels[i * 3 + 1], pixels[i * 3 + 2], 255};
+            bool same = px.r == previous.r && px.g == previous.g && px.b == previous.b;
+            if (same) {
+                run++;
+                if (run == 62 || i + 1 == pixelCount) {
+                    out.push_back(static_cast<unsigned char>(0xC0 | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                out.push_back(static_cast<unsigned char>(0xC0 | (run - 1)));
+                run = 0;
+            }
+
+            int hash = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+            if (index[hash].r == px.r && index[hash].g == px.g &&
+                index[hash].b == px.b && index[hash].a == px.a) {
+                out.push_back(static_cast<unsigned char>(hash));
+            } else {
+                index[hash] = px;
+                int dr = int(px.r) - int(previous.r);
+                int dg = int(px.g) - int(previous.g);
+                int db = int(px.b) - int(previous.b);
+                // Разности считаются по модулю 256
+                dr = int(int8_t(uint8_t(dr)));
+                dg = int(int8_t(uint8_t(dg)));
+                db = int(int8_t(uint8_t(db)));
+                int drg = dr - dg;
+                int dbg = db - dg;
+
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    out.push_back(static_cast<unsigned char>(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                    out.push_back(static_cast<unsigned char>(0x80 | (dg + 32)));
+                    out.push_back(static_cast<unsigned char>(((drg + 8) << 4) | (dbg + 8)));
+                } else {
+                    out.push_back(0xFE);
+                    out.push_back(px.r);
+                    out.push_back(px.g);
+                    out.push_back(px.b);
+                }
+            }
+            previous = px;
+        }
+
+        for (int i = 0; i < 7; i++) out.push_back(0);
+        out.push_back(1);
+    }
+};
+
+// PNG RGB8. Изображение делится на горизонтальные полосы, каждая полоса
+// фильтруется (адаптивный выбор фильтра по строке) и сжимается Deflate параллельно
+// в свой IDAT-чанк; Adler-32 собирается из сумм полос через adler32Combine.
+class PngEncoder : public ImageEncoder {
+public:
+    int stripRows = 32;
+
+    const char* extension() const override { return "png"; }
+
+    void encode(const unsigned char* pixels, int width, int height,
+                std::vector<unsigned char>& out) const override {
+        const size_t rowBytes = size_t(width) * 3;
+        const int stripCount = std::max(1, (height + stripRows - 1) / stripRows);
+
+        struct Strip {
+            std::vector<unsigned char> filtered;
+            std::vector<unsigned char> compressed;
+            uint32_t adler = 1;
+        };
+        std::vector<Strip> strips(stripCount);
+
+        ThreadPool::shared().parallelFor(0, stripCount, 1, [&](int begin, int end) {
+            Deflate deflate;
+            for (int s = begin; s < end; s++) {
+                Strip& strip = strips[s];
+                int y0 = s * stripRows;
+                int y1 = std::min(height, y0 + stripRows);
+                strip.filtered.resize(size_t(y1 - y0) * (rowBytes + 1));
+                for (int y = y0; y < y1; y++) {
+                    const unsigned char* row = pixels + size_t(y) * rowBytes;
+                    const unsigned char* above = y > 0 ? row - rowBytes : nullptr;
+                    filterRow(row, above, rowBytes, strip.filtered.data() + size_t(y - y0) * (rowBytes + 1));
+                }
+                strip.adler = Deflate::adler32(strip.filtered.data(), strip.filtered.size());
+
+                // Первая полоса несёт заголовок zlib
+                if (s == 0) {
+                    strip.compressed.push_back(0x78);
+                    strip.compressed.push_back(0x01);
+                }
+                deflate.compress(strip.filtered.data(), strip.filtered.size(),
+                                 s == stripCount - 1, strip.compressed);
+            }
+        });
+
+        uint32_t adler = 1;
+        for (auto& strip : strips) {
+            adler = Deflate::adler32Combine(adler, strip.adler, strip.filtered.size());
+        }
+
+        static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        out.assign(signature, signature + 8);
+
+        std::vector<unsigned char> ihdr;
+        putBigEndian32(ihdr, uint32_t(width));
+        putBigEndian32(ihdr, uint32_t(height));
+        ihdr.push_back(8);  // бит на канал
+        ihdr.push_back(2);  // RGB
+        ihdr.push_back(0);
+        ihdr.push_back(0);
+        ihdr.push_back(0);
+        writeChunk(out, "IHDR", ihdr.data(), ihdr.size());
+
+        for (auto& strip : strips) {
+            writeChunk(out, "IDAT", strip.compressed.data(), strip.compressed.size());
+        }
+        unsigned char trailer[4] = {
+                static_cast<unsigned char>(adler >> 24), static_cast<unsigned char>(adler >> 16),
+                static_cast<unsigned char>(adler >> 8), static_cast<unsigned char>(adler)
+        };
+        writeChunk(out, "IDAT", trailer, 4);
+        writeChunk(out, "IEND", nullptr, 0);
+    }
+
+private:
+    static uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0) {
+        static const std::vector<uint32_t> table = [] {
+            std::vector<uint32_t> t(256);
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static void writeChunk(std::vector<unsigned char>& out, const char* type,
+                           const unsigned char* data, size_t size) {
+        putBigEndian32(out, uint32_t(size));
+        size_t typeOffset = out.size();
+        out.insert(out.end(), type, type + 4);
+        if (size > 0) out.insert(out.end(), data, data + size);
+        putBigEndian32(out, crc32(out.data() + typeOffset, size + 4));
+    }
+
+    static unsigned char paeth(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) return static_cast<unsigned char>(a);
+        if (pb <= pc) return static_cast<unsigned char>(b);
+        return static_cast<unsigned char>(c);
+    }
+
+    // Пробует все пять фильтров и берёт тот, у которого меньше сумма |остатков|
+    static void filterRow(const unsigned char* row, const unsigned char* above,
+                          size_t rowBytes, unsigned char* dst) {
+        const int bpp = 3;
+        unsigned char* best = dst + 1;
+        std::vector<unsigned char> candidate(rowBytes);
+        uint64_t bestScore = UINT64_MAX;
+
+        for (int filter = 0; filter < 5; filter++) {
+            uint64_t score = 0;
+            for (size_t i = 0; i < rowBytes; i++) {
+                int a = i >= size_t(bpp) ? row[i - bpp] : 0;
+                int b = above ? above[i] : 0;
+                int c = (above && i >= size_t(bpp)) ? above[i - bpp] : 0;
+                int predicted = 0;
+                switch (filter) {
+                    case 1: predicted = a; break;
+                    case 2: predicted = b; break;
+                    case 3: predicted = (a + b) / 2; break;
+                    case 4: predicted = paeth(a, b, c); break;
+                    default: break;
+                }
+                unsigned char residual = static_cast<unsigned char>(row[i] - predicted);
+                candidate[i] = residual;
+                score += int8_t(residual) < 0 ? 256 - residual : residual;
+            }
+            if (score < bestScore) {
+                bestScore = score;
+                dst[0] = static_cast<unsigned char>(filter);
+                std::memcpy(best, candidate.data(), rowBytes);
+            }
+        }
+    }
+};
+
+inline std::unique_ptr<ImageEncoder> ImageEncoder::create(ImageFormat format) {
+    switch (format) {
+        case ImageFormat::PPM: return std::make_unique<PpmEncoder>();
+        case ImageFormat::BMP: return std::make_unique<BmpEncoder>();
+        case ImageFormat::QOI: return std::make_unique<QoiEncoder>();
+        case ImageFormat::PNG: return std::make_unique<PngEncoder>();
+    }
+    return nullptr;
+}
+
+#endif
@@ -8,6 +8,8 @@
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#include <climits>
+#include <cstdlib>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -18,8 +20,12 @@
 #define CREATE_DIR(path) mkdir(path, 0755)
 #endif
 
+#include "FrameBuffer.hpp"
+#include "PostProcess.hpp"
+#include "ImageEncoder.hpp"
+
 class ImageUtils {
-private:
+public:
     // Создание директории, если она не существует
     static bool createDirectory(const std::string& path) {
         struct stat info;
@@ -68,39 +74,97 @@ private:
         return relativePath;
     }
 
-public:
-    // Сохранение с автоматическим созданием директории и timestamp
+    // Сохранение с автоматическим созданием директории и timestamp.
+    // pixels — RGB сверху вниз; каждый формат из formats пишется в свой файл.
     static bool saveImage(const std::vector<unsigned char>& pixels,
                           int width, int height,
                           const std::string& directory = "output",
-                          const std::string& prefix = "screenshot") {
-        // Создаём директорию
+                          const std::string& prefix = "screenshot",
+                          const std::vector<ImageFormat>& formats = {ImageFormat::PNG}) {
         if (!createDirectory(directory)) {
             return false;
         }
 
-        // Генерируем имена файлов с timestamp
-        std::string timestamp = getTimestamp();
-        std::string baseFilename = directory + "/" + prefix + "_" + timestamp;
-        std::string ppmFile = baseFilename + ".ppm";
-        std::string bmpFile = baseFilename + ".bmp";
-
-        // Сохраняем оба формата
-        bool ppmSuccess = savePPM(ppmFile, pixels, width, height);
-        bool bmpSuccess = saveBMP(bmpFile, pixels, width, height);
+        std::string baseFilename = directory + "/" + prefix + "_" + getTimestamp();
+        std::vector<std::string> saved;
+        std::vector<unsigned char> converted;
+        std::vector<unsigned char> encoded;
 
-        if (ppmSuccess || bmpSuccess) {
-            std::cout << "\n=== Screenshot saved ===" << std::endl;
-            if (ppmSuccess) {
-                std::cout << "PPM: " << getAbsolutePath(ppmFile) << std::endl;
+        for (ImageFormat format : formats) {
+            auto encoder = ImageEncoder::create(format);
+            const unsigned char* input = pixels.data();
+            OutputLayout layout = encoder->inputLayout();
+            if (layout.order != ChannelOrder::RGB || layout.bottomUp || layout.rowAlignment != 1) {
+                convertLayout(pixels, width, height, layout, converted);
+                input = converted.data();
             }
-            if (bmpSuccess) {
-                std::cout << "BMP: " << getAbsolutePath(bmpFile) << std::endl;
+            encoder->encode(input, width, height, encoded);
+            std::string filename = baseFilename + "." + encoder->extension();
+            if (writeFile(filename, encoded)) {
+                saved.push_back(std::string(ImageEncoder::formatName(format)) + ": " + getAbsolutePath(filename));
+            }
+        }
+
+        reportSaved(saved);
+        return !saved.empty();
+    }
+
+    // Сохранение линейного буфера: PostProcess кодирует кадр сразу в раскладку,
+    // которую ожидает кодировщик (без отдельного прохода swizzle/flip)
+    static bool saveImage(const FrameBuffer& frame, const PostProcess& post,
+                          const std::string& directory = "output",
+                          const std::string& prefix = "screenshot",
+                          const std::vector<ImageFormat>& formats = {ImageFormat::PNG}) {
+        if (!createDirectory(directory)) {
+            return false;
+        }
+
+        std::string baseFilename = directory + "/" + prefix + "_" + getTimestamp();
+        std::vector<std::string> saved;
+        std::vector<unsigned char> pixels;
+        std::vector<unsigned char> encoded;
+
+        for (ImageFormat format : formats) {
+            auto encoder = ImageEncoder::create(format);
+            post.process(frame, encoder->inputLayout(), pixels);
+            encoder->encode(pixels.data(), frame.width, frame.height, encoded);
+            std::string filename = baseFilename + "." + encoder->extension();
+            if (writeFile(filename, encoded)) {
+                saved.push_back(std::string(ImageEncoder::formatName(format)) + ": " + getAbsolutePath(filename));
             }
-            std::cout << "========================\n" << std::endl;
         }
 
-        return ppmSuccess || bmpSuccess;
+        reportSaved(saved);
+        return !saved.empty();
+    }
+
+    static bool writeFile(const std::string& filename, const std::vector<unsigned char>& data) {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file: " << filename << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        return file.good();
+    }
+
+    // Перепаковка RGB сверху вниз в произвольную раскладку
+    static void convertLayout(const std::vector<unsigned char>& rgb, int width, int height,
+                              const OutputLayout& layout, std::vector<unsigned char>& out) {
+        size_t stride = layout.rowStride(width);
+        int channels = layout.channels();
+        bool swap = layout.order == ChannelOrder::BGR || layout.order == ChannelOrder::BGRA;
+        out.assign(stride * height, 0);
+        for (int y = 0; y < height; y++) {
+            unsigned char* dst = out.data() + size_t(layout.bottomUp ? height - 1 - y : y) * stride;
+            const unsigned char* src = rgb.data() + size_t(y) * width * 3;
+            for (int x = 0; x < width; x++) {
+                dst[x * channels + 0] = src[x * 3 + (swap ? 2 : 0)];
+                dst[x * channels + 1] = src[x * 3 + 1];
+                dst[x * channels + 2] = src[x * 3 + (swap ? 0 : 2)];
+                if (channels == 4) dst[x * channels + 3] = 255;
+            }
+        }
     }
 
     static bool savePPM(const std::string& filename,
@@ -128,6 +192,52 @@ public:
             return false;
         }
 
+        int rowSize = ((width * 3 + 3) / 4) * 4;
+        writeBMPHeader(file, width, height);
+
+        static const char padding[3] = {0, 0, 0};
+        for (int y = height - 1; y >= 0; y--) {
+            for (int x = 0; x < width; x++) {
+                int idx = (y * width + x) * 3;
+                file.put(pixels[idx + 2]);
+                file.put(pixels[idx + 1]);
+                file.put(pixels[idx + 0]);
+            }
+            file.write(padding, rowSize - width * 3);
+        }
+
+        file.close();
+        return true;
+    }
+
+    // Данные уже в раскладке BMP (OutputLayout::bmp()): пишутся одним блоком
+    static bool saveBMPRaw(const std::string& filename,
+                           const std::vector<unsigned char>& bmpPixels,
+                           int width, int height) {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file: " << filename << std::endl;
+            return false;
+        }
+
+        writeBMPHeader(file, width, height);
+        file.write(reinterpret_cast<const char*>(bmpPixels.data()), bmpPixels.size());
+
+        file.close();
+        return true;
+    }
+
+private:
+    static void reportSaved(const std::vector<std::string>& saved) {
+        if (saved.empty()) return;
+        std::cout << "\n=== Screenshot saved ===" << std::endl;
+        for (const auto& line : saved) {
+            std::cout << line << std::endl;
+        }
+        std::cout << "========================\n" << std::endl;
+    }
+
+    static void writeBMPHeader(std::ofstream& file, int width, int height) {
         int rowSize = ((width * 3 + 3) / 4) * 4;
         int imageSize = rowSize * height;
         int fileSize = 54 + imageSize;
@@ -163,20 +273,6 @@ public:
         };
 
         file.write(reinterpret_cast<char*>(header), 54);
-
-        std::vector<unsigned char> padding(rowSize - width * 3, 0);
-        for (int y = height - 1; y >= 0; y--) {
-            for (int x = 0; x < width; x++) {
-                int idx = (y * width + x) * 3;
-                file.put(pixels[idx + 2]);
-                file.put(pixels[idx + 1]);
-                file.put(pixels[idx + 0]);
-            }
-            file.write(reinterpret_cast<char*>(padding.data()), padding.size());
-        }
-
-        file.close();
-        return true;
     }
 };
 
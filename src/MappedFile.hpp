@@ -0,0 +1,123 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Файл, отображённый в память только для чтения. Страницы подгружаются ОС
+// по мере обращения, поэтому разбор больших файлов не копирует их в кучу.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& path, bool sequential = true) { open(path, sequential); }
+
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // sequential — файл будет прочитан целиком по порядку (разбор);
+    // иначе доступ выборочный и опережающее чтение только мешает
+    bool open(const std::string& path, bool sequential = true) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            std::cerr << "Failed to open file: " << path << std::endl;
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        length = size_t(fileSize.QuadPart);
+        if (length > 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Failed to open file: " << path << std::endl;
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0) length = size_t(info.st_size);
+        if (length > 0) {
+            void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                bytes = static_cast<const char*>(address);
+                if (sequential) {
+                    madvise(address, length, MADV_SEQUENTIAL);
+                    madvise(address, length, MADV_WILLNEED);
+                } else {
+                    madvise(address, length, MADV_RANDOM);
+                }
+            }
+        }
+        ::close(fd);
+#endif
+        if (length > 0 && !bytes) {
+            std::cerr << "Failed to map file: " << path << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes) munmap(const_cast<char*>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    // Отпускает страницы, покрывающие диапазон. Окно выравнивается по
+    // 64 КБ: при промахе ядро отображает соседние страницы пачкой
+    // (fault-around), и без этого они так и оставались бы резидентными.
+    // Отображение только для чтения, при следующем обращении ОС просто
+    // снова прочитает страницы из файла.
+    void release(size_t offset, size_t count) const {
+#ifndef _WIN32
+        const size_t window = size_t(64) << 10;
+        size_t begin = offset / window * window;
+        size_t end = std::min(length, (offset + count + window - 1) / window * window);
+        if (bytes && end > begin) madvise(const_cast<char*>(bytes) + begin, end - begin, MADV_DONTNEED);
+#else
+        (void)offset;
+        (void)count;
+#endif
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+#endif
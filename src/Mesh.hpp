@@ -0,0 +1,121 @@
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "Vector3.hpp"
+#include "Ray.hpp"
+#include "Sphere.hpp"
+#include "BVH.hpp"
+#include "ThreadPool.hpp"
+
+// Номера версий геометрии общие для всех сеток и групп: после замены
+// Scene::meshes[i] другой сеткой номер в ячейке тоже сменится
+inline unsigned long long nextGeometryRevision() {
+    static std::atomic<unsigned long long> counter{0};
+    return ++counter;
+}
+
+// Треугольная сетка. Вершины хранятся как SoA (x, y, z отдельными массивами),
+// треугольники — тройками индексов. Для обхода у каждой сетки свой BVH,
+// который нужно построить вызовом build() после заполнения массивов.
+class Mesh {
+public:
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<uint32_t> indices;
+    Material material;
+
+    size_t vertexCount() const { return x.size(); }
+    size_t triangleCount() const { return indices.size() / 3; }
+
+    Vector3 vertex(uint32_t i) const { return Vector3(x[i], y[i], z[i]); }
+
+    const BVH& accelerationStructure() const { return bvh; }
+    AABB bounds() const { return bvh.isEmpty() ? AABB() : bvh.nodes[0].bounds; }
+
+    // Меняется при build() и markChanged(); правку без перестройки BVH
+    // (например, материала) нужно отметить markChanged()
+    unsigned long long getRevision() const { return revision; }
+    void markChanged() { revision = nextGeometryRevision(); }
+
+    void build() {
+        markChanged();
+        int count = int(triangleCount());
+        std::vector<AABB> triangleBounds(count);
+        ThreadPool::shared().parallelFor(0, count, 16384, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                AABB box;
+                box.grow(vertex(indices[3 * i]));
+                box.grow(vertex(indices[3 * i + 1]));
+                box.grow(vertex(indices[3 * i + 2]));
+                triangleBounds[i] = box;
+            }
+        });
+        bvh.build(triangleBounds);
+    }
+
+    // Möller–Trumbore; расстояние до пересечения или -1 при промахе
+    float intersectTriangle(const Ray& ray, int triangle) const {
+        uint32_t i0 = indices[3 * triangle];
+        uint32_t i1 = indices[3 * triangle + 1];
+        uint32_t i2 = indices[3 * triangle + 2];
+        Vector3 v0 = vertex(i0);
+        Vector3 edge1 = vertex(i1) - v0;
+        Vector3 edge2 = vertex(i2) - v0;
+
+        Vector3 p = ray.direction.cross(edge2);
+        float det = edge1.dot(p);
+        if (std::fabs(det) < 1e-12f) return -1.0f;
+        float invDet = 1.0f / det;
+
+        Vector3 s = ray.origin - v0;
+        float u = s.dot(p) * invDet;
+        if (u < 0.0f || u > 1.0f) return -1.0f;
+
+        Vector3 q = s.cross(edge1);
+        float v = ray.direction.dot(q) * invDet;
+        if (v < 0.0f || u + v > 1.0f) return -1.0f;
+
+        return edge2.dot(q) * invDet;
+    }
+
+    // Ближайший треугольник на (tMin, tMax); при попадании уменьшает tMax
+    int intersect(const Ray& ray, float tMin, float& tMax) const {
+        int closest = -1;
+        bvh.intersect(ray, tMin, tMax, [&](int triangle, float& tFar) {
+            float t = intersectTriangle(ray, triangle);
+            if (t > tMin && t < tFar) {
+                tFar = t;
+                closest = triangle;
+                return true;
+            }
+            return false;
+        });
+        return closest;
+    }
+
+    bool occluded(const Ray& ray, float tMin, float tMax) const {
+        return bvh.occluded(ray, tMin, tMax, [&](int triangle, float lo, float hi) {
+            float t = intersectTriangle(ray, triangle);
+            return t > lo && t < hi;
+        });
+    }
+
+    // Геометрическая нормаль, развёрнутая навстречу лучу: у сеток нет
+    // гарантированного порядка обхода, а затенение ждёт нормаль к наблюдателю
+    Vector3 getNormal(int triangle, const Vector3& rayDirection) const {
+        Vector3 v0 = vertex(indices[3 * triangle]);
+        Vector3 normal = (vertex(indices[3 * triangle + 1]) - v0)
+                .cross(vertex(indices[3 * triangle + 2]) - v0).normalize();
+        return normal.dot(rayDirection) > 0.0f ? normal * -1.0f : normal;
+    }
+
+private:
+    BVH bvh;
+    unsigned long long revision = nextGeometryRevision();
+};
+
+#endif
@@ -0,0 +1,544 @@
+#ifndef MESHLOADER_HPP
+#define MESHLOADER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+// Загрузка OBJ и бинарного PLY. Файл отображается в память и разбирается
+// параллельно по чанкам в два прохода: сначала подсчёт вершин и треугольников
+// в каждом чанке, затем запись прямо в SoA-массивы Mesh по префиксным смещениям.
+// Строки не копируются, числа читаются std::from_chars прямо из отображения.
+// Многоугольники триангулируются веером; нормали и UV не загружаются.
+class MeshLoader {
+public:
+    // Формат выбирается по расширению; после загрузки строится BVH сетки
+    static bool load(const std::string& path, Mesh& mesh) {
+        auto start = std::chrono::steady_clock::now();
+
+        MappedFile file;
+        if (!file.open(path)) return false;
+
+        bool ok;
+        if (hasExtension(path, ".ply")) {
+            ok = parsePLY(file.data(), file.size(), mesh);
+        } else if (hasExtension(path, ".obj")) {
+            ok = parseOBJ(file.data(), file.size(), mesh);
+        } else {
+            std::cerr << "Unsupported mesh format: " << path << std::endl;
+            return false;
+        }
+        if (!ok) {
+            std::cerr << "Failed to load mesh: " << path << std::endl;
+            return false;
+        }
+
+        auto parsed = std::chrono::steady_clock::now();
+        mesh.build();
+        auto built = std::chrono::steady_clock::now();
+
+        std::cout << "Loaded mesh " << path << ": " << mesh.vertexCount() << " vertices, "
+                  << mesh.triangleCount() << " triangles (parse "
+                  << std::chrono::duration<double, std::milli>(parsed - start).count() << " ms, BVH "
+                  << std::chrono::duration<double, std::milli>(built - parsed).count() << " ms)"
+                  << std::endl;
+        return true;
+    }
+
+    static bool parseOBJ(const char* data, size_t size, Mesh& mesh) {
+        std::vector<Range> chunks = splitLines(data, size);
+        int chunkCount = int(chunks.size());
+        std::vector<size_t> vertexStart(chunkCount + 1, 0);
+        std::vector<size_t> triangleStart(chunkCount + 1, 0);
+
+        // Проход 1: только подсчёт, ничего не пишем
+        ThreadPool::shared().parallelFor(0, chunkCount, 1, [&](int begin, int end) {
+            for (int c = begin; c < end; c++) {
+                size_t vertices = 0, triangles = 0;
+                forEachLine(chunks[c], [&](const char* p, const char* lineEnd) {
+                    if (isKeyword(p, lineEnd, 'v')) {
+                        vertices++;
+                    } else if (isKeyword(p, lineEnd, 'f')) {
+                        size_t corners = 0;
+                        for (p += 2; skipSpaces(p, lineEnd) < lineEnd; p = skipToken(p, lineEnd)) corners++;
+                        if (corners >= 3) triangles += corners - 2;
+                    }
+                });
+                vertexStart[c + 1] = vertices;
+                triangleStart[c + 1] = triangles;
+            }
+        });
+        for (int c = 0; c < chunkCount; c++) {
+            vertexStart[c + 1] += vertexStart[c];
+            triangleStart[c + 1] += triangleStart[c];
+        }
+
+        size_t vertexCount = vertexStart[chunkCount];
+        resize(mesh, vertexCount, triangleStart[chunkCount]);
+
+        // Проход 2: разбор в уже выделенные массивы
+        std::atomic<bool> valid{true};
+        ThreadPool::shared().parallelFor(0, chunkCount, 1, [&](int begin, int end) {
+            for (int c = begin; c < end; c++) {
+                size_t v = vertexStart[c];
+                uint32_t* out = mesh.indices.data() + 3 * triangleStart[c];
+                forEachLine(chunks[c], [&](const char* p, const char* lineEnd) {
+                    if (isKeyword(p, lineEnd, 'v')) {
+                        p += 2;
+                        if (!parseFloat(p, lineEnd, mesh.x[v]) || !parseFloat(p, lineEnd, mesh.y[v]) ||
+                            !parseFloat(p, lineEnd, mesh.z[v])) {
+                            valid = false;
+                        }
+                        v++;
+                    } else if (isKeyword(p, lineEnd, 'f')) {
+                        // Индексы OBJ с единицы; отрицательные — относительно
+                        // последней вершины, объявленной до этой строки (её номер равен v)
+                        uint32_t first = 0, previous = 0;
+                        int corner = 0;
+                        for (p += 2; skipSpaces(p, lineEnd) < lineEnd; corner++) {
+                            long long index = 0;
+                            if (!parseInt(p, lineEnd, index) || index == 0) {
+                                valid = false;
+                                return;
+                            }
+                            index = index > 0 ? index - 1 : (long long)v + index;
+                            if (index < 0 || index >= (long long)vertexCount) {
+                                valid = false;
+                                index = 0;
+                            }
+                            p = skipToken(p, lineEnd);  // "/vt/vn" после индекса позиции
+
+                            uint32_t current = uint32_t(index);
+                            if (corner == 0) {
+                                first = current;
+                            } else if (corner >= 2) {
+                                out[0] = first;
+                                out[1] = previous;
+                                out[2] = current;
+                                out += 3;
+                            }
+                            previous = current;
+                        }
+                    }
+                });
+            }
+        });
+
+        if (!valid) {
+            std::cerr << "Malformed OBJ data" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Бинарный PLY (little и big endian): элемент vertex со скалярными x, y, z
+    // и элемент face со списком vertex_indices; прочие элементы и свойства пропускаются
+    static bool parsePLY(const char* data, size_t size, Mesh& mesh) {
+        PlyHeader header;
+        if (!parsePLYHeader(data, size, header)) return false;
+
+        const char* end = data + size;
+        const char* p = data + header.bodyOffset;
+        for (const PlyElement& element : header.elements) {
+            if (element.name == "vertex") {
+                if (!readPLYVertices(p, end, element, header.bigEndian, mesh)) return false;
+            } else if (element.name == "face") {
+                if (!readPLYFaces(p, end, element, header.bigEndian, mesh)) return false;
+            } else {
+                for (size_t i = 0; i < element.count && p; i++) {
+                    p = skipRecord(p, end, element, header.bigEndian);
+                }
+            }
+            if (!p) {
+                std::cerr << "Truncated PLY data in element " << element.name << std::endl;
+                return false;
+            }
+        }
+
+        for (uint32_t index : mesh.indices) {
+            if (index >= mesh.vertexCount()) {
+                std::cerr << "PLY face index out of range" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Range {
+        const char* begin;
+        const char* end;
+    };
+
+    static constexpr size_t ChunkBytes = 1 << 20;
+
+    static bool hasExtension(const std::string& path, const char* extension) {
+        size_t length = std::strlen(extension);
+        if (path.size() < length) return false;
+        for (size_t i = 0; i < length; i++) {
+            char c = path[path.size() - length + i];
+            if (c >= 'A' && c <= 'Z') c = char(c - 'A' + 'a');
+            if (c != extension[i]) return false;
+        }
+        return true;
+    }
+
+    static void resize(Mesh& mesh, size_t vertexCount, size_t triangleCount) {
+        mesh.x.resize(vertexCount);
+        mesh.y.resize(vertexCount);
+        mesh.z.resize(vertexCount);
+        mesh.indices.resize(3 * triangleCount);
+    }
+
+    // Куски примерно по ChunkBytes, границы сдвинуты на начало строки
+    static std::vector<Range> splitLines(const char* data, size_t size) {
+        std::vector<Range> chunks;
+        const char* end = data + size;
+        const char* begin = data;
+        while (begin < end) {
+            const char* split = begin + std::min(ChunkBytes, size_t(end - begin));
+            if (split < end) {
+                const char* newline = static_cast<const char*>(std::memchr(split, '\n', end - split));
+                split = newline ? newline + 1 : end;
+            }
+            chunks.push_back({begin, split});
+            begin = split;
+        }
+        return chunks;
+    }
+
+    template <typename LineFn>
+    static void forEachLine(const Range& range, LineFn&& fn) {
+        const char* p = range.begin;
+        while (p < range.end) {
+            const char* newline = static_cast<const char*>(std::memchr(p, '\n', range.end - p));
+            const char* lineEnd = newline ? newline : range.end;
+            const char* start = skipSpaces(p, lineEnd);
+            if (start < lineEnd && *start != '#') fn(start, lineEnd);
+            p = lineEnd + 1;
+        }
+    }
+
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static const char* skipSpaces(const char*& p, const char* end) {
+        while (p < end && isSpace(*p)) p++;
+        return p;
+    }
+
+    static const char* skipToken(const char* p, const char* end) {
+        while (p < end && !isSpace(*p)) p++;
+        return p;
+    }
+
+    // "v x y z" или "f ...", но не "vn", "vt"
+    static bool isKeyword(const char* p, const char* end, char keyword) {
+        return end - p >= 2 && p[0] == keyword && isSpace(p[1]);
+    }
+
+    static bool parseFloat(const char*& p, const char* end, float& value) {
+        skipSpaces(p, end);
+        if (p < end && *p == '+') p++;
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) return false;
+        p = result.ptr;
+        return true;
+    }
+
+    static bool parseInt(const char*& p, const char* end, long long& value) {
+        if (p < end && *p == '+') p++;
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) return false;
+        p = result.ptr;
+        return true;
+    }
+
+    enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+    struct PlyProperty {
+        std::string name;
+        PlyType type = PlyType::Invalid;
+        bool isList = false;
+        PlyType countType = PlyType::Invalid;
+    };
+
+    struct PlyElement {
+        std::string name;
+        size_t count = 0;
+        std::vector<PlyProperty> properties;
+    };
+
+    struct PlyHeader {
+        bool bigEndian = false;
+        size_t bodyOffset = 0;
+        std::vector<PlyElement> elements;
+    };
+
+    static PlyType plyType(const std::string& name) {
+        if (name == "char" || name == "int8") return PlyType::Int8;
+        if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+        if (name == "short" || name == "int16") return PlyType::Int16;
+        if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+        if (name == "int" || name == "int32") return PlyType::Int32;
+        if (name == "uint" || name == "uint32") return PlyType::UInt32;
+        if (name == "float" || name == "float32") return PlyType::Float32;
+        if (name == "double" || name == "float64") return PlyType::Float64;
+        return PlyType::Invalid;
+    }
+
+    static size_t plySize(PlyType type) {
+        switch (type) {
+            case PlyType::Int8: case PlyType::UInt8: return 1;
+            case PlyType::Int16: case PlyType::UInt16: return 2;
+            case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+            case PlyType::Float64: return 8;
+            default: return 0;
+        }
+    }
+
+    static void loadBytes(const char* p, unsigned char* out, size_t size, bool bigEndian) {
+        std::memcpy(out, p, size);
+        bool hostBigEndian = false;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        hostBigEndian = true;
+#endif
+        if (bigEndian != hostBigEndian) std::reverse(out, out + size);
+    }
+
+    static double readPLYValue(const char* p, PlyType type, bool bigEndian) {
+        unsigned char bytes[8];
+        loadBytes(p, bytes, plySize(type), bigEndian);
+        switch (type) {
+            case PlyType::Int8: { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+            case PlyType::UInt8: return bytes[0];
+            case PlyType::Int16: { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+            case PlyType::UInt16: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+            case PlyType::Int32: { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+            case PlyType::UInt32: { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+            case PlyType::Float32: { float v; std::memcpy(&v, bytes, 4); return v; }
+            case PlyType::Float64: { double v; std::memcpy(&v, bytes, 8); return v; }
+            default: return 0.0;
+        }
+    }
+
+    static bool parsePLYHeader(const char* data, size_t size, PlyHeader& header) {
+        const char* end = data + size;
+        const char* p = data;
+        bool first = true;
+        bool formatSeen = false;
+        while (p < end) {
+            const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!newline) break;
+            // Заголовок короткий, здесь строки допустимы
+            std::string line(p, newline);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            p = newline + 1;
+
+            std::vector<std::string> words;
+            for (size_t i = 0; i < line.size();) {
+                while (i < line.size() && isSpace(line[i])) i++;
+                size_t j = i;
+                while (j < line.size() && !isSpace(line[j])) j++;
+                if (j > i) words.push_back(line.substr(i, j - i));
+                i = j;
+            }
+
+            if (first) {
+                if (words.size() != 1 || words[0] != "ply") {
+                    std::cerr << "Not a PLY file" << std::endl;
+                    return false;
+                }
+                first = false;
+            } else if (words.empty() || words[0] == "comment" || words[0] == "obj_info") {
+                continue;
+            } else if (words[0] == "format" && words.size() >= 2) {
+                if (words[1] == "binary_little_endian") {
+                    header.bigEndian = false;
+                } else if (words[1] == "binary_big_endian") {
+                    header.bigEndian = true;
+                } else {
+                    std::cerr << "Only binary PLY is supported, got format " << words[1] << std::endl;
+                    return false;
+                }
+                formatSeen = true;
+            } else if (words[0] == "element" && words.size() == 3) {
+                PlyElement element;
+                element.name = words[1];
+                element.count = std::strtoull(words[2].c_str(), nullptr, 10);
+                header.elements.push_back(element);
+            } else if (words[0] == "property" && !header.elements.empty()) {
+                PlyProperty property;
+                if (words.size() == 5 && words[1] == "list") {
+                    property.isList = true;
+                    property.countType = plyType(words[2]);
+                    property.type = plyType(words[3]);
+                    property.name = words[4];
+                } else if (words.size() == 3) {
+                    property.type = plyType(words[1]);
+                    property.name = words[2];
+                }
+                if (property.type == PlyType::Invalid ||
+                    (property.isList && property.countType == PlyType::Invalid)) {
+                    std::cerr << "Unsupported PLY property: " << line << std::endl;
+                    return false;
+                }
+                header.elements.back().properties.push_back(property);
+            } else if (words[0] == "end_header") {
+                header.bodyOffset = size_t(p - data);
+                if (!formatSeen) std::cerr << "PLY header has no format line" << std::endl;
+                return formatSeen;
+            }
+        }
+        std::cerr << "PLY header is not terminated" << std::endl;
+        return false;
+    }
+
+    // Возвращает начало следующей записи или nullptr, если данные обрезаны
+    static const char* skipRecord(const char* p, const char* end, const PlyElement& element,
+                                  bool bigEndian) {
+        for (const PlyProperty& property : element.properties) {
+            if (property.isList) {
+                size_t countSize = plySize(property.countType);
+                if (size_t(end - p) < countSize) return nullptr;
+                size_t count = size_t(readPLYValue(p, property.countType, bigEndian));
+                p += countSize;
+                if (size_t(end - p) < count * plySize(property.type)) return nullptr;
+                p += count * plySize(property.type);
+            } else {
+                if (size_t(end - p) < plySize(property.type)) return nullptr;
+                p += plySize(property.type);
+            }
+        }
+        return p;
+    }
+
+    static bool readPLYVertices(const char*& p, const char* end, const PlyElement& element,
+                                bool bigEndian, Mesh& mesh) {
+        size_t stride = 0;
+        int axisOffset[3] = {-1, -1, -1};
+        PlyType axisType[3] = {PlyType::Invalid, PlyType::Invalid, PlyType::Invalid};
+        for (const PlyProperty& property : element.properties) {
+            if (property.isList) {
+                std::cerr << "PLY vertex lists are not supported" << std::endl;
+                return false;
+            }
+            int axis = property.name == "x" ? 0 : property.name == "y" ? 1 : property.name == "z" ? 2 : -1;
+            if (axis >= 0) {
+                axisOffset[axis] = int(stride);
+                axisType[axis] = property.type;
+            }
+            stride += plySize(property.type);
+        }
+        if (axisOffset[0] < 0 || axisOffset[1] < 0 || axisOffset[2] < 0) {
+            std::cerr << "PLY vertices have no x, y, z" << std::endl;
+            return false;
+        }
+        if (size_t(end - p) / std::max<size_t>(stride, 1) < element.count) {
+            p = nullptr;
+            return true;
+        }
+
+        mesh.x.resize(element.count);
+        mesh.y.resize(element.count);
+        mesh.z.resize(element.count);
+        float* axes[3] = {mesh.x.data(), mesh.y.data(), mesh.z.data()};
+        bool fastPath = !bigEndian && axisType[0] == PlyType::Float32 &&
+                        axisType[1] == PlyType::Float32 && axisType[2] == PlyType::Float32;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        fastPath = false;
+#endif
+        const char* base = p;
+        ThreadPool::shared().parallelFor(0, int(element.count), 65536, [&](int begin, int finish) {
+            for (int i = begin; i < finish; i++) {
+                const char* record = base + size_t(i) * stride;
+                for (int a = 0; a < 3; a++) {
+                    if (fastPath) {
+                        std::memcpy(&axes[a][i], record + axisOffset[a], sizeof(float));
+                    } else {
+                        axes[a][i] = float(readPLYValue(record + axisOffset[a], axisType[a], bigEndian));
+                    }
+                }
+            }
+        });
+        p += element.count * stride;
+        return true;
+    }
+
+    static bool readPLYFaces(const char*& p, const char* end, const PlyElement& element,
+                             bool bigEndian, Mesh& mesh) {
+        int listIndex = -1;
+        for (size_t i = 0; i < element.properties.size(); i++) {
+            const PlyProperty& property = element.properties[i];
+            if (property.isList && (property.name == "vertex_indices" || property.name == "vertex_index")) {
+                listIndex = int(i);
+            }
+        }
+        if (listIndex < 0) {
+            std::cerr << "PLY faces have no vertex_indices list" << std::endl;
+            return false;
+        }
+
+        // Записи переменной длины: последовательно находим начало каждого блока
+        // и число треугольников в нём, сами индексы читаются параллельно
+        const size_t blockFaces = 65536;
+        size_t blockCount = (element.count + blockFaces - 1) / blockFaces;
+        std::vector<const char*> blockStart(blockCount);
+        std::vector<size_t> triangleStart(blockCount + 1, 0);
+        const PlyProperty& list = element.properties[listIndex];
+        for (size_t i = 0; i < element.count; i++) {
+            if (i % blockFaces == 0) blockStart[i / blockFaces] = p;
+            const char* record = p;
+            p = skipRecord(p, end, element, bigEndian);
+            if (!p) return true;
+            const char* listStart = record;
+            for (int k = 0; k < listIndex; k++) listStart += plySize(element.properties[k].type);
+            size_t corners = size_t(readPLYValue(listStart, list.countType, bigEndian));
+            if (corners >= 3) triangleStart[i / blockFaces + 1] += corners - 2;
+        }
+        for (size_t b = 0; b < blockCount; b++) triangleStart[b + 1] += triangleStart[b];
+        mesh.indices.resize(3 * triangleStart[blockCount]);
+
+        // Свойства до списка индексов должны быть скалярами, иначе смещение не постоянно
+        for (int k = 0; k < listIndex; k++) {
+            if (element.properties[k].isList) {
+                std::cerr << "PLY face lists before vertex_indices are not supported" << std::endl;
+                return false;
+            }
+        }
+
+        size_t countSize = plySize(list.countType);
+        size_t indexSize = plySize(list.type);
+        ThreadPool::shared().parallelFor(0, int(blockCount), 1, [&](int begin, int finish) {
+            for (int b = begin; b < finish; b++) {
+                const char* record = blockStart[b];
+                uint32_t* out = mesh.indices.data() + 3 * triangleStart[b];
+                size_t faceEnd = std::min(element.count, size_t(b + 1) * blockFaces);
+                for (size_t i = size_t(b) * blockFaces; i < faceEnd; i++) {
+                    const char* listStart = record;
+                    for (int k = 0; k < listIndex; k++) listStart += plySize(element.properties[k].type);
+                    size_t corners = size_t(readPLYValue(listStart, list.countType, bigEndian));
+                    const char* item = listStart + countSize;
+                    for (size_t c = 2; c < corners; c++) {
+                        out[0] = uint32_t(readPLYValue(item, list.type, bigEndian));
+                        out[1] = uint32_t(readPLYValue(item + (c - 1) * indexSize, list.type, bigEndian));
+                        out[2] = uint32_t(readPLYValue(item + c * indexSize, list.type, bigEndian));
+                        out += 3;
+                    }
+                    record = skipRecord(record, end, element, bigEndian);
+                }
+            }
+        });
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef NUMATOPOLOGY_HPP
+#define NUMATOPOLOGY_HPP
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Узел NUMA: ядра с общим контроллером памяти
+struct NumaNode {
+    int id = 0;
+    std::vector<int> cpus;
+};
+
+// Разбиение машины на узлы NUMA. На Linux читается из
+// /sys/devices/system/node (без libnuma) и ограничивается ядрами, на которых
+// процессу разрешено работать. Если sysfs нет или узел один, получается
+// один узел со всеми ядрами — и весь NUMA-режим сводится к обычному.
+class NumaTopology {
+public:
+    // Больше узлов не различается: лишние сливаются с последним
+    static constexpr int MaxNodes = 8;
+
+    std::vector<NumaNode> nodes;
+
+    int nodeCount() const { return int(nodes.size()); }
+
+    int cpuCount() const {
+        int count = 0;
+        for (const NumaNode& node : nodes) count += int(node.cpus.size());
+        return count;
+    }
+
+    // Индекс узла (в nodes) по номеру ядра; -1, если ядро неизвестно
+    int nodeOfCpu(int cpu) const {
+        for (int i = 0; i < nodeCount(); i++) {
+            if (std::find(nodes[i].cpus.begin(), nodes[i].cpus.end(), cpu) != nodes[i].cpus.end()) return i;
+        }
+        return -1;
+    }
+
+    // Узел ядра, на котором сейчас выполняется поток; 0, если не определить
+    int currentNode() const {
+#ifdef __linux__
+        int node = nodeOfCpu(sched_getcpu());
+        if (node >= 0) return node;
+#endif
+        return 0;
+    }
+
+    // Делит count элементов на полосы по узлам пропорционально числу их
+    // ядер: узел i получает [begin[i], begin[i + 1]), begin — nodeCount() + 1 чисел
+    void split(int count, int* begin) const {
+        int total = std::max(1, cpuCount());
+        int cpus = 0;
+        begin[0] = 0;
+        for (int i = 0; i < nodeCount(); i++) {
+            cpus += int(nodes[i].cpus.size());
+            begin[i + 1] = int((long long)count * cpus / total);
+        }
+        begin[nodeCount()] = count;
+    }
+
+    // Закрепляет поток за ядром cpu
+    static bool pin(std::thread::native_handle_type thread, int cpu) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+#else
+        (void)thread;
+        (void)cpu;
+        return false;
+#endif
+    }
+
+    // Строка вида "0-3,8-11" из sysfs
+    static bool parseCpuList(const std::string& text, std::vector<int>& cpus) {
+        size_t position = 0;
+        while (position < text.size()) {
+            size_t end = text.find(',', position);
+            if (end == std::string::npos) end = text.size();
+            std::string range = text.substr(position, end - position);
+            position = end + 1;
+            while (!range.empty() && (range.back() == '\n' || range.back() == ' ')) range.pop_back();
+            if (range.empty()) continue;
+            size_t dash = range.find('-');
+            try {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                if (last < first) return false;
+                for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+            } catch (...) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static NumaTopology detect() {
+        NumaTopology topology;
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+        // Номера узлов могут идти с пропусками
+        for (int id = 0; id < 1024; id++) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            if (!file) continue;
+            std::string text;
+            std::getline(file, text);
+            NumaNode node;
+            node.id = id;
+            std::vector<int> cpus;
+            if (!parseCpuList(text, cpus)) continue;
+            for (int cpu : cpus) {
+                if (!haveMask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) node.cpus.push_back(cpu);
+            }
+            if (node.cpus.empty()) continue;
+            if (topology.nodeCount() == MaxNodes) {
+                std::vector<int>& last = topology.nodes.back().cpus;
+                last.insert(last.end(), node.cpus.begin(), node.cpus.end());
+            } else {
+                topology.nodes.push_back(std::move(node));
+            }
+        }
+        if (topology.nodeCount() > 0) return topology;
+
+        if (haveMask) {
+            NumaNode node;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) node.cpus.push_back(cpu);
+            }
+            if (!node.cpus.empty()) {
+                topology.nodes.push_back(std::move(node));
+                return topology;
+            }
+        }
+#endif
+        NumaNode node;
+        unsigned count = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned cpu = 0; cpu < count; cpu++) node.cpus.push_back(int(cpu));
+        topology.nodes.push_back(std::move(node));
+        return topology;
+    }
+
+    // Топология машины, определяется один раз
+    static const NumaTopology& system() {
+        static const NumaTopology topology = detect();
+        return topology;
+    }
+};
+
+#endif
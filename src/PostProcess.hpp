@@ -0,0 +1,182 @@
+#ifndef POSTPROCESS_HPP
+#define POSTPROCESS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "FrameBuffer.hpp"
+#include "ThreadPool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define POSTPROCESS_SSE2 1
+#endif
+
+enum class TransferFunction {
+    Gamma,  // pow(x, 1 / gamma), как в шейдерах
+    SRGB
+};
+
+enum class ChannelOrder {
+    RGB,
+    BGR,
+    RGBA,
+    BGRA
+};
+
+// Раскладка выходного 8-битного изображения
+struct OutputLayout {
+    ChannelOrder order = ChannelOrder::RGB;
+    bool bottomUp = false;  // строки снизу вверх, как в BMP
+    int rowAlignment = 1;   // выравнивание строки в байтах (BMP — 4)
+
+    int channels() const {
+        return (order == ChannelOrder::RGBA || order == ChannelOrder::BGRA) ? 4 : 3;
+    }
+
+    size_t rowStride(int width) const {
+        size_t bytes = size_t(width) * channels();
+        return (bytes + rowAlignment - 1) / rowAlignment * rowAlignment;
+    }
+
+    static OutputLayout rgb() { return OutputLayout(); }
+
+    static OutputLayout bmp() {
+        OutputLayout layout;
+        layout.order = ChannelOrder::BGR;
+        layout.bottomUp = true;
+        layout.rowAlignment = 4;
+        return layout;
+    }
+};
+
+// Один потоковый проход от линейного float-буфера к 8-битному изображению:
+// экспозиция, кодирование гаммы через таблицу, клампинг, квантование,
+// порядок каналов и направление строк. Строки обрабатываются параллельно.
+//
+// Таблица индексируется старшими битами float (8 бит порядка + 10 бит мантиссы),
+// поэтому относительная точность одинакова во всём диапазоне [2^-24, 1].
+class PostProcess {
+public:
+    float exposure = 1.0f;
+
+    explicit PostProcess(TransferFunction transfer = TransferFunction::Gamma, float gamma = 2.2f) {
+        setTransfer(transfer, gamma);
+    }
+
+    void setTransfer(TransferFunction transfer, float gamma = 2.2f) {
+        lut.resize(LutSize);
+        for (uint32_t i = 0; i < LutSize; i++) {
+            uint32_t bits = (i + LutBase) << MantissaShift;
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            float encoded = transfer == TransferFunction::SRGB
+                    ? (value <= 0.0031308f ? value * 12.92f
+                                           : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f)
+                    : std::pow(value, 1.0f / gamma);
+            lut[i] = static_cast<unsigned char>(std::min(1.0f, encoded) * 255);
+        }
+    }
+
+    // out должен вмещать layout.rowStride(frame.width) * frame.height байт
+    void process(const FrameBuffer& frame, const OutputLayout& layout, unsigned char* out) const {
+        ThreadPool::shared().parallelFor(0, frame.height, 16, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                int dstRow = layout.bottomUp ? frame.height - 1 - y : y;
+                processRow(frame, layout, y, out + size_t(dstRow) * layout.rowStride(frame.width));
+            }
+        });
+    }
+
+    void process(const FrameBuffer& frame, const OutputLayout& layout,
+                 std::vector<unsigned char>& out) const {
+        out.resize(layout.rowStride(frame.width) * frame.height);
+        process(frame, layout, out.data());
+    }
+
+    unsigned char encode(float value) const {
+        return lut[lutIndex(value * exposure)];
+    }
+
+private:
+    static constexpr uint32_t MantissaShift = 13;
+    // 2^-24 и 1.0 в битах float, сдвинутых на MantissaShift
+    static constexpr uint32_t LutBase = 0x33800000u >> MantissaShift;
+    static constexpr uint32_t LutMax = 0x3f800000u >> MantissaShift;
+    static constexpr uint32_t LutSize = LutMax - LutBase + 1;
+
+    std::vector<unsigned char> lut;
+
+    static uint32_t lutIndex(float value) {
+        // Сравнения записаны так, чтобы NaN попадал в 0
+        if (!(value > smallestEncodable())) return 0;
+        if (value > 1.0f) value = 1.0f;
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return (bits >> MantissaShift) - LutBase;
+    }
+
+    static float smallestEncodable() {
+        uint32_t bits = LutBase << MantissaShift;
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    void processRow(const FrameBuffer& frame, const OutputLayout& layout,
+                    int y, unsigned char* dst) const {
+        const int width = frame.width;
+        const size_t planeSize = frame.pixelCount();
+        const float* src[3] = {
+                frame.color.data() + size_t(y) * width,
+                frame.color.data() + size_t(y) * width + planeSize,
+                frame.color.data() + size_t(y) * width + 2 * planeSize
+        };
+
+        const int channels = layout.channels();
+        const bool swap = layout.order == ChannelOrder::BGR || layout.order == ChannelOrder::BGRA;
+        const int r = swap ? 2 : 0;
+        const int b = swap ? 0 : 2;
+        const unsigned char* table = lut.data();
+
+        int x = 0;
+#ifdef POSTPROCESS_SSE2
+        const __m128 scale = _mm_set1_ps(exposure);
+        const __m128 minValue = _mm_set1_ps(smallestEncodable());
+        const __m128 maxValue = _mm_set1_ps(1.0f);
+        const __m128i base = _mm_set1_epi32(int(LutBase));
+        alignas(16) uint32_t index[3][4];
+        for (; x + 4 <= width; x += 4) {
+            for (int c = 0; c < 3; c++) {
+                // max(v, min) первым аргументом отдаёт min для NaN
+                __m128 v = _mm_mul_ps(_mm_loadu_ps(src[c] + x), scale);
+                v = _mm_min_ps(_mm_max_ps(v, minValue), maxValue);
+                __m128i bits = _mm_srli_epi32(_mm_castps_si128(v), MantissaShift);
+                _mm_store_si128(reinterpret_cast<__m128i*>(index[c]), _mm_sub_epi32(bits, base));
+            }
+            for (int i = 0; i < 4; i++) {
+                unsigned char* pixel = dst + (x + i) * channels;
+                pixel[r] = table[index[0][i]];
+                pixel[1] = table[index[1][i]];
+                pixel[b] = table[index[2][i]];
+                if (channels == 4) pixel[3] = 255;
+            }
+        }
+#endif
+        for (; x < width; x++) {
+            unsigned char* pixel = dst + x * channels;
+            pixel[r] = table[lutIndex(src[0][x] * exposure)];
+            pixel[1] = table[lutIndex(src[1][x] * exposure)];
+            pixel[b] = table[lutIndex(src[2][x] * exposure)];
+            if (channels == 4) pixel[3] = 255;
+        }
+
+        size_t used = size_t(width) * channels;
+        size_t stride = layout.rowStride(width);
+        if (stride > used) std::memset(dst + used, 0, stride - used);
+    }
+};
+
+#endif
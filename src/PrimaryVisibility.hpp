@@ -0,0 +1,202 @@
+#ifndef PRIMARYVISIBILITY_HPP
+#define PRIMARYVISIBILITY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Scene.hpp"
+#include "Camera.hpp"
+#include "ThreadPool.hpp"
+
+// Диапазон тайлов кадра включительно; пустой, если x0 > x1
+struct TileRect {
+    int x0 = 1, y0 = 0, x1 = 0, y1 = -1;
+
+    bool empty() const { return x0 > x1 || y0 > y1; }
+    bool contains(int tx, int ty) const { return tx >= x0 && tx <= x1 && ty >= y0 && ty <= y1; }
+};
+
+// Проекция объёмов через камеру на сетку тайлов кадра width x height
+class TileProjection {
+public:
+    int tilesX = 0;
+    int tilesY = 0;
+
+    TileProjection() = default;
+
+    TileProjection(const Camera& camera, int width, int height, int tileSize)
+            : tilesX((width + tileSize - 1) / tileSize), tilesY((height + tileSize - 1) / tileSize),
+              width(width), height(height), tileSize(tileSize), camera(camera) {
+        // Базис камеры: corner — от позиции до нижнего левого угла,
+        // normal — нормаль плоскости изображения, смотрящая в сцену
+        corner = camera.lowerLeftCorner - camera.position;
+        normal = camera.horizontal.cross(camera.vertical).normalize();
+        Vector3 center = corner + camera.horizontal * 0.5f + camera.vertical * 0.5f;
+        if (normal.dot(center) < 0.0f) normal = normal * -1.0f;
+        planeDepth = normal.dot(center);
+
+        // Для разложения точки плоскости по horizontal/vertical (2x2 система)
+        hh = camera.horizontal.dot(camera.horizontal);
+        hv = camera.horizontal.dot(camera.vertical);
+        vv = camera.vertical.dot(camera.vertical);
+        det = hh * vv - hv * hv;
+    }
+
+    TileRect all() const {
+        TileRect rect;
+        rect.x0 = 0;
+        rect.y0 = 0;
+        rect.x1 = tilesX - 1;
+        rect.y1 = tilesY - 1;
+        return rect;
+    }
+
+    // Глубина ближайшей точки шара вдоль оси взгляда
+    float nearDepth(const Vector3& center, float radius) const {
+        return (center - camera.position).dot(normal) - radius;
+    }
+
+    // Тайлы, которые задевает проекция шара
+    TileRect sphereTiles(const Vector3& center, float radius) const {
+        float depth = (center - camera.position).dot(normal);
+        // Целиком позади камеры — в кадр не попадает
+        if (depth + radius <= 0.0f) return TileRect();
+        Vector3 r(radius, radius, radius);
+        return boxTiles(AABB(center - r, center + r));
+    }
+
+    // Тайлы, которые задевает проекция бокса. Бокс, пересекающий плоскость
+    // камеры, проецируется неограниченно и задевает весь кадр.
+    TileRect boxTiles(const AABB& box) const {
+        if (box.isEmpty()) return TileRect();
+        float uMin = FLT_MAX, uMax = -FLT_MAX, vMin = FLT_MAX, vMax = -FLT_MAX;
+        int behind = 0;
+        Vector3 d[8];
+        for (int k = 0; k < 8; k++) {
+            d[k] = Vector3((k & 1) ? box.max.x : box.min.x,
+                           (k & 2) ? box.max.y : box.min.y,
+                           (k & 4) ? box.max.z : box.min.z) - camera.position;
+            if (d[k].dot(normal) <= 1e-4f) behind++;
+        }
+        if (behind == 8) return TileRect();
+        if (behind > 0 || det == 0.0f) return all();
+
+        // Проекция выпукла, поэтому оболочка проекций углов содержит проекцию тела
+        for (int k = 0; k < 8; k++) {
+            Vector3 onPlane = d[k] * (planeDepth / d[k].dot(normal)) - corner;
+            float ph = onPlane.dot(camera.horizontal);
+            float pv = onPlane.dot(camera.vertical);
+            float u = (ph * vv - pv * hv) / det;
+            float v = (pv * hh - ph * hv) / det;
+            uMin = std::min(uMin, u);
+            uMax = std::max(uMax, u);
+            vMin = std::min(vMin, v);
+            vMax = std::max(vMax, v);
+        }
+
+        // Пиксель x покрывает u в [x, x + 1) / width, строка y — v в
+        // [height - 1 - y, height - y) / height; запас в пиксель на округление
+        int px0 = int(std::floor(uMin * width)) - 1;
+        int px1 = int(std::floor(uMax * width)) + 1;
+        int py0 = height - 1 - int(std::floor(vMax * height)) - 1;
+        int py1 = height - 1 - int(std::floor(vMin * height)) + 1;
+        if (px1 < 0 || py1 < 0 || px0 >= width || py0 >= height) return TileRect();
+        TileRect rect;
+        rect.x0 = std::max(0, px0) / tileSize;
+        rect.x1 = std::min(width - 1, px1) / tileSize;
+        rect.y0 = std::max(0, py0) / tileSize;
+        rect.y1 = std::min(height - 1, py1) / tileSize;
+        return rect;
+    }
+
+private:
+    int width = 0, height = 0, tileSize = 1;
+    Camera camera;
+    Vector3 corner, normal;
+    float planeDepth = 0.0f;
+    float hh = 0.0f, hv = 0.0f, vv = 0.0f, det = 0.0f;
+};
+
+// Предварительный проход для первичных лучей: каждая сфера проецируется
+// через камеру в прямоугольник на экране и попадает в списки тех тайлов,
+// которые он задевает. Первичный луч проверяет только список своего тайла.
+// Вторичные и теневые лучи по-прежнему идут через всю сцену.
+class PrimaryVisibility {
+public:
+    // Тайлы с более длинным списком трассируются через BVH сцены, если он есть
+    int maxCandidates = 64;
+
+    // Массивы переиспользуются между вызовами: при неизменном числе сфер и
+    // тайлов повторная сборка не выделяет память
+    void build(const Scene& scene, const Camera& camera, int width, int height, int tileSize) {
+        this->tileSize = tileSize;
+        TileProjection projection(camera, width, height, tileSize);
+        tilesX = projection.tilesX;
+        tilesY = projection.tilesY;
+        int tileCount = tilesX * tilesY;
+        int sphereCount = int(scene.spheres.size());
+
+        rects.resize(sphereCount);
+        ThreadPool::shared().parallelFor(0, sphereCount, 1024, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const Sphere& sphere = scene.spheres[i];
+                ScreenRect& rect = rects[i];
+                rect.tiles = projection.sphereTiles(sphere.center, sphere.radius);
+                rect.nearDepth = projection.nearDepth(sphere.center, sphere.radius);
+            }
+        });
+
+        // Сферы в порядке nearDepth, тогда и каждый список тайла отсортирован
+        order.resize(sphereCount);
+        for (int i = 0; i < sphereCount; i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return rects[a].nearDepth < rects[b].nearDepth; });
+
+        tileStart.assign(tileCount + 1, 0);
+        for (int i : order) {
+            const TileRect& rect = rects[i].tiles;
+            for (int ty = rect.y0; ty <= rect.y1 && rect.x0 <= rect.x1; ty++) {
+                for (int tx = rect.x0; tx <= rect.x1; tx++) tileStart[ty * tilesX + tx + 1]++;
+            }
+        }
+        for (int t = 0; t < tileCount; t++) tileStart[t + 1] += tileStart[t];
+
+        candidates.resize(tileStart[tileCount]);
+        cursor.assign(tileStart.begin(), tileStart.end() - 1);
+        for (int i : order) {
+            const TileRect& rect = rects[i].tiles;
+            for (int ty = rect.y0; ty <= rect.y1 && rect.x0 <= rect.x1; ty++) {
+                for (int tx = rect.x0; tx <= rect.x1; tx++) {
+                    candidates[cursor[ty * tilesX + tx]++] = {i, rects[i].nearDepth};
+                }
+            }
+        }
+    }
+
+    // Тайл по координатам пикселя
+    int tileOf(int x, int y) const { return (y / tileSize) * tilesX + x / tileSize; }
+
+    const SphereCandidate* candidatesOf(int tile) const { return candidates.data() + tileStart[tile]; }
+    int candidateCount(int tile) const { return tileStart[tile + 1] - tileStart[tile]; }
+
+    double averageCandidates() const {
+        int tileCount = tilesX * tilesY;
+        return tileCount > 0 ? double(candidates.size()) / double(tileCount) : 0.0;
+    }
+
+private:
+    struct ScreenRect {
+        TileRect tiles;
+        float nearDepth = 0.0f;
+    };
+
+    int tileSize = 16;
+    int tilesX = 0;
+    int tilesY = 0;
+    std::vector<ScreenRect> rects;
+    std::vector<int> order;
+    std::vector<int> tileStart;
+    std::vector<int> cursor;
+    std::vector<SphereCandidate> candidates;
+};
+
+#endif
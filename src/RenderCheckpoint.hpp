@@ -0,0 +1,393 @@
+#ifndef RENDERCHECKPOINT_HPP
+#define RENDERCHECKPOINT_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FrameBuffer.hpp"
+#include "Sampler.hpp"
+#include "Scene.hpp"
+#include "Camera.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Контрольная точка долгого офлайн-рендера в файле, отображённом в память:
+// заголовок с параметрами задания, карта готовых тайлов (байт на тайл) и
+// плоскости кадра в раскладке FrameBuffer.
+//
+// Потоки рендера копируют готовый тайл в отображение (tileDone) и ничего не
+// ждут. flush — из отдельного потока (startPeriodic) — сначала сбрасывает на
+// диск пиксели, и только потом отмечает в карте тайлы, чьи пиксели уже там.
+// Поэтому после сбоя в любой момент отмеченный тайл лежит на диске целиком,
+// а потеряно не больше interval работы.
+//
+// Сэмплер без состояния: точка зависит только от (тип, seed, пиксель, номер
+// сэмпла), поэтому для продолжения хватает этих параметров в заголовке, и
+// дорендеренные тайлы совпадают бит в бит с рендером без перерыва.
+class RenderCheckpoint {
+public:
+    // Всё, от чего зависят пиксели; при продолжении должно совпасть
+    struct Job {
+        int width = 0, height = 0;
+        int tileSize = 16;
+        int samplesPerPixel = 1;
+        SamplerType samplerType = SamplerType::Sobol;
+        uint32_t samplerSeed = 0;
+        bool withAux = false;
+        bool shadows = true;
+        bool cacheShading = false;
+        uint64_t sceneHash = 0;  // sceneFingerprint
+    };
+
+    RenderCheckpoint() = default;
+    ~RenderCheckpoint() { close(); }
+
+    RenderCheckpoint(const RenderCheckpoint&) = delete;
+    RenderCheckpoint& operator=(const RenderCheckpoint&) = delete;
+
+    // resume = false — файл создаётся заново. Иначе открывается
+    // существующий, и он должен принадлежать тому же заданию.
+    bool open(const std::string& path, const Job& job, bool resume) {
+        close();
+        Header expected = headerOf(job);
+        tilesX = (job.width + job.tileSize - 1) / job.tileSize;
+        tilesY = (job.height + job.tileSize - 1) / job.tileSize;
+        tileSize = job.tileSize;
+        bitmapOffset = Alignment;
+        planesOffset = alignUp(bitmapOffset + size_t(tileCount()));
+        planeFloats = size_t(job.width) * job.height * (job.withAux ? 10 : 3);
+        length = planesOffset + planeFloats * sizeof(float);
+
+        if (!map(path, resume)) return false;
+        if (resume) {
+            if (std::memcmp(bytes, &expected, sizeof(Header)) != 0) {
+                std::cerr << "Checkpoint " << path << " belongs to a different render job" << std::endl;
+                close();
+                return false;
+            }
+        } else {
+            std::memcpy(bytes, &expected, sizeof(Header));
+            if (!sync(0, Alignment)) {
+                close();
+                return false;
+            }
+        }
+        pending = std::make_unique<std::atomic<unsigned char>[]>(tileCount());
+        for (int i = 0; i < tileCount(); i++) pending[i].store(0, std::memory_order_relaxed);
+        ready.reserve(tileCount());
+        return true;
+    }
+
+    void close() {
+        stopPeriodic();
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes) munmap(bytes, length);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        bytes = nullptr;
+        pending.reset();
+    }
+
+    bool isOpen() const { return bytes != nullptr; }
+    int tileCount() const { return tilesX * tilesY; }
+
+    // Тайл уже надёжно записан в файл
+    bool isDone(int tile) const { return bytes[bitmapOffset + size_t(tile)] != 0; }
+
+    int doneCount() const {
+        int count = 0;
+        for (int tile = 0; tile < tileCount(); tile++) count += isDone(tile);
+        return count;
+    }
+
+    // Переносит записанные тайлы из файла в frame (размер как у задания)
+    void restore(FrameBuffer& frame) const {
+        forEachPlaneRow(frame, [&](float* plane, const float* stored, int tile, size_t offset, int count) {
+            if (isDone(tile)) std::memcpy(plane + offset, stored + offset, count * sizeof(float));
+        });
+    }
+
+    // Из потока рендера, когда тайл tile в frame закончен
+    void tileDone(const FrameBuffer& frame, int tile) {
+        int x0 = (tile % tilesX) * tileSize, y0 = (tile / tilesX) * tileSize;
+        int x1 = std::min(x0 + tileSize, frame.width), y1 = std::min(y0 + tileSize, frame.height);
+        float* stored = planes();
+        size_t planeSize = frame.pixelCount();
+        const FrameBuffer::Plane* sources[4] = {&frame.color, &frame.normal, &frame.albedo, &frame.depth};
+        for (int p = 0, base = 0; p < (frame.hasAux ? 4 : 1); p++) {
+            int channels = p == 3 ? 1 : 3;
+            for (int c = 0; c < channels; c++, base++) {
+                for (int y = y0; y < y1; y++) {
+                    size_t row = size_t(y) * frame.width;
+                    std::memcpy(stored + base * planeSize + row + x0, sources[p]->data() + c * planeSize + row + x0,
+                                size_t(x1 - x0) * sizeof(float));
+                }
+            }
+        }
+        pending[tile].store(1, std::memory_order_release);
+    }
+
+    // Сбрасывает на диск тайлы, законченные с прошлого вызова
+    bool flush() {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        if (!bytes) return false;
+        ready.clear();
+        for (int tile = 0; tile < tileCount(); tile++) {
+            if (pending[tile].exchange(0, std::memory_order_acquire)) ready.push_back(tile);
+        }
+        if (ready.empty()) return true;
+        // Ядро пишет только изменённые страницы, так что весь диапазон дёшев
+        if (!sync(planesOffset, length - planesOffset)) return false;
+        for (int tile : ready) bytes[bitmapOffset + size_t(tile)] = 1;
+        return sync(bitmapOffset, planesOffset - bitmapOffset);
+    }
+
+    // Поток, вызывающий flush раз в interval, пока не вызван stopPeriodic
+    void startPeriodic(std::chrono::milliseconds interval) {
+        stopPeriodic();
+        stopping = false;
+        flusher = std::thread([this, interval] {
+            std::unique_lock<std::mutex> lock(periodicMutex);
+            while (!periodicCondition.wait_for(lock, interval, [this] { return stopping; })) {
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+        });
+    }
+
+    // Останавливает поток и делает последний flush
+    void stopPeriodic() {
+        if (!flusher.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(periodicMutex);
+            stopping = true;
+        }
+        periodicCondition.notify_all();
+        flusher.join();
+        flush();
+    }
+
+    // Отпечаток сцены и камеры по содержимому геометрии: при продолжении
+    // с другой сценой файл не подойдёт
+    static uint64_t sceneFingerprint(const Scene& scene, const Camera& camera) {
+        uint64_t hash = 1469598103934665603ull;
+        auto mix = [&](const void* data, size_t size) {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; i++) hash = (hash ^ p[i]) * 1099511628211ull;
+        };
+        auto mixVector = [&](const Vector3& v) {
+            float values[3] = {v.x, v.y, v.z};
+            mix(values, sizeof(values));
+        };
+        auto mixMaterial = [&](const Material& material) {
+            mixVector(material.color);
+            float values[4] = {material.ambient, material.diffuse, material.specular, material.shininess};
+            mix(values, sizeof(values));
+        };
+
+        auto mixSphere = [&](const Sphere& sphere) {
+            mixVector(sphere.center);
+            mix(&sphere.radius, sizeof(sphere.radius));
+            mixMaterial(sphere.material);
+        };
+        auto mixMesh = [&](const Mesh& mesh) {
+            uint64_t sizes[2] = {mesh.vertexCount(), mesh.indices.size()};
+            mix(sizes, sizeof(sizes));
+            mix(mesh.x.data(), mesh.x.size() * sizeof(float));
+            mix(mesh.y.data(), mesh.y.size() * sizeof(float));
+            mix(mesh.z.data(), mesh.z.size() * sizeof(float));
+            mix(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+            mixMaterial(mesh.material);
+        };
+
+        mixVector(camera.position);
+        mixVector(camera.lowerLeftCorner);
+        mixVector(camera.horizontal);
+        mixVector(camera.vertical);
+        mixVector(scene.backgroundColor);
+        for (const Sphere& sphere : scene.spheres) mixSphere(sphere);
+        for (const Light& light : scene.lights) {
+            mixVector(light.position);
+            mixVector(light.color);
+            mix(&light.intensity, sizeof(light.intensity));
+        }
+        for (const Mesh& mesh : scene.meshes) mixMesh(mesh);
+        for (const GeometryGroup& group : scene.groups) {
+            uint64_t sizes[2] = {group.spheres.size(), group.meshes.size()};
+            mix(sizes, sizeof(sizes));
+            for (const Sphere& sphere : group.spheres) mixSphere(sphere);
+            for (const Mesh& mesh : group.meshes) mixMesh(mesh);
+        }
+        for (const Instance& instance : scene.instances) {
+            mix(instance.objectToWorld.m, sizeof(instance.objectToWorld.m));
+            mix(&instance.group, sizeof(instance.group));
+            mix(&instance.overrideMaterial, sizeof(instance.overrideMaterial));
+            mixMaterial(instance.material);
+        }
+        // Облако читается целиком один раз при старте задания: по таблице
+        // кластеров не видно сдвига сферы внутри кластера
+        for (const auto& cloud : scene.clouds) cloud->forEachFileChunk(mix);
+        return hash;
+    }
+
+private:
+    // Выравнивание областей файла: msync принимает только адреса на границе
+    // страницы, 64 КБ подходит для любого размера страницы
+    static constexpr size_t Alignment = size_t(64) << 10;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        int32_t width, height, tileSize, samplesPerPixel;
+        uint32_t samplerType, samplerSeed, flags;
+        uint64_t sceneHash;
+    };
+
+    int tilesX = 0, tilesY = 0, tileSize = 16;
+    size_t bitmapOffset = 0, planesOffset = 0, planeFloats = 0, length = 0;
+    unsigned char* bytes = nullptr;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    // Тайлы, скопированные в отображение, но ещё не отмеченные в карте
+    std::unique_ptr<std::atomic<unsigned char>[]> pending;
+    std::vector<int> ready;
+    std::mutex flushMutex;
+
+    std::thread flusher;
+    std::mutex periodicMutex;
+    std::condition_variable periodicCondition;
+    bool stopping = false;
+
+    static size_t alignUp(size_t offset) { return (offset + Alignment - 1) / Alignment * Alignment; }
+
+    static Header headerOf(const Job& job) {
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "RTCKPT\0", 8);
+        header.version = 1;
+        header.width = job.width;
+        header.height = job.height;
+        header.tileSize = job.tileSize;
+        header.samplesPerPixel = job.samplesPerPixel;
+        header.samplerType = uint32_t(job.samplerType);
+        header.samplerSeed = job.samplerSeed;
+        header.flags = (job.withAux ? 1u : 0u) | (job.shadows ? 2u : 0u) | (job.cacheShading ? 4u : 0u);
+        header.sceneHash = job.sceneHash;
+        return header;
+    }
+
+    float* planes() const { return reinterpret_cast<float*>(bytes + planesOffset); }
+
+    // fn(plane, stored, tile, offset, count) для отрезков строк по тайлам во всех плоскостях
+    template <typename Fn>
+    void forEachPlaneRow(FrameBuffer& frame, const Fn& fn) const {
+        size_t planeSize = frame.pixelCount();
+        FrameBuffer::Plane* targets[4] = {&frame.color, &frame.normal, &frame.albedo, &frame.depth};
+        for (int p = 0, base = 0; p < (frame.hasAux ? 4 : 1); p++) {
+            int channels = p == 3 ? 1 : 3;
+            for (int c = 0; c < channels; c++, base++) {
+                float* plane = targets[p]->data() + c * planeSize;
+                const float* stored = planes() + base * planeSize;
+                for (int y = 0; y < frame.height; y++) {
+                    for (int tx = 0; tx < tilesX; tx++) {
+                        int x0 = tx * tileSize;
+                        int count = std::min(tileSize, frame.width - x0);
+                        fn(plane, stored, (y / tileSize) * tilesX + tx, size_t(y) * frame.width + x0, count);
+                    }
+                }
+            }
+        }
+    }
+
+    bool map(const std::string& path, bool resume) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                           resume ? OPEN_EXISTING : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            std::cerr << "Failed to open checkpoint: " << path << std::endl;
+            return false;
+        }
+        LARGE_INTEGER size;
+        GetFileSizeEx(file, &size);
+        if (resume && size_t(size.QuadPart) != length) {
+            std::cerr << "Checkpoint " << path << " belongs to a different render job" << std::endl;
+            close();
+            return false;
+        }
+        size.QuadPart = LONGLONG(length);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, size.HighPart, size.LowPart, nullptr);
+        if (mapping) bytes = static_cast<unsigned char*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+#else
+        fd = ::open(path.c_str(), resume ? O_RDWR : O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::cerr << "Failed to open checkpoint: " << path << std::endl;
+            return false;
+        }
+        struct stat info;
+        if (resume && (fstat(fd, &info) != 0 || size_t(info.st_size) != length)) {
+            std::cerr << "Checkpoint " << path << " belongs to a different render job" << std::endl;
+            close();
+            return false;
+        }
+        // Место под файл занимается до отображения: запись в дыру разреженного
+        // файла при полном диске убила бы процесс SIGBUS вместо ошибки.
+        // Новый файл заполняется нулями, а нули карты читаются как «не готово»
+        int error = posix_fallocate(fd, 0, off_t(length));
+        if (error != 0) {
+            std::cerr << "Failed to allocate checkpoint " << path << ": " << std::strerror(error) << std::endl;
+            close();
+            return false;
+        }
+        void* address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address != MAP_FAILED) bytes = static_cast<unsigned char*>(address);
+#endif
+        if (!bytes) {
+            std::cerr << "Failed to map checkpoint: " << path << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool sync(size_t offset, size_t size) {
+#ifdef _WIN32
+        bool ok = FlushViewOfFile(bytes + offset, size) && FlushFileBuffers(file);
+#else
+        bool ok = msync(bytes + offset, size, MS_SYNC) == 0;
+#endif
+        if (!ok) std::cerr << "Failed to write checkpoint" << std::endl;
+        return ok;
+    }
+};
+
+#endif
@@ -0,0 +1,505 @@
+#ifndef RENDERDAEMON_HPP
+#define RENDERDAEMON_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Scene.hpp"
+#include "SceneFile.hpp"
+#include "Camera.hpp"
+#include "CpuRenderer.hpp"
+#include "FrameBuffer.hpp"
+#include "PostProcess.hpp"
+#include "ImageEncoder.hpp"
+#include "ImageUtils.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Разобранные сцены с построенными BVH, общие для всех заданий. Ключ —
+// путь файла с временем изменения или хеш встроенного текста, поэтому
+// правка файла просто даёт новый ключ, а старая запись уходит по LRU.
+class SceneCache {
+public:
+    explicit SceneCache(size_t budgetBytes) : budget(budgetBytes) {}
+
+    using Loader = std::function<bool(Scene&)>;
+
+    // Сцена по ключу; при промахе загружается вне блокировки, так что
+    // долгий разбор одной сцены не останавливает задания с другими
+    std::shared_ptr<const Scene> get(const std::string& key, const Loader& load) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = index.find(key);
+            if (found != index.end()) {
+                entries.splice(entries.begin(), entries, found->second);
+                hits++;
+                return found->second->scene;
+            }
+            misses++;
+        }
+
+        auto scene = std::make_shared<Scene>();
+        if (!load(*scene)) return nullptr;
+        scene->updateAccelerationStructure();
+        size_t bytes = sizeOf(*scene);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(key);
+        if (found != index.end()) return found->second->scene;  // загрузили параллельно
+        entries.push_front({key, scene, bytes});
+        index[key] = entries.begin();
+        used += bytes;
+        // Последняя запись остаётся, даже если одна не влезает в бюджет
+        while (used > budget && entries.size() > 1) {
+            used -= entries.back().bytes;
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+        return scene;
+    }
+
+    std::string stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ostringstream out;
+        out << entries.size() << " scenes, " << used << "/" << budget << " bytes, "
+            << hits << " hits, " << misses << " misses";
+        return out.str();
+    }
+
+    // Оценка памяти сцены: сферы, свет и узлы BVH
+    static size_t sizeOf(const Scene& scene) {
+        return sizeof(Scene) + scene.spheres.capacity() * (sizeof(Sphere) + sizeof(AABB)) +
+               scene.lights.capacity() * sizeof(Light) +
+               scene.accelerationStructure().nodes.capacity() * sizeof(BVHNode);
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const Scene> scene;
+        size_t bytes;
+    };
+
+    mutable std::mutex mutex;
+    std::list<Entry> entries;  // от недавних к давним
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t budget;
+    size_t used = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+// Сервер рендера на Unix-сокете: процесс, сцены и пул потоков живут между
+// заданиями, OpenGL не нужен. Каждое соединение обслуживается своим потоком,
+// а сами тайлы всех заданий считаются в общем ThreadPool::shared().
+//
+// Протокол текстовый, по команде в строке; настройки сохраняются в
+// пределах соединения до следующей команды render:
+//
+//   scene <путь>              файл сцены (формат SceneFile)
+//   inline <байт>             далее ровно столько байт текста сцены; больше
+//                             maxInlineBytes — ошибка и разрыв соединения
+//
+// Строка команды длиннее MaxLineBytes — тоже ошибка и разрыв соединения.
+//   camera x y z tx ty tz [vfov]
+//   size <ширина> <высота>
+//   spp <сэмплов>
+//   format png|qoi|bmp|ppm|raw  raw — RGB по 8 бит, строки сверху вниз
+//   output <путь>             писать файл вместо передачи пикселей; "-" — передавать
+//   render                    -> "ok <байт> <ширина> <высота> <формат>\n" и данные
+//                                либо "ok written <путь>\n"
+//   stats                     -> "ok <состояние кэша>\n"
+//   shutdown                  остановить сервер после текущих заданий
+//
+// Ошибка любой команды — ответ "error <текст>\n", соединение остаётся открытым.
+//
+// Пути scene и output разрешаются относительно rootDirectory, и выйти за
+// него нельзя ни через "..", ни через символические ссылки: иначе любой,
+// кто достучался до сокета, читал бы и перезаписывал файлы с правами демона.
+class RenderDaemon {
+public:
+    // Наибольший текст сцены в команде inline
+    size_t maxInlineBytes = size_t(64) << 20;
+    // Наибольшая строка команды: без перевода строки буфер иначе рос бы без конца
+    static constexpr size_t MaxLineBytes = size_t(64) << 10;
+    // Права на файл сокета; по умолчанию подключаться может только владелец
+    unsigned socketMode = 0600;
+    // Каталог сцен и результатов; пустой — текущий каталог при запуске run
+    std::string rootDirectory;
+
+    explicit RenderDaemon(size_t cacheBytes = size_t(256) << 20) : scenes(cacheBytes) {}
+
+    // Блокирует до команды shutdown
+    bool run(const std::string& socketPath) {
+#ifdef _WIN32
+        std::cerr << "Daemon mode needs Unix domain sockets" << std::endl;
+        return false;
+#else
+        sockaddr_un address{};
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Socket path too long: " << socketPath << std::endl;
+            return false;
+        }
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            std::cerr << "Failed to create socket: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        std::error_code ec;
+        root = std::filesystem::weakly_canonical(rootDirectory.empty() ? std::filesystem::current_path(ec)
+                                                                        : std::filesystem::path(rootDirectory), ec);
+        if (ec || !std::filesystem::is_directory(root)) {
+            std::cerr << "Daemon root is not a directory: " << rootDirectory << std::endl;
+            ::close(listenFd);
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+        ::unlink(socketPath.c_str());
+        // Права меняются до listen: раньше подключиться к сокету нельзя
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::chmod(socketPath.c_str(), mode_t(socketMode)) != 0 || listen(listenFd, 64) != 0) {
+            std::cerr << "Failed to listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+            ::close(listenFd);
+            return false;
+        }
+        std::cout << "Render daemon listening on " << socketPath << " ("
+                  << ThreadPool::shared().size() << " worker threads, root " << root.string() << ")" << std::endl;
+
+        while (!stopping.load()) {
+            int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EINTR) continue;
+                if (!stopping.load()) std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> lock(clientsMutex);
+                clients.insert(client);
+            }
+            std::thread([this, client] {
+                serve(client);
+                std::lock_guard<std::mutex> lock(clientsMutex);
+                ::close(client);
+                clients.erase(client);
+                if (clients.empty()) clientsDone.notify_all();
+            }).detach();
+        }
+
+        // Простаивающие соединения закрываются, начатые задания дорабатывают
+        std::unique_lock<std::mutex> lock(clientsMutex);
+        for (int client : clients) ::shutdown(client, SHUT_RD);
+        clientsDone.wait(lock, [this] { return clients.empty(); });
+        ::close(listenFd);
+        ::unlink(socketPath.c_str());
+        std::cout << "Render daemon stopped: " << scenes.stats() << std::endl;
+        return true;
+#endif
+    }
+
+private:
+    SceneCache scenes;
+    std::filesystem::path root;
+    std::atomic<bool> stopping{false};
+    int listenFd = -1;
+    std::mutex clientsMutex;
+    std::condition_variable clientsDone;
+    std::set<int> clients;
+
+    // Настройки одного соединения
+    struct Job {
+        std::string sceneKey;
+        SceneCache::Loader loadScene;
+        Vector3 position = Vector3(0, 1, 5);
+        Vector3 target = Vector3(0, 0, 0);
+        float vfov = 45.0f;
+        int width = 256;
+        int height = 256;
+        int samplesPerPixel = 1;
+        std::string format = "png";
+        std::string outputPath;
+    };
+
+#ifndef _WIN32
+    // Буферизованное чтение строк и блоков из сокета
+    class Connection {
+    public:
+        explicit Connection(int fd) : fd(fd) {}
+
+        // false при разрыве или если строка не уложилась в MaxLineBytes (lineTooLong)
+        bool readLine(std::string& line) {
+            line.clear();
+            size_t searched = offset;
+            for (;;) {
+                size_t newline = buffer.find('\n', searched);
+                if (newline != std::string::npos) {
+                    line.assign(buffer, offset, newline - offset);
+                    offset = newline + 1;
+                    if (!line.empty() && line.back() == '\r') line.pop_back();
+                    return true;
+                }
+                if (buffer.size() - offset > MaxLineBytes) {
+                    tooLong = true;
+                    return false;
+                }
+                searched = buffer.size() - offset;
+                if (!fill()) return false;
+                searched += offset;
+            }
+        }
+
+        bool lineTooLong() const { return tooLong; }
+
+        bool readExact(size_t count, std::string& out) {
+            while (buffer.size() - offset < count) {
+                if (!fill()) return false;
+            }
+            out.assign(buffer, offset, count);
+            offset += count;
+            return true;
+        }
+
+        bool write(const void* data, size_t size) {
+            const char* bytes = static_cast<const char*>(data);
+            while (size > 0) {
+                ssize_t written = ::send(fd, bytes, size, MSG_NOSIGNAL);
+                if (written < 0 && errno == EINTR) continue;
+                if (written <= 0) return false;
+                bytes += written;
+                size -= size_t(written);
+            }
+            return true;
+        }
+
+        bool write(const std::string& text) { return write(text.data(), text.size()); }
+
+    private:
+        int fd;
+        std::string buffer;
+        size_t offset = 0;
+        bool tooLong = false;
+
+        bool fill() {
+            if (offset > 0) {
+                buffer.erase(0, offset);
+                offset = 0;
+            }
+            char chunk[65536];
+            ssize_t received;
+            do {
+                received = ::recv(fd, chunk, sizeof(chunk), 0);
+            } while (received < 0 && errno == EINTR);
+            if (received <= 0) return false;
+            buffer.append(chunk, size_t(received));
+            return true;
+        }
+    };
+
+    void serve(int fd) {
+        Connection connection(fd);
+        Job job;
+        std::string line;
+        while (connection.readLine(line)) {
+            std::istringstream in(line);
+            std::string command;
+            if (!(in >> command)) continue;
+
+            std::string error;
+            if (command == "scene") {
+                std::string path;
+                if (!(in >> path)) {
+                    error = "usage: scene <path>";
+                } else if (!resolvePath(path)) {
+                    error = "path outside the daemon root: " + path;
+                } else {
+                    std::error_code ec;
+                    auto modified = std::filesystem::last_write_time(path, ec);
+                    job.sceneKey = "file:" + path + "@" + std::to_string(modified.time_since_epoch().count());
+                    job.loadScene = [path](Scene& scene) {
+                        SceneDescription description;
+                        if (!SceneFile::parse(path, description)) return false;
+                        SceneFile().load(description, scene);
+                        return true;
+                    };
+                }
+            } else if (command == "inline") {
+                size_t bytes = 0;
+                std::string text;
+                if (!(in >> bytes)) {
+                    error = "usage: inline <bytes> followed by the scene text";
+                } else if (bytes > maxInlineBytes) {
+                    // Текст сцены уже в пути, и границу следующей команды не
+                    // найти, поэтому соединение закрывается
+                    connection.write("error inline scene exceeds " + std::to_string(maxInlineBytes) + " bytes\n");
+                    return;
+                } else if (!connection.readExact(bytes, text)) {
+                    error = "usage: inline <bytes> followed by the scene text";
+                } else {
+                    job.sceneKey = "inline:" + std::to_string(std::hash<std::string>()(text)) + ":" +
+                                   std::to_string(text.size());
+                    job.loadScene = [text](Scene& scene) {
+                        std::istringstream source(text);
+                        SceneDescription description;
+                        if (!SceneFile::parse(source, "inline scene", description)) return false;
+                        SceneFile().load(description, scene);
+                        return true;
+                    };
+                }
+            } else if (command == "camera") {
+                Vector3 position, target;
+                if (in >> position.x >> position.y >> position.z >> target.x >> target.y >> target.z) {
+                    job.position = position;
+                    job.target = target;
+                    float vfov;
+                    if (in >> vfov) job.vfov = vfov;
+                } else {
+                    error = "usage: camera x y z tx ty tz [vfov]";
+                }
+            } else if (command == "size") {
+                int width, height;
+                if (in >> width >> height && width > 0 && height > 0 && width <= 16384 && height <= 16384) {
+                    job.width = width;
+                    job.height = height;
+                } else {
+                    error = "usage: size <width> <height> (1..16384)";
+                }
+            } else if (command == "spp") {
+                int spp;
+                if (in >> spp && spp > 0 && spp <= 65536) {
+                    job.samplesPerPixel = spp;
+                } else {
+                    error = "usage: spp <1..65536>";
+                }
+            } else if (command == "format") {
+                std::string format;
+                if (in >> format && (format == "raw" || parseFormat(format, nullptr))) {
+                    job.format = format;
+                } else {
+                    error = "usage: format png|qoi|bmp|ppm|raw";
+                }
+            } else if (command == "output") {
+                std::string path;
+                if (!(in >> path)) {
+                    error = "usage: output <path>|-";
+                } else if (path == "-") {
+                    job.outputPath.clear();
+                } else if (!resolvePath(path)) {
+                    error = "path outside the daemon root: " + path;
+                } else {
+                    job.outputPath = path;
+                }
+            } else if (command == "render") {
+                if (!render(job, connection, error) && error.empty()) return;  // соединение оборвалось
+            } else if (command == "stats") {
+                if (!connection.write("ok " + scenes.stats() + "\n")) return;
+            } else if (command == "shutdown") {
+                stopping.store(true);
+                ::shutdown(listenFd, SHUT_RDWR);
+                connection.write("ok\n");
+                return;
+            } else {
+                error = "unknown command '" + command + "'";
+            }
+
+            if (!error.empty() && !connection.write("error " + error + "\n")) return;
+        }
+        if (connection.lineTooLong()) {
+            connection.write("error command exceeds " + std::to_string(MaxLineBytes) + " bytes\n");
+        }
+    }
+
+    // Путь клиента относительно root в абсолютный; символические ссылки в
+    // существующей части раскрываются, так что ссылка наружу тоже отвергается
+    bool resolvePath(std::string& path) const {
+        std::error_code ec;
+        std::filesystem::path resolved = std::filesystem::weakly_canonical(root / path, ec);
+        if (ec) return false;
+        auto relative = resolved.lexically_relative(root);
+        if (relative.empty() || *relative.begin() == "..") return false;
+        path = resolved.string();
+        return true;
+    }
+
+    // false с пустым error — клиент отключился
+    bool render(const Job& job, Connection& connection, std::string& error) {
+        if (!job.loadScene) {
+            error = "no scene: send 'scene' or 'inline' first";
+            return false;
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<const Scene> scene = scenes.get(job.sceneKey, job.loadScene);
+        if (!scene) {
+            error = "failed to load scene";
+            return false;
+        }
+
+        Camera camera(job.position, job.target, job.vfov, float(job.width) / float(job.height));
+        FrameBuffer frame(job.width, job.height, false);
+        CpuRenderer renderer;
+        renderer.render(*scene, camera, frame, job.samplesPerPixel);
+
+        PostProcess post;
+        std::vector<unsigned char> pixels;
+        std::vector<unsigned char> encoded;
+        if (job.format == "raw") {
+            post.process(frame, OutputLayout::rgb(), encoded);
+        } else {
+            ImageFormat format = ImageFormat::PNG;
+            parseFormat(job.format, &format);
+            auto encoder = ImageEncoder::create(format);
+            post.process(frame, encoder->inputLayout(), pixels);
+            encoder->encode(pixels.data(), frame.width, frame.height, encoded);
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Rendered " << job.width << "x" << job.height << " " << job.format << " in " << ms
+                  << " ms" << std::endl;
+
+        if (!job.outputPath.empty()) {
+            if (!ImageUtils::writeFile(job.outputPath, encoded)) {
+                error = "failed to write " + job.outputPath;
+                return false;
+            }
+            return connection.write("ok written " + job.outputPath + "\n");
+        }
+        std::ostringstream header;
+        header << "ok " << encoded.size() << " " << job.width << " " << job.height << " " << job.format << "\n";
+        return connection.write(header.str()) && connection.write(encoded.data(), encoded.size());
+    }
+#endif
+
+    static bool parseFormat(const std::string& name, ImageFormat* format) {
+        static const std::pair<const char*, ImageFormat> formats[] = {
+                {"png", ImageFormat::PNG}, {"qoi", ImageFormat::QOI},
+                {"bmp", ImageFormat::BMP}, {"ppm", ImageFormat::PPM},
+        };
+        for (const auto& entry : formats) {
+            if (name == entry.first) {
+                if (format) *format = entry.second;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif
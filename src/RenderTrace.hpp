@@ -0,0 +1,207 @@
+#ifndef RENDERTRACE_HPP
+#define RENDERTRACE_HPP
+
+// Инструментирование CPU-рендера: счётчики лучей и тестов пересечений в
+// thread-local блоках и времена начала/конца каждого тайла по воркерам.
+// Включается определением RAYTRACER_TRACE (опция CMake RAYTRACER_ENABLE_TRACE);
+// без него макросы TRACE_* раскрываются в пустоту и ничего не стоят.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TraceCounters {
+    uint64_t raysCast = 0;
+    uint64_t sphereTests = 0;
+    uint64_t shadowRays = 0;
+    uint64_t occludedHits = 0;
+
+    TraceCounters& operator+=(const TraceCounters& other) {
+        raysCast += other.raysCast;
+        sphereTests += other.sphereTests;
+        shadowRays += other.shadowRays;
+        occludedHits += other.occludedHits;
+        return *this;
+    }
+};
+
+struct TileEvent {
+    int worker;
+    int tileX;
+    int tileY;
+    int64_t startNs;
+    int64_t endNs;
+    TraceCounters counters;  // приращение счётчиков за тайл
+};
+
+class RenderTrace {
+public:
+    // Блок данных одного потока; пишется только своим потоком
+    struct ThreadBlock {
+        int worker = 0;
+        TraceCounters counters;
+        std::vector<TileEvent> tiles;
+    };
+
+    static RenderTrace& instance() {
+        static RenderTrace trace;
+        return trace;
+    }
+
+    static ThreadBlock& local() {
+        static thread_local ThreadBlock* block = instance().registerThread();
+        return *block;
+    }
+
+    // Вызывается перед кадром, пока воркеры простаивают
+    void beginFrame(int tileSize) {
+        std::lock_guard<std::mutex> lock(mutex);
+        frameTileSize = tileSize;
+        frameStart = std::chrono::steady_clock::now();
+        for (auto& block : blocks) {
+            block->counters = TraceCounters();
+            block->tiles.clear();
+        }
+    }
+
+    int64_t nowNs() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - frameStart).count();
+    }
+
+    TraceCounters totals() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        TraceCounters sum;
+        for (const auto& block : blocks) sum += block->counters;
+        return sum;
+    }
+
+    std::vector<TileEvent> tileEvents() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<TileEvent> events;
+        for (const auto& block : blocks) {
+            events.insert(events.end(), block->tiles.begin(), block->tiles.end());
+        }
+        std::sort(events.begin(), events.end(),
+                  [](const TileEvent& a, const TileEvent& b) { return a.startNs < b.startNs; });
+        return events;
+    }
+
+    int tileSize() const { return frameTileSize; }
+
+    // Chrome trace-event JSON (chrome://tracing, Perfetto): один "X"-event на тайл
+    bool writeChromeTrace(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open trace file: " << path << std::endl;
+            return false;
+        }
+
+        TraceCounters sum = totals();
+        file << "{\"traceEvents\":[\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU render\"}}";
+        for (const auto& event : tileEvents()) {
+            file << ",\n{\"name\":\"tile " << event.tileX << "," << event.tileY
+                 << "\",\"cat\":\"tile\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.worker
+                 << ",\"ts\":" << double(event.startNs) / 1000.0
+                 << ",\"dur\":" << double(event.endNs - event.startNs) / 1000.0
+                 << ",\"args\":{\"rays\":" << event.counters.raysCast
+                 << ",\"sphereTests\":" << event.counters.sphereTests
+                 << ",\"shadowRays\":" << event.counters.shadowRays
+                 << ",\"occluded\":" << event.counters.occludedHits << "}}";
+        }
+        file << "\n],\"otherData\":{\"raysCast\":" << sum.raysCast
+             << ",\"sphereTests\":" << sum.sphereTests
+             << ",\"shadowRays\":" << sum.shadowRays
+             << ",\"occludedHits\":" << sum.occludedHits << "}}\n";
+        return true;
+    }
+
+    // Тепловая карта времени тайлов: RGB сверху вниз, каждый тайл — блок tileSize x tileSize,
+    // от синего (самый быстрый) к красному (самый медленный)
+    void tileHeatmap(int width, int height, std::vector<unsigned char>& pixels) const {
+        pixels.assign(size_t(width) * height * 3, 0);
+        std::vector<TileEvent> events = tileEvents();
+        if (events.empty() || frameTileSize <= 0) return;
+
+        int64_t slowest = 1;
+        for (const auto& event : events) slowest = std::max(slowest, event.endNs - event.startNs);
+
+        for (const auto& event : events) {
+            float t = float(event.endNs - event.startNs) / float(slowest);
+            unsigned char r = static_cast<unsigned char>(255 * std::min(1.0f, 2.0f * t));
+            unsigned char g = static_cast<unsigned char>(255 * (1.0f - std::abs(2.0f * t - 1.0f)));
+            unsigned char b = static_cast<unsigned char>(255 * std::min(1.0f, 2.0f * (1.0f - t)));
+            int x0 = event.tileX * frameTileSize;
+            int y0 = event.tileY * frameTileSize;
+            for (int y = y0; y < std::min(height, y0 + frameTileSize); y++) {
+                for (int x = x0; x < std::min(width, x0 + frameTileSize); x++) {
+                    unsigned char* p = pixels.data() + (size_t(y) * width + x) * 3;
+                    p[0] = r;
+                    p[1] = g;
+                    p[2] = b;
+                }
+            }
+        }
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBlock>> blocks;
+    std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+    int frameTileSize = 0;
+
+    ThreadBlock* registerThread() {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocks.push_back(std::make_unique<ThreadBlock>());
+        blocks.back()->worker = int(blocks.size()) - 1;
+        return blocks.back().get();
+    }
+};
+
+// Отметка тайла: запоминает время и счётчики на входе, на выходе пишет TileEvent
+class TileScope {
+public:
+    TileScope(int tileX, int tileY) : tileX(tileX), tileY(tileY) {
+        RenderTrace::ThreadBlock& block = RenderTrace::local();
+        before = block.counters;
+        startNs = RenderTrace::instance().nowNs();
+    }
+
+    ~TileScope() {
+        RenderTrace::ThreadBlock& block = RenderTrace::local();
+        TileEvent event;
+        event.worker = block.worker;
+        event.tileX = tileX;
+        event.tileY = tileY;
+        event.startNs = startNs;
+        event.endNs = RenderTrace::instance().nowNs();
+        event.counters.raysCast = block.counters.raysCast - before.raysCast;
+        event.counters.sphereTests = block.counters.sphereTests - before.sphereTests;
+        event.counters.shadowRays = block.counters.shadowRays - before.shadowRays;
+        event.counters.occludedHits = block.counters.occludedHits - before.occludedHits;
+        block.tiles.push_back(event);
+    }
+
+private:
+    int tileX;
+    int tileY;
+    int64_t startNs;
+    TraceCounters before;
+};
+
+#ifdef RAYTRACER_TRACE
+#define TRACE_COUNT(counter, n) (RenderTrace::local().counters.counter += (n))
+#define TRACE_TILE(tileX, tileY) TileScope traceTileScope_(tileX, tileY)
+#else
+#define TRACE_COUNT(counter, n) ((void)0)
+#define TRACE_TILE(tileX, tileY) ((void)0)
+#endif
+
+#endif
@@ -2,6 +2,8 @@
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <string>
 
 const char* vertexShaderSource = R"(
 #version 330 core
@@ -22,9 +24,17 @@ in vec2 TexCoord;
 out vec4 FragColor;
 
 uniform sampler2D screenTexture;
+// Выборка из SRGB8_ALPHA8 уже линейна — кодируем обратно в sRGB
+uniform bool encodeSrgb;
+
+vec3 linearToSrgb(vec3 c) {
+    return mix(c * 12.92, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, c));
+}
 
 void main() {
-    FragColor = texture(screenTexture, TexCoord);
+    vec4 color = texture(screenTexture, TexCoord);
+    if (encodeSrgb) color.rgb = linearToSrgb(color.rgb);
+    FragColor = color;
 }
 )";
 
@@ -53,9 +63,10 @@ struct Light {
     float intensity;
 };
 
-uniform Sphere spheres[5];
+uniform Sphere spheres[32];  // Renderer::MaxGpuSpheres
 uniform int sphereCount;
-uniform Light light;
+uniform Light lights[8];  // Renderer::MaxGpuLights
+uniform int lightCount;
 uniform vec3 backgroundColor;
 
 struct HitRecord {
@@ -119,23 +130,38 @@ bool isInShadow(vec3 point, vec3 lightPos) {
     return shadowHit.hit && shadowHit.t < lightDist;
 }
 
+// LIGHT_COUNT, SHADOWS и SPECULAR подставляет Renderer::compileShader
+// по конфигурации сцены, лишние ветви вырезаются при компиляции.
+// LIGHT_COUNT — 0, 1, 2 или 4 источника (цикл разворачивается) либо -1:
+// тогда их число берётся из lightCount
 vec3 computePhongLighting(HitRecord hit, vec3 viewDir) {
-    vec3 lightDir = normalize(light.position - hit.point);
-    vec3 reflectDir = reflect(-lightDir, hit.normal);
+    vec3 color = hit.material.x * hit.color;
+#if LIGHT_COUNT != 0
+#if LIGHT_COUNT > 0
+    for (int i = 0; i < LIGHT_COUNT; i++) {
+#else
+    for (int i = 0; i < lightCount; i++) {
+#endif
+        Light light = lights[i];
+        vec3 lightDir = normalize(light.position - hit.point);
+
+#if SHADOWS
+        if (isInShadow(hit.point, light.position)) {
+            continue;
+        }
+#endif
 
-    vec3 ambient = hit.material.x * hit.color;
+        float diff = max(dot(hit.normal, lightDir), 0.0);
+        color += hit.material.y * diff * hit.color * light.color * light.intensity;
 
-    if (isInShadow(hit.point, light.position)) {
-        return ambient;
+#if SPECULAR
+        vec3 reflectDir = reflect(-lightDir, hit.normal);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), hit.shininess);
+        color += hit.material.z * spec * light.color * light.intensity;
+#endif
     }
-
-    float diff = max(dot(hit.normal, lightDir), 0.0);
-    vec3 diffuse = hit.material.y * diff * hit.color * light.color * light.intensity;
-
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), hit.shininess);
-    vec3 specular = hit.material.z * spec * light.color * light.intensity;
-
-    return ambient + diffuse + specular;
+#endif
+    return color;
 }
 
 void main() {
@@ -160,10 +186,28 @@ void main() {
 }
 )";
 
-const char* computeShaderSource = R"(
-#version 430 core
-layout (local_size_x = 8, local_size_y = 8) in;
-layout (rgba32f, binding = 0) uniform image2D imgOutput;
+// Общая часть compute-трассировщиков; #version и #define подставляются
+// в createComputeKernel, main — из одного из вариантов ниже.
+// OUTPUT_FORMAT — layout-квалификатор формата итоговой текстуры, SRGB_OUTPUT —
+// пишется ли она через RGBA8-вид sRGB-текстуры.
+const char* computeShaderCommon = R"(
+layout (OUTPUT_FORMAT, binding = 0) uniform writeonly image2D imgOutput;
+// Накопление: rgb — сумма линейных сэмплов, a — их количество
+layout (rgba32f, binding = 1) uniform image2D accumBuffer;
+// Точка первого попадания пикселя (w = 1) или промах (w = 0)
+layout (rgba32f, binding = 2) uniform image2D hitPoints;
+
+// Тайлы 8x8 частичного перерендера; первые три слова — аргументы
+// glDispatchComputeIndirect, их заполняет dirtyClassifyShaderSource
+layout (std430, binding = 1) buffer DirtyTiles {
+    uint dirtyGroupsX, dirtyGroupsY, dirtyGroupsZ;
+    uint dirtyTiles[];
+};
+
+// Номер сэмпла с момента последнего сброса накопления (0 — начать заново)
+uniform uint frameIndex;
+// Рисуются только тайлы из dirtyTiles, накопление в них начинается заново
+uniform bool dirtyPass;
 
 uniform vec2 resolution;
 uniform vec3 cameraPos;
@@ -185,9 +229,10 @@ struct Light {
     float intensity;
 };
 
-uniform Sphere spheres[5];
+uniform Sphere spheres[32];  // Renderer::MaxGpuSpheres
 uniform int sphereCount;
-uniform Light light;
+uniform Light lights[8];  // Renderer::MaxGpuLights
+uniform int lightCount;
 uniform vec3 backgroundColor;
 
 struct HitRecord {
@@ -251,32 +296,59 @@ bool isInShadow(vec3 point, vec3 lightPos) {
     return shadowHit.hit && shadowHit.t < lightDist;
 }
 
+// LIGHT_COUNT, SHADOWS и SPECULAR подставляет Renderer::compileShader
+// по конфигурации сцены, лишние ветви вырезаются при компиляции.
+// LIGHT_COUNT — 0, 1, 2 или 4 источника (цикл разворачивается) либо -1:
+// тогда их число берётся из lightCount
 vec3 computePhongLighting(HitRecord hit, vec3 viewDir) {
-    vec3 lightDir = normalize(light.position - hit.point);
-    vec3 reflectDir = reflect(-lightDir, hit.normal);
+    vec3 color = hit.material.x * hit.color;
+#if LIGHT_COUNT != 0
+#if LIGHT_COUNT > 0
+    for (int i = 0; i < LIGHT_COUNT; i++) {
+#else
+    for (int i = 0; i < lightCount; i++) {
+#endif
+        Light light = lights[i];
+        vec3 lightDir = normalize(light.position - hit.point);
+
+#if SHADOWS
+        if (isInShadow(hit.point, light.position)) {
+            continue;
+        }
+#endif
 
-    vec3 ambient = hit.material.x * hit.color;
+        float diff = max(dot(hit.normal, lightDir), 0.0);
+        color += hit.material.y * diff * hit.color * light.color * light.intensity;
 
-    if (isInShadow(hit.point, light.position)) {
-        return ambient;
+#if SPECULAR
+        vec3 reflectDir = reflect(-lightDir, hit.normal);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), hit.shininess);
+        color += hit.material.z * spec * light.color * light.intensity;
+#endif
     }
-
-    float diff = max(dot(hit.normal, lightDir), 0.0);
-    vec3 diffuse = hit.material.y * diff * hit.color * light.color * light.intensity;
-
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), hit.shininess);
-    vec3 specular = hit.material.z * spec * light.color * light.intensity;
-
-    return ambient + diffuse + specular;
+#endif
+    return color;
 }
 
-void main() {
-    ivec2 pixelCoords = ivec2(gl_GlobalInvocationID.xy);
-    ivec2 dims = imageSize(imgOutput);
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
 
-    if (pixelCoords.x >= dims.x || pixelCoords.y >= dims.y) return;
+void tracePixel(ivec2 pixelCoords, ivec2 dims) {
+    vec4 sum = frameIndex == 0u || dirtyPass ? vec4(0.0) : imageLoad(accumBuffer, pixelCoords);
 
-    vec2 uv = vec2(pixelCoords) / vec2(dims);
+    // Первый сэмпл в углу пикселя, как без накопления; дальше — случайный сдвиг
+    vec2 jitter = vec2(0.0);
+    if (sum.a > 0.0) {
+        uint seed = hash(uint(pixelCoords.x) + uint(pixelCoords.y) * 65536u + frameIndex * 0x9e3779b9u);
+        jitter = vec2(float(seed & 0xffffu), float(seed >> 16)) / 65536.0;
+    }
+    vec2 uv = (vec2(pixelCoords) + jitter) / vec2(dims);
 
     vec3 rayOrigin = cameraPos;
     vec3 rayDir = normalize(cameraLowerLeft + cameraHorizontal * uv.x +
@@ -292,30 +364,241 @@ void main() {
         color = backgroundColor;
     }
 
+    if (sum.a == 0.0) imageStore(hitPoints, pixelCoords, hit.hit ? vec4(hit.point, 1.0) : vec4(0.0));
+    sum += vec4(color, 1.0);
+    imageStore(accumBuffer, pixelCoords, sum);
+
+    color = sum.rgb / sum.a;
+#if SRGB_OUTPUT
+    // Байты вида читаются как sRGB: нужна точная кривая, а не гамма 2.2,
+    // иначе декодирование при выборке не вернёт исходный линейный цвет
+    color = mix(color * 12.92, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, color));
+#else
     color = pow(color, vec3(1.0/2.2));
+#endif
     imageStore(imgOutput, pixelCoords, vec4(color, 1.0));
 }
 )";
 
+// Один поток на пиксель, сетка групп 8x8 на весь кадр; в частичном
+// проходе — по группе на тайл из dirtyTiles (косвенный запуск)
+static_assert(Renderer::DirtyTileSize == 8, "dispatch and dirty-classify shaders assume 8x8 tiles");
+const char* computeDispatchMain = R"(
+layout (local_size_x = 8, local_size_y = 8) in;
+
+void main() {
+    ivec2 pixelCoords = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 dims = imageSize(imgOutput);
+    if (dirtyPass) {
+        uint tile = dirtyTiles[gl_WorkGroupID.x];
+        uint dirtyTilesX = uint(dims.x + 7) / 8u;
+        pixelCoords = ivec2(tile % dirtyTilesX, tile / dirtyTilesX) * 8 + ivec2(gl_LocalInvocationID.xy);
+    }
+
+    if (pixelCoords.x >= dims.x || pixelCoords.y >= dims.y) return;
+    tracePixel(pixelCoords, dims);
+}
+)";
+
+// Постоянные потоки: запускается ровно столько групп, сколько помещается
+// на GPU, и каждая группа, закончив тайл, берёт следующий из атомарного
+// счётчика. Дорогие тайлы не держат занятыми слоты, которые в обычной
+// сетке простаивали бы до конца самой медленной группы.
+// WORKGROUP_SIZE и TILE_SIZE (Renderer::DirtyTileSize) задаются через
+// #define. В частичном проходе очередь идёт по списку dirtyTiles.
+const char* computePersistentMain = R"(
+layout (local_size_x = WORKGROUP_SIZE) in;
+
+layout (std430, binding = 0) buffer TileQueue {
+    uint nextTile;
+};
+
+uniform uint tilesX;
+uniform uint tileCount;
+
+shared uint currentTile;
+
+void main() {
+    ivec2 dims = imageSize(imgOutput);
+    for (;;) {
+        if (gl_LocalInvocationIndex == 0u) currentTile = atomicAdd(nextTile, 1u);
+        barrier();
+        uint tile = currentTile;
+        barrier();
+        // tile одинаков во всей группе, поэтому выход не нарушает barrier()
+        if (tile >= (dirtyPass ? dirtyGroupsX : tileCount)) return;
+        if (dirtyPass) tile = dirtyTiles[tile];
+
+        ivec2 origin = ivec2(tile % tilesX, tile / tilesX) * TILE_SIZE;
+        for (uint i = gl_LocalInvocationIndex; i < uint(TILE_SIZE * TILE_SIZE); i += uint(WORKGROUP_SIZE)) {
+            ivec2 pixelCoords = origin + ivec2(i % uint(TILE_SIZE), i / uint(TILE_SIZE));
+            if (pixelCoords.x < dims.x && pixelCoords.y < dims.y) tracePixel(pixelCoords, dims);
+        }
+    }
+}
+)";
+
+// Отбор тайлов 8x8 для частичного перерендера после правки отдельных
+// объектов (DirtyRegions): тайл попадает в список, если задевает проекцию
+// прежнего или нового положения объекта или если точки первого попадания
+// его пикселей могут лежать в тени объекта. Сдвинутые сэмплы пикселя
+// попадают между точками соседних пикселей, поэтому берётся и рамка в
+// пиксель вокруг тайла.
+const char* dirtyClassifyShaderSource = R"(
+#version 430 core
+layout (local_size_x = 64) in;
+
+layout (rgba32f, binding = 2) uniform readonly image2D hitPoints;
+
+layout (std430, binding = 1) buffer DirtyTiles {
+    uint dirtyGroupsX, dirtyGroupsY, dirtyGroupsZ;
+    uint dirtyTiles[];
+};
+
+uniform uint tilesX;
+uniform uint tileCount;
+uniform vec3 lightPositions[8];  // Renderer::MaxGpuLights
+uniform int lightCount;
+uniform float receiverMargin;
+uniform int volumeCount;
+uniform vec4 volumes[16];       // Renderer::MaxDirtyVolumes; центр и радиус
+uniform ivec4 volumeTiles[16];  // тайлы проекции: x0, y0, x1, y1
+uniform bool volumeShadows[16];
+
+// То же, что DirtyRegions::shadowMayReach
+bool shadowMayReach(vec3 lightPosition, vec3 center, float radius, vec3 receiver, float receiverRadius) {
+    vec3 axis = center - lightPosition;
+    float lightDistance = length(axis);
+    if (lightDistance <= radius) return true;
+    axis /= lightDistance;
+    float sinAngle = radius / lightDistance;
+    float cosAngle = sqrt(1.0 - sinAngle * sinAngle);
+
+    vec3 toReceiver = receiver - lightPosition;
+    float along = dot(toReceiver, axis);
+    if (along + receiverRadius < lightDistance * cosAngle * cosAngle) return false;
+    float across = length(toReceiver - axis * along);
+    float gap = along * cosAngle + across * sinAngle >= 0.0 ? across * cosAngle - along * sinAngle
+                                                             : length(toReceiver);
+    return gap <= receiverRadius;
+}
+
+void main() {
+    uint tile = gl_GlobalInvocationID.x;
+    if (tile >= tileCount) return;
+    ivec2 tileCoords = ivec2(tile % tilesX, tile / tilesX);
+
+    bool dirty = false;
+    for (int i = 0; i < volumeCount && !dirty; i++) {
+        dirty = all(greaterThanEqual(tileCoords, volumeTiles[i].xy)) &&
+                all(lessThanEqual(tileCoords, volumeTiles[i].zw));
+    }
+
+    if (!dirty) {
+        ivec2 dims = imageSize(hitPoints);
+        ivec2 origin = tileCoords * 8;
+        vec3 low = vec3(1e30), high = vec3(-1e30);
+        bool anyHit = false;
+        for (int y = -1; y <= 8; y++) {
+            for (int x = -1; x <= 8; x++) {
+                vec4 hit = imageLoad(hitPoints, clamp(origin + ivec2(x, y), ivec2(0), dims - 1));
+                if (hit.w == 0.0) continue;
+                low = min(low, hit.xyz);
+                high = max(high, hit.xyz);
+                anyHit = true;
+            }
+        }
+        if (anyHit) {
+            vec3 receiver = (low + high) * 0.5;
+            float receiverRadius = length(high - low) * 0.5 + receiverMargin;
+            for (int i = 0; i < volumeCount && !dirty; i++) {
+                if (!volumeShadows[i]) continue;
+                for (int l = 0; l < lightCount && !dirty; l++) {
+                    dirty = shadowMayReach(lightPositions[l], volumes[i].xyz, volumes[i].w, receiver, receiverRadius);
+                }
+            }
+        }
+    }
+
+    if (dirty) dirtyTiles[atomicAdd(dirtyGroupsX, 1u)] = tile;
+}
+)";
+
+namespace {
+
+struct OutputFormatInfo {
+    const char* name;
+    GLenum internalFormat;  // хранилище texture
+    GLenum imageFormat;     // формат привязки к image unit
+    const char* qualifier;  // layout-квалификатор в шейдере
+};
+
+const OutputFormatInfo& outputFormatInfo(OutputFormat format) {
+    static const OutputFormatInfo formats[] = {
+            {"rgba32f", GL_RGBA32F, GL_RGBA32F, "rgba32f"},
+            {"rgba16f", GL_RGBA16F, GL_RGBA16F, "rgba16f"},
+            {"rgba8", GL_RGBA8, GL_RGBA8, "rgba8"},
+            {"srgb8", GL_SRGB8_ALPHA8, GL_RGBA8, "rgba8"},
+            {"rgb10a2", GL_RGB10_A2, GL_RGB10_A2, "rgb10_a2"},
+    };
+    return formats[int(format)];
+}
+
+}  // namespace
+
+const char* outputFormatName(OutputFormat format) {
+    return outputFormatInfo(format).name;
+}
+
 Renderer::Renderer(int width, int height, bool useComputeShader)
-        : width(width), height(height), useComputeShader(useComputeShader) {
+        : width(width), height(height), renderWidth(width), renderHeight(height),
+          useComputeShader(useComputeShader) {
 
     setupTexture();
     setupQuad();
 
     if (useComputeShader) {
-        computeProgram = createComputeProgram(computeShaderSource);
+        dispatchProgram = createComputeKernel(ComputeKernel::Dispatch);
+        computeProgram = dispatchProgram;
+        glGenBuffers(1, &tileQueueBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileQueueBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        classifyProgram = createComputeProgram(dirtyClassifyShaderSource);
+        classifyUniforms.tilesX = glGetUniformLocation(classifyProgram, "tilesX");
+        classifyUniforms.tileCount = glGetUniformLocation(classifyProgram, "tileCount");
+        classifyUniforms.lightPositions = glGetUniformLocation(classifyProgram, "lightPositions");
+        classifyUniforms.lightCount = glGetUniformLocation(classifyProgram, "lightCount");
+        classifyUniforms.receiverMargin = glGetUniformLocation(classifyProgram, "receiverMargin");
+        classifyUniforms.volumeCount = glGetUniformLocation(classifyProgram, "volumeCount");
+        classifyUniforms.volumes = glGetUniformLocation(classifyProgram, "volumes");
+        classifyUniforms.volumeTiles = glGetUniformLocation(classifyProgram, "volumeTiles");
+        classifyUniforms.volumeShadows = glGetUniformLocation(classifyProgram, "volumeShadows");
+        // Без кэша теней на GPU запас нужен только на округление
+        dirtyRegions.receiverMargin = 1e-3f;
         fragmentProgram = createProgram(vertexShaderSource, displayFragmentShaderSource);
     } else {
-        fragmentProgram = createProgram(vertexShaderSource, raytracingFragmentShaderSource);
+        fragmentProgram = createTracingFragmentProgram();
     }
+    lookupUniforms();
 }
 
 Renderer::~Renderer() {
-    glDeleteTextures(1, &texture);
+    // Запрошенные, но ещё не прочитанные кадры не теряются
+    if (readback.busy()) {
+        glFinish();
+        collectReadbacks();
+    }
+    releaseTextures();
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(1, &vbo);
-    if (useComputeShader) glDeleteProgram(computeProgram);
+    if (useComputeShader) {
+        glDeleteProgram(dispatchProgram);
+        if (persistentProgram) glDeleteProgram(persistentProgram);
+        glDeleteProgram(classifyProgram);
+        glDeleteBuffers(1, &tileQueueBuffer);
+    }
     glDeleteProgram(fragmentProgram);
 }
 
@@ -341,18 +624,87 @@ void Renderer::setupQuad() {
 }
 
 void Renderer::setupTexture() {
+    // Накопительный буфер того же размера; после пересоздания начинаем заново
+    glGenTextures(1, &accumTexture);
+    glBindTexture(GL_TEXTURE_2D, accumTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, renderWidth, renderHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    accumulatedFrames = 0;
+
+    if (useComputeShader) {
+        glGenTextures(1, &hitTexture);
+        glBindTexture(GL_TEXTURE_2D, hitTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, renderWidth, renderHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        // Три слова аргументов косвенного запуска и по слову на тайл
+        GLsizeiptr tiles = GLsizeiptr((renderWidth + DirtyTileSize - 1) / DirtyTileSize) *
+                           ((renderHeight + DirtyTileSize - 1) / DirtyTileSize);
+        glGenBuffers(1, &dirtyTileBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, dirtyTileBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (3 + tiles) * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    if (useComputeShader) {
+        // Неизменяемое хранилище, чтобы у sRGB-текстуры мог быть RGBA8-вид
+        const OutputFormatInfo& format = outputFormatInfo(outputFormat);
+        glTexStorage2D(GL_TEXTURE_2D, 1, format.internalFormat, renderWidth, renderHeight);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, renderWidth, renderHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+    }
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (!useComputeShader) return;
+
+    if (outputFormat == OutputFormat::SRGB8_ALPHA8) {
+        glGenTextures(1, &outputView);
+        glTextureView(outputView, GL_TEXTURE_2D, texture, GL_RGBA8, 0, 1, 0, 1);
+    }
+
+    // Blit копирует байты вида как есть, без преобразования sRGB
+    glGenFramebuffers(1, &presentFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, presentFramebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, outputImage(), 0);
+    if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Present framebuffer incomplete, falling back to quad" << std::endl;
+        presentMode = PresentMode::Quad;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 }
 
-GLuint Renderer::compileShader(GLenum type, const char* source) {
+void Renderer::releaseTextures() {
+    glDeleteTextures(1, &texture);
+    glDeleteTextures(1, &accumTexture);
+    glDeleteTextures(1, &hitTexture);
+    glDeleteBuffers(1, &dirtyTileBuffer);
+    if (outputView) glDeleteTextures(1, &outputView);
+    if (presentFramebuffer) glDeleteFramebuffers(1, &presentFramebuffer);
+    outputView = 0;
+    presentFramebuffer = 0;
+}
+
+// defines вставляются сразу после строки #version
+GLuint Renderer::compileShader(GLenum type, const char* source, const char* defines) {
+    std::string text = source;
+    if (defines) {
+        size_t at = 0;
+        size_t version = text.find("#version");
+        if (version != std::string::npos) {
+            size_t lineEnd = text.find('\n', version);
+            at = lineEnd == std::string::npos ? text.size() : lineEnd + 1;
+        }
+        text.insert(at, defines);
+    }
+    const char* combined = text.c_str();
     GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, nullptr);
+    glShaderSource(shader, 1, &combined, nullptr);
     glCompileShader(shader);
 
     GLint success;
@@ -365,9 +717,9 @@ GLuint Renderer::compileShader(GLenum type, const char* source) {
     return shader;
 }
 
-GLuint Renderer::createProgram(const char* vertSource, const char* fragSource) {
+GLuint Renderer::createProgram(const char* vertSource, const char* fragSource, const char* fragDefines) {
     GLuint vertShader = compileShader(GL_VERTEX_SHADER, vertSource);
-    GLuint fragShader = compileShader(GL_FRAGMENT_SHADER, fragSource);
+    GLuint fragShader = compileShader(GL_FRAGMENT_SHADER, fragSource, fragDefines);
 
     GLuint program = glCreateProgram();
     glAttachShader(program, vertShader);
@@ -387,8 +739,126 @@ GLuint Renderer::createProgram(const char* vertSource, const char* fragSource) {
     return program;
 }
 
-GLuint Renderer::createComputeProgram(const char* compSource) {
-    GLuint compShader = compileShader(GL_COMPUTE_SHADER, compSource);
+GLuint Renderer::createComputeKernel(ComputeKernel kernel) {
+    char shading[96];
+    shadingDefines(shading, sizeof(shading));
+    char defines[256];
+    std::snprintf(defines, sizeof(defines), "#define WORKGROUP_SIZE %d\n#define TILE_SIZE %d\n#define OUTPUT_FORMAT %s\n#define SRGB_OUTPUT %d\n%s",
+                  persistentWorkgroupSize, DirtyTileSize, outputFormatInfo(outputFormat).qualifier,
+                  outputFormat == OutputFormat::SRGB8_ALPHA8 ? 1 : 0, shading);
+    std::string source = std::string("#version 430 core\n") + computeShaderCommon +
+                         (kernel == ComputeKernel::Persistent ? computePersistentMain : computeDispatchMain);
+    return createComputeProgram(source.c_str(), defines);
+}
+
+void Renderer::shadingDefines(char* defines, size_t size) const {
+    std::snprintf(defines, size, "#define LIGHT_COUNT %d\n#define SHADOWS %d\n#define SPECULAR %d\n",
+                  shadingVariant.lights, int(shadingVariant.shadows), int(shadingVariant.specular));
+}
+
+GLuint Renderer::createTracingFragmentProgram() {
+    char defines[96];
+    shadingDefines(defines, sizeof(defines));
+    return createProgram(vertexShaderSource, raytracingFragmentShaderSource, defines);
+}
+
+// Вариант шейдеров под сцену: без источника, без бликов, без теней.
+// Проверяется при правке сцены; программы пересобираются, только если
+// вариант сменился.
+void Renderer::updateShadingVariant(const Scene& scene) {
+    if (&scene == variantScene && scene.getRevision() == variantRevision) return;
+    variantScene = &scene;
+    variantRevision = scene.getRevision();
+
+    ShadingVariant variant;
+    // Как у CPU: 1, 2 и 4 источника — развёрнутые циклы, иначе цикл до lightCount
+    int lights = std::min(int(scene.lights.size()), MaxGpuLights);
+    variant.lights = lights == 0 || lights == 1 || lights == 2 || lights == 4 ? lights : -1;
+    variant.shadows = cpuRenderer.shadows;
+    variant.specular = false;
+    int count = std::min(int(scene.spheres.size()), MaxGpuSpheres);
+    for (int i = 0; i < count && !variant.specular; i++) {
+        variant.specular = scene.spheres[i].material.specular != 0.0f;
+    }
+    if (variant == shadingVariant) return;
+    shadingVariant = variant;
+
+    if (useComputeShader) {
+        rebuildComputeKernels();
+    } else {
+        glDeleteProgram(fragmentProgram);
+        fragmentProgram = createTracingFragmentProgram();
+        lookupUniforms();
+        sceneUploaded = false;
+        uploadedSpheres.clear();
+    }
+}
+
+void Renderer::setShadows(bool enabled) {
+    if (enabled == cpuRenderer.shadows) return;
+    cpuRenderer.shadows = enabled;
+    variantScene = nullptr;
+    accumulatedFrames = 0;
+}
+
+void Renderer::setComputeKernel(ComputeKernel kernel) {
+    if (!useComputeShader || kernel == computeKernel) return;
+    if (kernel == ComputeKernel::Persistent && !persistentProgram) {
+        persistentProgram = createComputeKernel(ComputeKernel::Persistent);
+    }
+    computeKernel = kernel;
+    computeProgram = kernel == ComputeKernel::Persistent ? persistentProgram : dispatchProgram;
+
+    // Uniform-ы — состояние программы: адреса ищутся заново, сцена загружается целиком
+    lookupUniforms();
+    sceneUploaded = false;
+    uploadedSpheres.clear();
+    accumulatedFrames = 0;
+    dirtyPass = false;
+}
+
+void Renderer::setPersistentKernelShape(int workgroupSize, int groups) {
+    persistentGroups = std::max(1, groups);
+    if (workgroupSize == persistentWorkgroupSize || workgroupSize <= 0) return;
+    persistentWorkgroupSize = workgroupSize;
+    if (!persistentProgram) return;
+
+    glDeleteProgram(persistentProgram);
+    persistentProgram = createComputeKernel(ComputeKernel::Persistent);
+    if (computeKernel == ComputeKernel::Persistent) {
+        computeProgram = persistentProgram;
+        lookupUniforms();
+        sceneUploaded = false;
+        uploadedSpheres.clear();
+        dirtyPass = false;
+    }
+}
+
+void Renderer::setOutputFormat(OutputFormat format) {
+    if (!useComputeShader || format == outputFormat) return;
+    outputFormat = format;
+    releaseTextures();
+    setupTexture();
+    rebuildComputeKernels();
+}
+
+// Пересборка всех вариантов трассировщика после смены #define
+void Renderer::rebuildComputeKernels() {
+    glDeleteProgram(dispatchProgram);
+    dispatchProgram = createComputeKernel(ComputeKernel::Dispatch);
+    if (persistentProgram) {
+        glDeleteProgram(persistentProgram);
+        persistentProgram = createComputeKernel(ComputeKernel::Persistent);
+    }
+    computeProgram = computeKernel == ComputeKernel::Persistent ? persistentProgram : dispatchProgram;
+    lookupUniforms();
+    sceneUploaded = false;
+    uploadedSpheres.clear();
+    dirtyPass = false;
+}
+
+GLuint Renderer::createComputeProgram(const char* compSource, const char* defines) {
+    GLuint compShader = compileShader(GL_COMPUTE_SHADER, compSource, defines);
     GLuint program = glCreateProgram();
     glAttachShader(program, compShader);
     glLinkProgram(program);
@@ -406,138 +876,337 @@ GLuint Renderer::createComputeProgram(const char* compSource) {
 }
 
 void Renderer::uploadSceneData(const Scene& scene, const Camera& camera) {
-    GLuint program = useComputeShader ? computeProgram : fragmentProgram;
-    glUseProgram(program);
+    glUseProgram(useComputeShader ? computeProgram : fragmentProgram);
 
-    glUniform2f(glGetUniformLocation(program, "resolution"), width, height);
-    glUniform3f(glGetUniformLocation(program, "cameraPos"),
+    glUniform2f(uniforms.resolution, renderWidth, renderHeight);
+    glUniform3f(uniforms.cameraPos,
                 camera.position.x, camera.position.y, camera.position.z);
-    glUniform3f(glGetUniformLocation(program, "cameraLowerLeft"),
+    glUniform3f(uniforms.cameraLowerLeft,
                 camera.lowerLeftCorner.x, camera.lowerLeftCorner.y, camera.lowerLeftCorner.z);
-    glUniform3f(glGetUniformLocation(program, "cameraHorizontal"),
+    glUniform3f(uniforms.cameraHorizontal,
                 camera.horizontal.x, camera.horizontal.y, camera.horizontal.z);
-    glUniform3f(glGetUniformLocation(program, "cameraVertical"),
+    glUniform3f(uniforms.cameraVertical,
                 camera.vertical.x, camera.vertical.y, camera.vertical.z);
 
-    glUniform1i(glGetUniformLocation(program, "sphereCount"), scene.spheres.size());
-    for (size_t i = 0; i < scene.spheres.size() && i < 5; i++) {
-        std::string base = "spheres[" + std::to_string(i) + "]";
-        glUniform3f(glGetUniformLocation(program, (base + ".center").c_str()),
-                    scene.spheres[i].center.x, scene.spheres[i].center.y, scene.spheres[i].center.z);
-        glUniform1f(glGetUniformLocation(program, (base + ".radius").c_str()),
-                    scene.spheres[i].radius);
-        glUniform3f(glGetUniformLocation(program, (base + ".color").c_str()),
-                    scene.spheres[i].material.color.x,
-                    scene.spheres[i].material.color.y,
-                    scene.spheres[i].material.color.z);
-        glUniform3f(glGetUniformLocation(program, (base + ".material").c_str()),
-                    scene.spheres[i].material.ambient,
-                    scene.spheres[i].material.diffuse,
-                    scene.spheres[i].material.specular);
-        glUniform1f(glGetUniformLocation(program, (base + ".shininess").c_str()),
-                    scene.spheres[i].material.shininess);
-    }
-
-    if (!scene.lights.empty()) {
-        glUniform3f(glGetUniformLocation(program, "light.position"),
-                    scene.lights[0].position.x, scene.lights[0].position.y, scene.lights[0].position.z);
-        glUniform3f(glGetUniformLocation(program, "light.color"),
-                    scene.lights[0].color.x, scene.lights[0].color.y, scene.lights[0].color.z);
-        glUniform1f(glGetUniformLocation(program, "light.intensity"),
-                    scene.lights[0].intensity);
-    }
-
-    glUniform3f(glGetUniformLocation(program, "backgroundColor"),
-                scene.backgroundColor.x, scene.backgroundColor.y, scene.backgroundColor.z);
+    if (!sceneUploaded || scene.getRevision() != uploadedRevision) {
+        int count = std::min(int(scene.spheres.size()), MaxGpuSpheres);
+        if (!sceneUploaded || int(uploadedSpheres.size()) != count) {
+            glUniform1i(uniforms.sphereCount, count);
+        }
+        for (int i = 0; i < count; i++) {
+            const Sphere& sphere = scene.spheres[i];
+            if (i < int(uploadedSpheres.size()) && uploadedSpheres[i].center == sphere.center &&
+                uploadedSpheres[i].radius == sphere.radius && uploadedSpheres[i].material == sphere.material) {
+                continue;
+            }
+            uploadSphere(i, sphere);
+        }
+        uploadedSpheres.assign(scene.spheres.begin(), scene.spheres.begin() + count);
+
+        int lightCount = std::min(int(scene.lights.size()), MaxGpuLights);
+        glUniform1i(uniforms.lightCount, lightCount);
+        for (int i = 0; i < lightCount; i++) {
+            const Light& light = scene.lights[i];
+            glUniform3f(uniforms.lights[i].position, light.position.x, light.position.y, light.position.z);
+            glUniform3f(uniforms.lights[i].color, light.color.x, light.color.y, light.color.z);
+            glUniform1f(uniforms.lights[i].intensity, light.intensity);
+        }
+
+        glUniform3f(uniforms.backgroundColor,
+                    scene.backgroundColor.x, scene.backgroundColor.y, scene.backgroundColor.z);
+        uploadedRevision = scene.getRevision();
+        sceneUploaded = true;
+    }
+
+    if (useComputeShader) {
+        // Движение камеры, правка источников, фона или сеток сбрасывает
+        // накопление; правка отдельных объектов — только в задетых тайлах
+        bool partial = dirtyRegions.update(scene, camera, renderWidth, renderHeight, DirtyTileSize);
+        size_t changes = dirtyRegions.changes().size();
+        if (!partial || changes > size_t(MaxDirtyVolumes)) accumulatedFrames = 0;
+        bool pass = accumulatedFrames > 0 && changes > 0;
+        if (pass != dirtyPass) glUniform1i(uniforms.dirtyPass, pass);
+        dirtyPass = pass;
+        glUniform1ui(uniforms.frameIndex, accumulatedFrames);
+    }
+}
+
+void Renderer::lookupUniforms() {
+    GLuint program = useComputeShader ? computeProgram : fragmentProgram;
+    uniforms.resolution = glGetUniformLocation(program, "resolution");
+    uniforms.cameraPos = glGetUniformLocation(program, "cameraPos");
+    uniforms.cameraLowerLeft = glGetUniformLocation(program, "cameraLowerLeft");
+    uniforms.cameraHorizontal = glGetUniformLocation(program, "cameraHorizontal");
+    uniforms.cameraVertical = glGetUniformLocation(program, "cameraVertical");
+    uniforms.sphereCount = glGetUniformLocation(program, "sphereCount");
+    uniforms.lightCount = glGetUniformLocation(program, "lightCount");
+    uniforms.backgroundColor = glGetUniformLocation(program, "backgroundColor");
+    uniforms.frameIndex = glGetUniformLocation(program, "frameIndex");
+    uniforms.dirtyPass = glGetUniformLocation(program, "dirtyPass");
+    uniforms.tilesX = glGetUniformLocation(program, "tilesX");
+    uniforms.tileCount = glGetUniformLocation(program, "tileCount");
+
+    char name[64];
+    for (int i = 0; i < MaxGpuSpheres; i++) {
+        SphereUniforms& sphere = uniforms.spheres[i];
+        std::snprintf(name, sizeof(name), "spheres[%d].center", i);
+        sphere.center = glGetUniformLocation(program, name);
+        std::snprintf(name, sizeof(name), "spheres[%d].radius", i);
+        sphere.radius = glGetUniformLocation(program, name);
+        std::snprintf(name, sizeof(name), "spheres[%d].color", i);
+        sphere.color = glGetUniformLocation(program, name);
+        std::snprintf(name, sizeof(name), "spheres[%d].material", i);
+        sphere.material = glGetUniformLocation(program, name);
+        std::snprintf(name, sizeof(name), "spheres[%d].shininess", i);
+        sphere.shininess = glGetUniformLocation(program, name);
+    }
+    for (int i = 0; i < MaxGpuLights; i++) {
+        LightUniforms& light = uniforms.lights[i];
+        std::snprintf(name, sizeof(name), "lights[%d].position", i);
+        light.position = glGetUniformLocation(program, name);
+        std::snprintf(name, sizeof(name), "lights[%d].color", i);
+        light.color = glGetUniformLocation(program, name);
+        std::snprintf(name, sizeof(name), "lights[%d].intensity", i);
+        light.intensity = glGetUniformLocation(program, name);
+    }
+
+    screenTextureUniform = glGetUniformLocation(fragmentProgram, "screenTexture");
+    encodeSrgbUniform = glGetUniformLocation(fragmentProgram, "encodeSrgb");
+}
+
+void Renderer::uploadSphere(size_t index, const Sphere& sphere) {
+    const SphereUniforms& location = uniforms.spheres[index];
+    glUniform3f(location.center, sphere.center.x, sphere.center.y, sphere.center.z);
+    glUniform1f(location.radius, sphere.radius);
+    glUniform3f(location.color, sphere.material.color.x, sphere.material.color.y, sphere.material.color.z);
+    glUniform3f(location.material, sphere.material.ambient, sphere.material.diffuse, sphere.material.specular);
+    glUniform1f(location.shininess, sphere.material.shininess);
 }
 
 void Renderer::render(const Scene& scene, const Camera& camera) {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point frameStart = Clock::now();
+
+    FrameTiming timing;
+    timing.frame = frameIndex;
+    timing.renderScale = renderScale;
+    if (frameIndex > 0) {
+        timing.frameMs = std::chrono::duration<double, std::milli>(frameStart - lastFrameStart).count();
+    }
+    lastFrameStart = frameStart;
+
+    collectReadbacks();
+    updateShadingVariant(scene);
+
     if (useComputeShader) {
         glUseProgram(computeProgram);
         uploadSceneData(scene, camera);
+        timing.uploadMs = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+        gpuTimer.beginFrame(timing);
+
+        gpuTimer.begin(GpuPhase::Dispatch);
+        glBindImageTexture(0, outputImage(), 0, GL_FALSE, 0, GL_WRITE_ONLY, outputFormatInfo(outputFormat).imageFormat);
+        glBindImageTexture(1, accumTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindImageTexture(2, hitTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, dirtyTileBuffer);
+        GLbitfield barriers = GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+        if (dirtyPass) {
+            classifyDirtyTiles(scene);
+            glUseProgram(computeProgram);
+            // Следующий отбор перезаписывает список, который читает этот проход
+            barriers |= GL_BUFFER_UPDATE_BARRIER_BIT;
+        }
+        if (computeKernel == ComputeKernel::Persistent) {
+            GLuint tilesX = GLuint((renderWidth + DirtyTileSize - 1) / DirtyTileSize);
+            GLuint tileCount = tilesX * GLuint((renderHeight + DirtyTileSize - 1) / DirtyTileSize);
+            glUniform1ui(uniforms.tilesX, tilesX);
+            glUniform1ui(uniforms.tileCount, tileCount);
+            const GLuint zero = 0;
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, tileQueueBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+            glDispatchCompute(std::min(GLuint(persistentGroups), tileCount), 1, 1);
+            // Следующий сброс счётчика должен дождаться атомиков этого кадра
+            barriers |= GL_BUFFER_UPDATE_BARRIER_BIT;
+        } else if (dirtyPass) {
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, dirtyTileBuffer);
+            glDispatchComputeIndirect(0);
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        } else {
+            glDispatchCompute((renderWidth + 7) / 8, (renderHeight + 7) / 8, 1);
+        }
+        accumulatedFrames++;
+        gpuTimer.end(GpuPhase::Dispatch);
 
-        glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-        glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        // Вывод читает кадр как текстуру или как буфер кадра
+        barriers |= presentMode == PresentMode::Blit ? GL_FRAMEBUFFER_BARRIER_BIT : GL_TEXTURE_FETCH_BARRIER_BIT;
+        gpuTimer.begin(GpuPhase::Barrier);
+        glMemoryBarrier(barriers);
+        gpuTimer.end(GpuPhase::Barrier);
 
         glUseProgram(fragmentProgram);
-        glUniform1i(glGetUniformLocation(fragmentProgram, "screenTexture"), 0);
+        glUniform1i(screenTextureUniform, 0);
+        glUniform1i(encodeSrgbUniform, outputFormat == OutputFormat::SRGB8_ALPHA8);
     } else {
         glUseProgram(fragmentProgram);
         uploadSceneData(scene, camera);
+        timing.uploadMs = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+        gpuTimer.beginFrame(timing);
     }
 
-    glBindVertexArray(vao);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-}
+    // В режиме фрагментного шейдера трассировка происходит в этом же проходе
+    gpuTimer.begin(GpuPhase::Draw);
+    if (useComputeShader && presentMode == PresentMode::Blit) {
+        bool scaled = renderWidth != width || renderHeight != height;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, presentFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, width, height,
+                          GL_COLOR_BUFFER_BIT, scaled ? GL_LINEAR : GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    } else {
+        glBindVertexArray(vao);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    gpuTimer.end(GpuPhase::Draw);
 
-void Renderer::resize(int width, int height) {
-    this->width = width;
-    this->height = height;
-    glDeleteTextures(1, &texture);
-    setupTexture();
+    if (imageWriter && (screenshotRequested || continuousCapture)) requestReadback();
+
+    gpuTimer.endFrame();
+    gpuTimer.collect(frameStats);
+    frameIndex++;
 }
 
-Vector3 Renderer::traceRay(const Ray& ray, const Scene& scene, int depth) {
-    if (depth > 3) return scene.backgroundColor;
+// Список тайлов для частичного прохода: аргументы запуска сбрасываются в
+// (0, 1, 1), classifyProgram дописывает тайлы и наращивает число групп
+void Renderer::classifyDirtyTiles(const Scene& scene) {
+    const std::vector<DirtyVolume>& changes = dirtyRegions.changes();
+    GLfloat volumes[MaxDirtyVolumes * 4];
+    GLint volumeTiles[MaxDirtyVolumes * 4];
+    GLint volumeShadows[MaxDirtyVolumes];
+    int count = int(changes.size());
+    for (int i = 0; i < count; i++) {
+        const DirtyVolume& volume = changes[i];
+        volumes[4 * i] = volume.center.x;
+        volumes[4 * i + 1] = volume.center.y;
+        volumes[4 * i + 2] = volume.center.z;
+        volumes[4 * i + 3] = volume.radius;
+        volumeTiles[4 * i] = volume.tiles.x0;
+        volumeTiles[4 * i + 1] = volume.tiles.y0;
+        volumeTiles[4 * i + 2] = volume.tiles.x1;
+        volumeTiles[4 * i + 3] = volume.tiles.y1;
+        volumeShadows[i] = volume.castsShadow && !scene.lights.empty();
+    }
 
-    HitRecord hit = scene.intersect(ray);
-    if (!hit.hit) return scene.backgroundColor;
+    glUseProgram(classifyProgram);
+    GLuint tileCount = GLuint(dirtyRegions.tileCount());
+    glUniform1ui(classifyUniforms.tilesX, GLuint(dirtyRegions.tilesX()));
+    glUniform1ui(classifyUniforms.tileCount, tileCount);
+    GLfloat lightPositions[MaxGpuLights * 3];
+    int lightCount = std::min(int(scene.lights.size()), MaxGpuLights);
+    for (int i = 0; i < lightCount; i++) {
+        lightPositions[3 * i] = scene.lights[i].position.x;
+        lightPositions[3 * i + 1] = scene.lights[i].position.y;
+        lightPositions[3 * i + 2] = scene.lights[i].position.z;
+    }
+    glUniform1i(classifyUniforms.lightCount, lightCount);
+    glUniform3fv(classifyUniforms.lightPositions, lightCount, lightPositions);
+    glUniform1f(classifyUniforms.receiverMargin, dirtyRegions.receiverMargin);
+    glUniform1i(classifyUniforms.volumeCount, count);
+    glUniform4fv(classifyUniforms.volumes, count, volumes);
+    glUniform4iv(classifyUniforms.volumeTiles, count, volumeTiles);
+    glUniform1iv(classifyUniforms.volumeShadows, count, volumeShadows);
+
+    const GLuint arguments[3] = {0, 1, 1};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dirtyTileBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(arguments), arguments);
+    glDispatchCompute((tileCount + 63) / 64, 1, 1);
+    // Трассировщик читает список как SSBO и как аргументы запуска и
+    // перезаписывает точки попадания, которые отбор только что читал
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
 
-    Vector3 viewDir = (ray.origin - hit.point).normalize();
-    Vector3 color(0, 0, 0);
+void Renderer::requestScreenshot(ImageFormat format) {
+    screenshotRequested = true;
+    captureFormat = format;
+}
 
-    color = color + hit.material.color * hit.material.ambient;
+void Renderer::setContinuousCapture(bool enabled, ImageFormat format) {
+    continuousCapture = enabled;
+    captureFormat = format;
+    captureIndex = 0;
+}
 
-    for (const auto& light : scene.lights) {
-        if (scene.isInShadow(hit.point, light.position)) {
-            continue;
+// Копия кадра ставится в очередь GPU; сами пиксели забирает
+// collectReadbacks через несколько кадров. Тег: номер кадра
+// последовательности или -1 для одиночного снимка (он важнее, кадр
+// последовательности в этот раз не пишется).
+void Renderer::requestReadback() {
+    long long tag = screenshotRequested ? -1 : captureIndex;
+    bool queued;
+    if (useComputeShader) {
+        // glGetTexImage должен видеть запись imageStore из compute-прохода
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+        queued = readback.requestTexture(outputImage(), renderWidth, renderHeight, tag);
+    } else {
+        glReadBuffer(GL_BACK);
+        queued = readback.requestFramebuffer(width, height, tag);
+    }
+    // Кольцо занято: снимок переносится на следующий кадр, кадр
+    // последовательности пропускается без дыры в нумерации
+    if (!queued) return;
+    if (tag < 0) screenshotRequested = false;
+    else captureIndex++;
+}
+
+void Renderer::collectReadbacks() {
+    if (!imageWriter) return;
+    readback.collect([&](const unsigned char* rgba, int frameWidth, int frameHeight, long long tag) {
+        if (tag < 0) {
+            imageWriter->submitScreenshot(rgba, frameWidth, frameHeight, captureFormat);
+        } else {
+            imageWriter->submitSequenceFrame(rgba, frameWidth, frameHeight, captureFormat, tag);
         }
+    });
+}
 
-        Vector3 lightDir = (light.position - hit.point).normalize();
-        Vector3 reflectDir = lightDir.reflect(hit.normal) * -1.0f;
+void Renderer::resize(int width, int height) {
+    this->width = width;
+    this->height = height;
+    renderWidth = std::max(1, int(width * renderScale));
+    renderHeight = std::max(1, int(height * renderScale));
+    releaseTextures();
+    setupTexture();
+}
 
-        float diffuseIntensity = std::max(0.0f, hit.normal.dot(lightDir));
-        Vector3 diffuse = hit.material.color * hit.material.diffuse *
-                          diffuseIntensity * light.color * light.intensity;
+void Renderer::setRenderScale(float scale) {
+    // Фрагментный трассировщик рисует прямо в окно, масштаб для него не применяется
+    if (!useComputeShader) return;
 
-        float specularIntensity = std::pow(std::max(0.0f, viewDir.dot(reflectDir)),
-                                           hit.material.shininess);
-        Vector3 specular = light.color * hit.material.specular *
-                           specularIntensity * light.intensity;
+    int newWidth = std::max(1, int(width * scale));
+    int newHeight = std::max(1, int(height * scale));
+    renderScale = scale;
+    if (newWidth == renderWidth && newHeight == renderHeight) return;
 
-        color = color + diffuse + specular;
-    }
+    renderWidth = newWidth;
+    renderHeight = newHeight;
+    releaseTextures();
+    setupTexture();
+}
 
-    return color;
+Vector3 Renderer::traceRay(const Ray& ray, const Scene& scene, int depth) {
+    return cpuRenderer.traceRay(ray, scene, depth);
 }
 
 void Renderer::renderCPU(const Scene& scene, const Camera& camera,
                          std::vector<unsigned char>& pixels) {
-    pixels.resize(width * height * 3);
-
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            float u = float(x) / float(width);
-            float v = float(height - 1 - y) / float(height);
-
-            Ray ray = camera.getRay(u, v);
-            Vector3 color = traceRay(ray, scene);
-
-            color.x = std::pow(color.x, 1.0f / 2.2f);
-            color.y = std::pow(color.y, 1.0f / 2.2f);
-            color.z = std::pow(color.z, 1.0f / 2.2f);
-
-            color.x = std::max(0.0f, std::min(1.0f, color.x));
-            color.y = std::max(0.0f, std::min(1.0f, color.y));
-            color.z = std::max(0.0f, std::min(1.0f, color.z));
+    cpuRenderer.resizeFrame(cpuFrame, width, height, false);
+    cpuRenderer.render(scene, camera, cpuFrame);
+    postProcess.process(cpuFrame, OutputLayout::rgb(), pixels);
+}
 
-            int idx = (y * width + x) * 3;
-            pixels[idx + 0] = static_cast<unsigned char>(color.x * 255);
-            pixels[idx + 1] = static_cast<unsigned char>(color.y * 255);
-            pixels[idx + 2] = static_cast<unsigned char>(color.z * 255);
-        }
-    }
+void Renderer::renderCPU(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                         int samplesPerPixel) {
+    cpuRenderer.resizeFrame(frame, width, height, frame.hasAux);
+    cpuRenderer.render(scene, camera, frame, samplesPerPixel);
 }
\ No newline at end of file
@@ -3,25 +3,174 @@
 
 #include "glad/glad.h"
 #include <vector>
+#include <chrono>
 #include "Scene.hpp"
 #include "Camera.hpp"
+#include "CpuRenderer.hpp"
+#include "FrameBuffer.hpp"
+#include "PostProcess.hpp"
+#include "GpuTimer.hpp"
+#include "GpuReadback.hpp"
+#include "AsyncImageWriter.hpp"
+#include "FrameStats.hpp"
+
+// Вариант compute-трассировщика
+enum class ComputeKernel {
+    Dispatch,    // сетка групп 8x8 на весь кадр
+    Persistent   // постоянные группы разбирают тайлы из атомарной очереди
+};
+
+// Формат текстуры, в которую compute-трассировщик пишет итоговый кадр.
+// Значения уже в гамме дисплея, поэтому 8 бит на канал хватает; float-
+// форматы нужны, только если кадр читается дальше как HDR.
+enum class OutputFormat {
+    RGBA32F,       // 16 байт на пиксель
+    RGBA16F,       // 8
+    RGBA8,         // 4
+    SRGB8_ALPHA8,  // 4, выборка при выводе фильтруется в линейном пространстве
+    RGB10_A2       // 4, 10 бит на цветовой канал
+};
+
+const char* outputFormatName(OutputFormat format);
+
+// Вывод кадра compute-трассировщика в окно
+enum class PresentMode {
+    Quad,  // полноэкранный четырёхугольник с выборкой из текстуры
+    Blit   // glBlitFramebuffer из FBO с текстурой, без шейдерного прохода
+};
 
 class Renderer {
+public:
+    // Размер массива spheres в шейдерах; остальные сферы видит только CPU
+    static constexpr int MaxGpuSpheres = 32;
+    // Размер массива lights в шейдерах; остальные источники видит только CPU
+    static constexpr int MaxGpuLights = 8;
+    // Сколько изменившихся объёмов разбирает частичный перерендер за кадр;
+    // при большем числе накопление сбрасывается целиком
+    static constexpr int MaxDirtyVolumes = 16;
+    // Тайл частичного перерендера; им же режет кадр Persistent-вариант,
+    // чтобы номера из dirtyTileBuffer означали одни и те же тайлы
+    static constexpr int DirtyTileSize = 8;
+
 private:
     int width;
     int height;
-    GLuint computeProgram;
+    // Внутреннее разрешение трассировки (динамическое разрешение в compute-режиме)
+    int renderWidth;
+    int renderHeight;
+    float renderScale = 1.0f;
+    GLuint computeProgram;  // активный из dispatchProgram и persistentProgram
+    GLuint dispatchProgram = 0;
+    GLuint persistentProgram = 0;
+    ComputeKernel computeKernel = ComputeKernel::Dispatch;
+    int persistentWorkgroupSize = 64;
+    int persistentGroups = 256;
+    // Счётчик следующего тайла для ComputeKernel::Persistent
+    GLuint tileQueueBuffer = 0;
     GLuint fragmentProgram;
+    // Под какую конфигурацию сцены собраны шейдеры трассировки
+    struct ShadingVariant {
+        int lights = 1;
+        bool shadows = true;
+        bool specular = true;
+
+        bool operator==(const ShadingVariant& v) const {
+            return lights == v.lights && shadows == v.shadows && specular == v.specular;
+        }
+    };
+    ShadingVariant shadingVariant;
+    const Scene* variantScene = nullptr;
+    unsigned long long variantRevision = 0;
     GLuint texture;
+    // Куда пишет imageStore и откуда читают blit и readback: сама texture
+    // или её RGBA8-вид для SRGB8_ALPHA8 (sRGB-форматов у image нет)
+    GLuint outputView = 0;
+    GLuint presentFramebuffer = 0;
+    OutputFormat outputFormat = OutputFormat::RGBA32F;
+    PresentMode presentMode = PresentMode::Quad;
+    GLuint accumTexture;
+    GLuint hitTexture = 0;  // точки первого попадания для отбора тайлов
+    // Временное накопление в compute-режиме, пока камера и сцена не меняются
+    unsigned int accumulatedFrames = 0;
+    // Правка отдельных сфер сбрасывает накопление только в тайлах, которые
+    // она могла задеть: их отбирает classifyProgram в dirtyTileBuffer, и
+    // трассировщик перерисовывает только их (косвенный запуск)
+    DirtyRegions dirtyRegions;
+    bool dirtyPass = false;
+    GLuint classifyProgram = 0;
+    GLuint dirtyTileBuffer = 0;
+    struct ClassifyUniforms {
+        GLint tilesX = -1, tileCount = -1;
+        GLint lightPositions = -1, lightCount = -1, receiverMargin = -1;
+        GLint volumeCount = -1, volumes = -1, volumeTiles = -1, volumeShadows = -1;
+    };
+    ClassifyUniforms classifyUniforms;
+    // Копия того, что уже лежит в uniform-ах программы: пока сцена не
+    // меняется, сферы и свет не загружаются, после правки — только
+    // изменившиеся сферы
+    std::vector<Sphere> uploadedSpheres;
+    unsigned long long uploadedRevision = 0;
+    bool sceneUploaded = false;
+
+    // Адреса uniform-ов ищутся один раз после сборки программы,
+    // в кадре строки имён не строятся
+    struct SphereUniforms {
+        GLint center = -1, radius = -1, color = -1, material = -1, shininess = -1;
+    };
+    struct LightUniforms {
+        GLint position = -1, color = -1, intensity = -1;
+    };
+    struct SceneUniforms {
+        GLint resolution = -1;
+        GLint cameraPos = -1, cameraLowerLeft = -1, cameraHorizontal = -1, cameraVertical = -1;
+        GLint sphereCount = -1;
+        GLint lightCount = -1;
+        GLint backgroundColor = -1;
+        GLint frameIndex = -1;
+        GLint dirtyPass = -1;
+        GLint tilesX = -1, tileCount = -1;  // только ComputeKernel::Persistent
+        SphereUniforms spheres[MaxGpuSpheres];
+        LightUniforms lights[MaxGpuLights];
+    };
+    SceneUniforms uniforms;
+    GLint screenTextureUniform = -1;
+    GLint encodeSrgbUniform = -1;
     GLuint vao, vbo;
     bool useComputeShader;
+    CpuRenderer cpuRenderer;
+    FrameBuffer cpuFrame;
+    PostProcess postProcess;
+
+    GpuTimer gpuTimer;
+    // Снимки и запись последовательности кадров прямо с GPU
+    GpuReadback readback;
+    AsyncImageWriter* imageWriter = nullptr;
+    bool screenshotRequested = false;
+    bool continuousCapture = false;
+    ImageFormat captureFormat = ImageFormat::PNG;
+    long long captureIndex = 0;
+    FrameStats* frameStats = nullptr;
+    long long frameIndex = 0;
+    std::chrono::steady_clock::time_point lastFrameStart;
 
     void setupQuad();
     void setupTexture();
-    GLuint compileShader(GLenum type, const char* source);
-    GLuint createProgram(const char* vertSource, const char* fragSource);
-    GLuint createComputeProgram(const char* compSource);
+    void releaseTextures();
+    GLuint outputImage() const { return outputView ? outputView : texture; }
+    void rebuildComputeKernels();
+    GLuint compileShader(GLenum type, const char* source, const char* defines = nullptr);
+    GLuint createProgram(const char* vertSource, const char* fragSource, const char* fragDefines = nullptr);
+    GLuint createComputeProgram(const char* compSource, const char* defines = nullptr);
+    GLuint createTracingFragmentProgram();
+    void shadingDefines(char* defines, size_t size) const;
+    void updateShadingVariant(const Scene& scene);
+    GLuint createComputeKernel(ComputeKernel kernel);
     void uploadSceneData(const Scene& scene, const Camera& camera);
+    void lookupUniforms();
+    void classifyDirtyTiles(const Scene& scene);
+    void uploadSphere(size_t index, const Sphere& sphere);
+    void requestReadback();
+    void collectReadbacks();
 
 public:
     Renderer(int width, int height, bool useComputeShader = true);
@@ -30,9 +179,49 @@ public:
     void render(const Scene& scene, const Camera& camera);
     void resize(int width, int height);
 
+    // Масштаб внутреннего разрешения относительно окна; изображение растягивается
+    // на окно билинейной фильтрацией текстуры при выводе
+    void setRenderScale(float scale);
+    float getRenderScale() const { return renderScale; }
+
+    // Замеры кадров (CPU и GPU) отправляются в stats с задержкой в несколько кадров
+    void setFrameStats(FrameStats* stats) { frameStats = stats; }
+
+    // Смена варианта compute-трассировщика; в режиме фрагментного шейдера
+    // ничего не делает. workgroupSize — потоков в группе Persistent-варианта
+    // (пересобирает его шейдер), groups — сколько групп запускать.
+    void setComputeKernel(ComputeKernel kernel);
+    void setPersistentKernelShape(int workgroupSize, int groups);
+    ComputeKernel getComputeKernel() const { return computeKernel; }
+
+    // Формат итоговой текстуры compute-режима (пересоздаёт её и шейдеры,
+    // накопление начинается заново) и способ вывода её в окно
+    void setOutputFormat(OutputFormat format);
+    void setPresentMode(PresentMode mode) { presentMode = mode; }
+    OutputFormat getOutputFormat() const { return outputFormat; }
+    PresentMode getPresentMode() const { return presentMode; }
+
+    // Готовые кадры с GPU уходят в writer; без него захват недоступен
+    void setImageWriter(AsyncImageWriter* writer) { imageWriter = writer; }
+    // Текущий кадр GPU будет сохранён как снимок, без повторного рендера
+    void requestScreenshot(ImageFormat format);
+    // Каждый кадр отправляется в последовательность writer-а (startSequence)
+    void setContinuousCapture(bool enabled, ImageFormat format);
+    bool isCapturing() const { return continuousCapture; }
+
+    // Тени в шейдерах и на CPU; выключенные — быстрый предпросмотр
+    void setShadows(bool enabled);
+    bool getShadows() const { return cpuRenderer.shadows; }
+
+    // Настройки CPU-пути (скриншоты, трассировка)
+    CpuRenderer& getCpuRenderer() { return cpuRenderer; }
+
     Vector3 traceRay(const Ray& ray, const Scene& scene, int depth = 0);
     void renderCPU(const Scene& scene, const Camera& camera,
                    std::vector<unsigned char>& pixels);
+    // Линейный рендер с вспомогательными буферами (при frame.hasAux) для денойзера
+    void renderCPU(const Scene& scene, const Camera& camera, FrameBuffer& frame,
+                   int samplesPerPixel = 1);
 };
 
 #endif
\ No newline at end of file
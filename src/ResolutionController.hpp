@@ -0,0 +1,49 @@
+#ifndef RESOLUTIONCONTROLLER_HPP
+#define RESOLUTIONCONTROLLER_HPP
+
+#include <algorithm>
+#include <cmath>
+
+// Подбирает масштаб внутреннего разрешения трассировки под бюджет времени кадра.
+// Стоимость кадра считается пропорциональной числу пикселей, поэтому масштаб по
+// стороне меняется как sqrt(бюджет / замер). Масштаб квантуется шагом 1/16, чтобы
+// текстура не пересоздавалась на каждом кадре из-за шума замеров.
+class ResolutionController {
+public:
+    double targetFrameMs = 16.0;
+    float minScale = 0.25f;
+    float maxScale = 1.0f;
+    float smoothing = 0.3f;
+
+    float scale() const { return currentScale; }
+
+    // gpuFrameMs — время трассировки и вывода последнего замеренного кадра,
+    // frameScale — масштаб, с которым этот кадр рисовался: GPU-замеры приходят
+    // на несколько кадров позже, и после смены масштаба ещё описывают старый.
+    // Пока камера неподвижна, сразу возвращается полное разрешение.
+    float update(double gpuFrameMs, float frameScale, bool cameraMoving) {
+        if (!cameraMoving) {
+            desiredScale = maxScale;
+            currentScale = maxScale;
+            return currentScale;
+        }
+        if (gpuFrameMs <= 0.0) return currentScale;
+
+        float ideal = frameScale * float(std::sqrt(targetFrameMs / gpuFrameMs));
+        desiredScale += (ideal - desiredScale) * smoothing;
+        desiredScale = std::clamp(desiredScale, minScale, maxScale);
+
+        float quantized = std::round(desiredScale * 16.0f) / 16.0f;
+        quantized = std::clamp(quantized, minScale, maxScale);
+        if (std::abs(quantized - currentScale) >= 1.0f / 16.0f) {
+            currentScale = quantized;
+        }
+        return currentScale;
+    }
+
+private:
+    float currentScale = 1.0f;
+    float desiredScale = 1.0f;
+};
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+enum class SamplerType {
+    Independent,  // хеш от (пиксель, сэмпл, измерение) — эталон «как rand»
+    Sobol,        // Sobol с перемешиванием индекса и вложенным скремблированием Оуэна
+    BlueNoise     // тайл blue noise со сдвигом по последовательности R2 между сэмплами
+};
+
+// Генератор точек сэмплирования. Значение зависит только от (seed, пиксель,
+// номер сэмпла, номер измерения), поэтому рендер воспроизводится бит в бит
+// при любом числе потоков. Объект маленький и копируется в каждый поток;
+// общие таблицы только читаются после инициализации.
+//
+// Измерения расходуются по порядку вызовами get1D/get2D после startPixel.
+// Sobol выдаётся блоками по 4 измерения: внутри блока точки образуют одну
+// 4D-последовательность, разные блоки и пиксели декоррелированы разными
+// перестановками индекса (Burley, "Practical Hash-based Owen Scrambling").
+class Sampler {
+public:
+    static constexpr int BlueNoiseSize = 64;
+
+    explicit Sampler(SamplerType type = SamplerType::Sobol, uint32_t seed = 0)
+            : type(type), seed(seed) {}
+
+    void startPixel(int x, int y, uint32_t sampleIndex) {
+        pixelX = x;
+        pixelY = y;
+        pixelSeed = hashCombine(seed, hash(uint32_t(x) * 0x8da6b343u ^ uint32_t(y) * 0xd8163841u));
+        sample = sampleIndex;
+        dimension = 0;
+    }
+
+    float get1D() {
+        uint32_t d = dimension++;
+        switch (type) {
+            case SamplerType::Sobol:
+                return sobolSample(d);
+            case SamplerType::BlueNoise:
+                return blueNoiseSample(d);
+            default:
+                return toFloat(hash(hashCombine(pixelSeed, hashCombine(sample, d))));
+        }
+    }
+
+    void get2D(float& u, float& v) {
+        u = get1D();
+        v = get1D();
+    }
+
+    // [0, 1) из старших 24 бит
+    static float toFloat(uint32_t x) {
+        return float(x >> 8) * (1.0f / 16777216.0f);
+    }
+
+    static uint32_t hash(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352dU;
+        x ^= x >> 15;
+        x *= 0x846ca68bU;
+        x ^= x >> 16;
+        return x;
+    }
+
+    static uint32_t hashCombine(uint32_t a, uint32_t b) {
+        return a ^ (b + 0x9e3779b9u + (a << 6) + (a >> 2));
+    }
+
+    // Sobol без скремблирования, 32 бита; измерения 0..3
+    static uint32_t sobol(uint32_t index, int dim) {
+        const uint32_t* directions = sobolDirections().v[dim];
+        uint32_t x = 0;
+        for (int bit = 0; index != 0; bit++, index >>= 1) {
+            if (index & 1u) x ^= directions[bit];
+        }
+        return x;
+    }
+
+    static uint32_t reverseBits(uint32_t x) {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+        x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Вложенное равномерное скремблирование Оуэна через хеш Лейна–Карраса:
+    // каждый бит переворачивается в зависимости только от старших битов
+    static uint32_t owenScramble(uint32_t x, uint32_t seed) {
+        x = reverseBits(x);
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return reverseBits(x);
+    }
+
+    // Ранги тайла void-and-cluster, нормированные в [0, 1)
+    static const std::vector<float>& blueNoiseTile() {
+        static const std::vector<float> tile = buildBlueNoise();
+        return tile;
+    }
+
+private:
+    SamplerType type;
+    uint32_t seed;
+    uint32_t pixelSeed = 0;
+    uint32_t sample = 0;
+    uint32_t dimension = 0;
+    int pixelX = 0;
+    int pixelY = 0;
+
+    float sobolSample(uint32_t d) const {
+        uint32_t block = d / 4;
+        uint32_t index = owenScramble(sample, hashCombine(pixelSeed, hash(block)));
+        uint32_t value = sobol(index, int(d % 4));
+        return toFloat(owenScramble(value, hashCombine(pixelSeed, hash(d + 0x51ed270bu))));
+    }
+
+    float blueNoiseSample(uint32_t d) const {
+        // Каждому измерению — свой тороидальный сдвиг тайла, между сэмплами —
+        // аддитивная последовательность R2 (шаги 1/g и 1/g^2, g — пластическое
+        // число), чтобы пара соседних измерений не ложилась на одну диагональ
+        uint32_t offset = hash(hashCombine(seed, d));
+        int x = (pixelX + int(offset & 0xFFu)) & (BlueNoiseSize - 1);
+        int y = (pixelY + int((offset >> 8) & 0xFFu)) & (BlueNoiseSize - 1);
+        // Сдвиг считается в 32-битной фиксированной точке, чтобы не терять
+        // точность на больших номерах сэмплов
+        uint32_t value = uint32_t(blueNoiseTile()[size_t(y) * BlueNoiseSize + x] * 4294967296.0);
+        uint32_t step = (d & 1u) ? 0x91e10da6u : 0xc13fa9a9u;
+        return toFloat(value + sample * step);
+    }
+
+    struct DirectionTable {
+        uint32_t v[4][32];
+    };
+
+    static const DirectionTable& sobolDirections() {
+        static const DirectionTable table = buildSobolDirections();
+        return table;
+    }
+
+    // Направляющие числа Joe–Kuo для измерений 2..4, первое измерение —
+    // обращение битов (ван дер Корпут)
+    static DirectionTable buildSobolDirections() {
+        struct Primitive {
+            int degree;
+            uint32_t coefficients;
+            uint32_t initial[3];
+        };
+        const Primitive primitives[3] = {
+                {1, 0, {1, 0, 0}},
+                {2, 1, {1, 3, 0}},
+                {3, 1, {1, 3, 1}},
+        };
+
+        DirectionTable directions;
+        for (int bit = 0; bit < 32; bit++) directions.v[0][bit] = 1u << (31 - bit);
+        for (int dim = 1; dim < 4; dim++) {
+            const Primitive& p = primitives[dim - 1];
+            uint32_t* v = directions.v[dim];
+            for (int bit = 0; bit < p.degree; bit++) v[bit] = p.initial[bit] << (31 - bit);
+            for (int bit = p.degree; bit < 32; bit++) {
+                uint32_t value = v[bit - p.degree] ^ (v[bit - p.degree] >> p.degree);
+                for (int k = 1; k < p.degree; k++) {
+                    if ((p.coefficients >> (p.degree - 1 - k)) & 1u) value ^= v[bit - k];
+                }
+                v[bit] = value;
+            }
+        }
+        return directions;
+    }
+
+    // Void-and-cluster (Ulichney) на торе BlueNoiseSize x BlueNoiseSize с гауссовым
+    // фильтром sigma = 1.5. Энергия обновляется инкрементально сдвигом ядра.
+    static std::vector<float> buildBlueNoise() {
+        const int n = BlueNoiseSize;
+        const int count = n * n;
+        const float sigma = 1.5f;
+
+        std::vector<float> kernel(count);
+        for (int y = 0; y < n; y++) {
+            for (int x = 0; x < n; x++) {
+                int dx = std::min(x, n - x);
+                int dy = std::min(y, n - y);
+                kernel[size_t(y) * n + x] = std::exp(-float(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+            }
+        }
+
+        std::vector<unsigned char> pattern(count, 0);
+        std::vector<float> energy(count, 0.0f);
+        auto splat = [&](std::vector<float>& field, int index, float sign) {
+            int px = index % n, py = index / n;
+            for (int y = 0; y < n; y++) {
+                const float* row = kernel.data() + size_t((y - py + n) & (n - 1)) * n;
+                float* out = field.data() + size_t(y) * n;
+                for (int x = 0; x < n; x++) out[x] += sign * row[(x - px + n) & (n - 1)];
+            }
+        };
+        // Самый плотный кластер среди value == 1 или самая большая пустота среди value == 0
+        auto extreme = [&](const std::vector<float>& field, unsigned char value, bool largest) {
+            int best = -1;
+            for (int i = 0; i < count; i++) {
+                if (pattern[i] != value) continue;
+                if (best < 0 || (largest ? field[i] > field[best] : field[i] < field[best])) best = i;
+            }
+            return best;
+        };
+
+        // Начальный узор: 10% точек в детерминированных случайных местах
+        int initialOnes = count / 10;
+        uint32_t state = 1;
+        for (int placed = 0; placed < initialOnes;) {
+            state = hash(state + 0x9e3779b9u);
+            int index = int(state % uint32_t(count));
+            if (pattern[index]) continue;
+            pattern[index] = 1;
+            splat(energy, index, 1.0f);
+            placed++;
+        }
+        // Перемещаем точки из кластеров в пустоты, пока узор не стабилизируется
+        for (int iteration = 0; iteration < count; iteration++) {
+            int cluster = extreme(energy, 1, true);
+            pattern[cluster] = 0;
+            splat(energy, cluster, -1.0f);
+            int gap = extreme(energy, 0, false);
+            pattern[gap] = 1;
+            splat(energy, gap, 1.0f);
+            if (gap == cluster) break;
+        }
+
+        std::vector<int> rank(count, 0);
+        std::vector<unsigned char> initial = pattern;
+        std::vector<float> initialEnergy = energy;
+
+        // Фаза 1: ранжируем начальные точки, удаляя самые плотные
+        for (int ones = initialOnes; ones > 0; ones--) {
+            int cluster = extreme(energy, 1, true);
+            pattern[cluster] = 0;
+            splat(energy, cluster, -1.0f);
+            rank[cluster] = ones - 1;
+        }
+
+        // Фаза 2: до половины заполняем самые большие пустоты
+        pattern = initial;
+        energy = initialEnergy;
+        int filled = initialOnes;
+        for (; filled < count / 2; filled++) {
+            int gap = extreme(energy, 0, false);
+            pattern[gap] = 1;
+            splat(energy, gap, 1.0f);
+            rank[gap] = filled;
+        }
+
+        // Фаза 3: меньшинством становятся нули, заполняем самые плотные их кластеры
+        std::vector<float> zeroEnergy(count, 0.0f);
+        for (int i = 0; i < count; i++) {
+            if (!pattern[i]) splat(zeroEnergy, i, 1.0f);
+        }
+        for (; filled < count; filled++) {
+            int cluster = extreme(zeroEnergy, 0, true);
+            pattern[cluster] = 1;
+            splat(zeroEnergy, cluster, -1.0f);
+            rank[cluster] = filled;
+        }
+
+        std::vector<float> tile(count);
+        for (int i = 0; i < count; i++) tile[i] = (float(rank[i]) + 0.5f) / float(count);
+        return tile;
+    }
+};
+
+#endif
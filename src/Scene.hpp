@@ -1,9 +1,16 @@
 #ifndef SCENE_HPP
 #define SCENE_HPP
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 #include "Sphere.hpp"
+#include "Mesh.hpp"
+#include "GeometryGroup.hpp"
+#include "SphereCloud.hpp"
 #include "Ray.hpp"
+#include "BVH.hpp"
+#include "RenderTrace.hpp"
 
 struct Light {
     Vector3 position;
@@ -13,40 +20,186 @@ struct Light {
     Light(const Vector3& pos, const Vector3& color = Vector3(1, 1, 1),
           float intensity = 1.0f)
             : position(pos), color(color), intensity(intensity) {}
+
+    bool operator==(const Light& l) const {
+        return position == l.position && color == l.color && intensity == l.intensity;
+    }
 };
 
-struct HitRecord {
-    float t;
-    Vector3 point;
-    Vector3 normal;
-    Material material;
-    bool hit;
+// Кандидат для первичного луча: сфера и нижняя граница расстояния до неё
+// вдоль любого луча из камеры (глубина ближайшей точки по оси взгляда)
+struct SphereCandidate {
+    int sphere;
+    float nearDepth;
+};
 
-    HitRecord() : t(-1.0f), hit(false) {}
+enum class AccelUpdate {
+    None,
+    Refit,
+    Rebuild
 };
 
 class Scene {
+private:
+    BVH bvh;
+    std::vector<AABB> sphereBounds;
+    std::vector<int> dirtySpheres;
+    std::vector<unsigned char> dirtyFlags;
+    // Верхний уровень: BVH над мировыми AABB экземпляров
+    BVH instanceBvh;
+    std::vector<AABB> instanceBounds;
+    bool instancesDirty = false;
+    unsigned long long revision = 0;
+
+    static AABB boundsOf(const Sphere& sphere) {
+        Vector3 r(sphere.radius, sphere.radius, sphere.radius);
+        return AABB(sphere.center - r, sphere.center + r);
+    }
+
+    // BVH годится для обхода, только если он построен по текущему набору сфер
+    // и все изменения уже применены через updateAccelerationStructure()
+    bool accelerationValid() const {
+        return !bvh.isEmpty() && bvh.primitiveCount() == int(spheres.size()) &&
+               dirtySpheres.empty();
+    }
+
+    bool instanceAccelerationValid() const {
+        return !instanceBvh.isEmpty() && instanceBvh.primitiveCount() == int(instances.size()) &&
+               !instancesDirty;
+    }
+
 public:
     std::vector<Sphere> spheres;
+    std::vector<Mesh> meshes;
+    // Общая геометрия и её размещения; память растёт с числом уникальных
+    // групп, а экземпляр хранит только преобразование и материал
+    std::vector<GeometryGroup> groups;
+    std::vector<Instance> instances;
+    // Облака сфер читаются с диска по требованию и разделяются между копиями сцены
+    std::vector<std::shared_ptr<SphereCloud>> clouds;
     std::vector<Light> lights;
     Vector3 backgroundColor;
+    // Порог деградации: refit допускается, пока SAH-стоимость дерева
+    // не превышает стоимость свежепостроенного в rebuildThreshold раз
+    float rebuildThreshold = 1.5f;
 
     Scene() : backgroundColor(0.5f, 0.7f, 1.0f) {}
 
     void addSphere(const Sphere& sphere) {
         spheres.push_back(sphere);
+        markChanged();
+        // После removeSphere число сфер может снова совпасть с BVH,
+        // тогда новая сфера обновится через refit
+        if (spheres.size() <= size_t(bvh.primitiveCount())) markSphereDirty(spheres.size() - 1);
+    }
+
+    // Сетка добавляется уже с построенным BVH (MeshLoader::load делает это сам)
+    void addMesh(Mesh mesh) {
+        if (mesh.accelerationStructure().isEmpty() && mesh.triangleCount() > 0) mesh.build();
+        meshes.push_back(std::move(mesh));
+        markChanged();
+    }
+
+    // Группа считается неизменной после добавления; возвращает её индекс для Instance
+    int addGeometryGroup(GeometryGroup group) {
+        group.build();
+        groups.push_back(std::move(group));
+        markChanged();
+        return int(groups.size()) - 1;
+    }
+
+    void addCloud(std::shared_ptr<SphereCloud> cloud) {
+        clouds.push_back(std::move(cloud));
+        markChanged();
+    }
+
+    void addInstance(const Instance& instance) {
+        instances.push_back(instance);
+        markInstancesDirty();
+    }
+
+    void updateInstance(size_t index, const Transform& transform) {
+        instances[index].setTransform(transform);
+        markInstancesDirty();
     }
 
+    // Прямые правки instances[i] нужно сопровождать этим вызовом
+    void markInstancesDirty() {
+        instancesDirty = true;
+        markChanged();
+    }
+
+    // Номер версии сцены: растёт при любой правке через API сцены.
+    // После прямого изменения полей (материалы, lights, backgroundColor)
+    // нужно вызвать markChanged(), чтобы сбросились накопленные кадры;
+    // правку meshes[i] или groups[i] — ещё и их build() или markChanged().
+    unsigned long long getRevision() const { return revision; }
+    void markChanged() { revision++; }
+
+    // Перемещение/изменение радиуса сферы; BVH обновится при следующем
+    // updateAccelerationStructure(). Прямые правки spheres[i] нужно
+    // сопровождать вызовом markSphereDirty(i).
+    void updateSphere(size_t index, const Vector3& center, float radius) {
+        spheres[index].center = center;
+        spheres[index].radius = radius;
+        markSphereDirty(index);
+    }
+
+    // Удаляет сферу, перенося на её место последнюю; BVH перестроится
+    // при следующем updateAccelerationStructure()
+    void removeSphere(size_t index) {
+        spheres[index] = spheres.back();
+        spheres.pop_back();
+        markChanged();
+        if (index < spheres.size()) markSphereDirty(index);
+    }
+
+    void markSphereDirty(size_t index) {
+        markChanged();
+        if (dirtyFlags.size() != spheres.size()) {
+            dirtyFlags.assign(spheres.size(), 0);
+        }
+        if (!dirtyFlags[index]) {
+            dirtyFlags[index] = 1;
+            dirtySpheres.push_back(int(index));
+        }
+    }
+
+    // Вызывается раз в кадр после всех изменений: при смене количества сфер
+    // строит BVH заново, иначе делает refit изменённых, а если качество дерева
+    // упало ниже порога — полную перестройку. То же для BVH экземпляров.
+    AccelUpdate updateAccelerationStructure() {
+        AccelUpdate sphereUpdate = updateSphereAcceleration();
+        AccelUpdate instanceUpdate = updateInstanceAcceleration();
+        return std::max(sphereUpdate, instanceUpdate);
+    }
+
+    const BVH& accelerationStructure() const { return bvh; }
+    const BVH& instanceAccelerationStructure() const { return instanceBvh; }
+    bool hasSphereAcceleration() const { return accelerationValid(); }
+
     void addLight(const Light& light) {
         lights.push_back(light);
+        markChanged();
     }
 
     HitRecord intersect(const Ray& ray, float tMin = 0.001f, float tMax = 1000.0f) const {
+        HitRecord closestHit = accelerationValid() ? intersectBVH(ray, tMin, tMax)
+                                                   : intersectSpheres(ray, tMin, tMax);
+        intersectOtherGeometry(ray, tMin, closestHit);
+        return closestHit;
+    }
+
+    // Как intersect, но из сфер проверяются только кандидаты, отсортированные
+    // по nearDepth: как только nearDepth не ближе найденного попадания, дальше
+    // искать нечего. Остальная геометрия проверяется полностью.
+    HitRecord intersectCandidates(const Ray& ray, const SphereCandidate* candidates, int count,
+                                  float tMin = 0.001f, float tMax = 1000.0f) const {
         HitRecord closestHit;
         closestHit.t = tMax;
-        closestHit.hit = false;
-
-        for (const auto& sphere : spheres) {
+        for (int i = 0; i < count && candidates[i].nearDepth < closestHit.t; i++) {
+            TRACE_COUNT(sphereTests, 1);
+            const Sphere& sphere = spheres[candidates[i].sphere];
             float t = sphere.intersect(ray);
             if (t > tMin && t < closestHit.t) {
                 closestHit.hit = true;
@@ -54,9 +207,10 @@ public:
                 closestHit.point = ray.pointAt(t);
                 closestHit.normal = sphere.getNormal(closestHit.point);
                 closestHit.material = sphere.material;
+                closestHit.sphere = candidates[i].sphere;
             }
         }
-
+        intersectOtherGeometry(ray, tMin, closestHit);
         return closestHit;
     }
 
@@ -65,9 +219,207 @@ public:
         float lightDistance = (lightPos - point).length();
 
         Ray shadowRay(point, lightDir);
-        HitRecord shadowHit = intersect(shadowRay, 0.001f, lightDistance);
+        TRACE_COUNT(shadowRays, 1);
+        bool occluded;
+        if (accelerationValid()) {
+            occluded = bvh.occluded(shadowRay, 0.001f, lightDistance,
+                                    [&](int prim, float tMin, float tMax) {
+                TRACE_COUNT(sphereTests, 1);
+                float t = spheres[prim].intersect(shadowRay);
+                return t > tMin && t < tMax;
+            });
+        } else {
+            occluded = intersectSpheres(shadowRay, 0.001f, lightDistance).hit;
+        }
+        for (size_t i = 0; i < meshes.size() && !occluded; i++) {
+            occluded = meshes[i].occluded(shadowRay, 0.001f, lightDistance);
+        }
+        if (!occluded && !instances.empty()) {
+            occluded = instancesOccluded(shadowRay, 0.001f, lightDistance);
+        }
+        for (size_t i = 0; i < clouds.size() && !occluded; i++) {
+            occluded = clouds[i]->occluded(shadowRay, 0.001f, lightDistance);
+        }
+
+        if (occluded) TRACE_COUNT(occludedHits, 1);
+        return occluded;
+    }
+
+private:
+    // Сетки, экземпляры и облака после того, как сферы уже дали closestHit
+    void intersectOtherGeometry(const Ray& ray, float tMin, HitRecord& closestHit) const {
+        float sphereT = closestHit.t;
+        if (!meshes.empty()) intersectMeshes(ray, tMin, closestHit);
+        if (!instances.empty()) intersectInstances(ray, tMin, closestHit);
+        for (const auto& cloud : clouds) {
+            float tMax = closestHit.t;
+            cloud->intersect(ray, tMin, tMax, closestHit);
+        }
+        if (closestHit.t != sphereT) closestHit.sphere = -1;
+    }
+
+    AccelUpdate updateSphereAcceleration() {
+        int count = int(spheres.size());
+        bool countChanged = bvh.primitiveCount() != count;
+        if (!countChanged && dirtySpheres.empty()) {
+            return AccelUpdate::None;
+        }
 
-        return shadowHit.hit;
+        // Индексы сфер, удалённых после пометки, уже не существуют
+        dirtySpheres.erase(std::remove_if(dirtySpheres.begin(), dirtySpheres.end(),
+                                          [count](int i) { return i >= count; }),
+                           dirtySpheres.end());
+        sphereBounds.resize(count);
+        if (countChanged) {
+            ThreadPool::shared().parallelFor(0, count, 4096, [&](int begin, int end) {
+                for (int i = begin; i < end; i++) sphereBounds[i] = boundsOf(spheres[i]);
+            });
+        } else if (dirtySpheres.size() * 8 > size_t(count)) {
+            ThreadPool::shared().parallelFor(0, int(dirtySpheres.size()), 4096, [&](int begin, int end) {
+                for (int i = begin; i < end; i++) {
+                    sphereBounds[dirtySpheres[i]] = boundsOf(spheres[dirtySpheres[i]]);
+                }
+            });
+        } else {
+            for (int i : dirtySpheres) sphereBounds[i] = boundsOf(spheres[i]);
+        }
+
+        AccelUpdate result = AccelUpdate::Refit;
+        if (countChanged) {
+            bvh.build(sphereBounds);
+            result = AccelUpdate::Rebuild;
+        } else {
+            bvh.refit(sphereBounds, dirtySpheres);
+            if (bvh.cost() > bvh.buildCost * rebuildThreshold) {
+                bvh.build(sphereBounds);
+                result = AccelUpdate::Rebuild;
+            }
+        }
+
+        for (int i : dirtySpheres) {
+            if (i < int(dirtyFlags.size())) dirtyFlags[i] = 0;
+        }
+        dirtySpheres.clear();
+        return result;
+    }
+
+    AccelUpdate updateInstanceAcceleration() {
+        int count = int(instances.size());
+        bool countChanged = instanceBvh.primitiveCount() != count;
+        if (!countChanged && !instancesDirty) {
+            return AccelUpdate::None;
+        }
+
+        instanceBounds.resize(count);
+        ThreadPool::shared().parallelFor(0, count, 4096, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const Instance& instance = instances[i];
+                instanceBounds[i] = instance.objectToWorld.bounds(groups[instance.group].bounds());
+            }
+        });
+        instancesDirty = false;
+
+        if (countChanged) {
+            instanceBvh.build(instanceBounds);
+            return AccelUpdate::Rebuild;
+        }
+        instanceBvh.refit(instanceBounds);
+        if (instanceBvh.cost() > instanceBvh.buildCost * rebuildThreshold) {
+            instanceBvh.build(instanceBounds);
+            return AccelUpdate::Rebuild;
+        }
+        return AccelUpdate::Refit;
+    }
+
+    void intersectInstances(const Ray& ray, float tMin, HitRecord& closestHit) const {
+        float tMax = closestHit.t;
+        auto hitInstance = [&](int index, float& tFar) {
+            const Instance& instance = instances[index];
+            return instance.intersect(groups[instance.group], ray, tMin, tFar, closestHit);
+        };
+        if (instanceAccelerationValid()) {
+            instanceBvh.intersect(ray, tMin, tMax, hitInstance);
+        } else {
+            for (int i = 0; i < int(instances.size()); i++) hitInstance(i, tMax);
+        }
+    }
+
+    bool instancesOccluded(const Ray& ray, float tMin, float tMax) const {
+        auto blocks = [&](int index, float lo, float hi) {
+            const Instance& instance = instances[index];
+            return instance.occluded(groups[instance.group], ray, lo, hi);
+        };
+        if (instanceAccelerationValid()) {
+            return instanceBvh.occluded(ray, tMin, tMax, blocks);
+        }
+        for (int i = 0; i < int(instances.size()); i++) {
+            if (blocks(i, tMin, tMax)) return true;
+        }
+        return false;
+    }
+
+    HitRecord intersectSpheres(const Ray& ray, float tMin, float tMax) const {
+        HitRecord closestHit;
+        closestHit.t = tMax;
+        closestHit.hit = false;
+
+        TRACE_COUNT(sphereTests, spheres.size());
+        for (int i = 0; i < int(spheres.size()); i++) {
+            const Sphere& sphere = spheres[i];
+            float t = sphere.intersect(ray);
+            if (t > tMin && t < closestHit.t) {
+                closestHit.hit = true;
+                closestHit.t = t;
+                closestHit.point = ray.pointAt(t);
+                closestHit.normal = sphere.getNormal(closestHit.point);
+                closestHit.material = sphere.material;
+                closestHit.sphere = i;
+            }
+        }
+
+        return closestHit;
+    }
+
+    // Уточняет попадание по сеткам: каждая сетка обходится своим BVH,
+    // tMax сужается до уже найденного ближайшего попадания
+    void intersectMeshes(const Ray& ray, float tMin, HitRecord& closestHit) const {
+        float tMax = closestHit.t;
+        for (const Mesh& mesh : meshes) {
+            int triangle = mesh.intersect(ray, tMin, tMax);
+            if (triangle >= 0) {
+                closestHit.hit = true;
+                closestHit.t = tMax;
+                closestHit.point = ray.pointAt(tMax);
+                closestHit.normal = mesh.getNormal(triangle, ray.direction);
+                closestHit.material = mesh.material;
+            }
+        }
+    }
+
+    HitRecord intersectBVH(const Ray& ray, float tMin, float tMax) const {
+        int closest = -1;
+        float closestT = tMax;
+        bvh.intersect(ray, tMin, closestT, [&](int prim, float& tFar) {
+            TRACE_COUNT(sphereTests, 1);
+            float t = spheres[prim].intersect(ray);
+            if (t > tMin && t < tFar) {
+                tFar = t;
+                closest = prim;
+                return true;
+            }
+            return false;
+        });
+
+        HitRecord closestHit;
+        closestHit.t = closestT;
+        if (closest >= 0) {
+            closestHit.hit = true;
+            closestHit.point = ray.pointAt(closestT);
+            closestHit.normal = spheres[closest].getNormal(closestHit.point);
+            closestHit.material = spheres[closest].material;
+            closestHit.sphere = closest;
+        }
+        return closestHit;
     }
 };
 
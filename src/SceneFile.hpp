@@ -0,0 +1,223 @@
+#ifndef SCENEFILE_HPP
+#define SCENEFILE_HPP
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Scene.hpp"
+
+// Текстовое описание сцены, построчно, '#' — комментарий:
+//
+//   background r g b
+//   material <имя> r g b [ambient diffuse specular shininess]
+//   sphere <имя> x y z radius <материал>
+//   light x y z [r g b [intensity]]
+//
+// Сферы именованы: по имени reload() сопоставляет их со сферами живой
+// сцены и трогает только изменившиеся. Материал, изменённый в файле,
+// обновляется у всех сфер, которые на него ссылаются.
+struct SceneDescription {
+    struct SphereEntry {
+        std::string name;
+        Vector3 center;
+        float radius = 1.0f;
+        std::string material;
+    };
+
+    std::map<std::string, Material> materials;
+    std::vector<SphereEntry> spheres;
+    std::vector<Light> lights;
+    Vector3 backgroundColor = Vector3(0.5f, 0.7f, 1.0f);
+};
+
+// Что изменил очередной reload()
+struct SceneReloadStats {
+    int moved = 0;        // изменились центр или радиус
+    int recolored = 0;    // изменился материал
+    int added = 0;
+    int removed = 0;
+    int lightsChanged = 0;
+    bool backgroundChanged = false;
+
+    bool any() const {
+        return moved || recolored || added || removed || lightsChanged || backgroundChanged;
+    }
+};
+
+// Связь файла со сферами и источниками живой сцены. Предполагается, что
+// scene.spheres и scene.lights целиком принадлежат файлу; остальная
+// геометрия (сетки, экземпляры, облака) не трогается.
+class SceneFile {
+public:
+    static bool parse(const std::string& path, SceneDescription& description) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "Failed to open scene file: " << path << std::endl;
+            return false;
+        }
+        return parse(file, path, description);
+    }
+
+    // source — имя для сообщений об ошибках
+    static bool parse(std::istream& file, const std::string& source, SceneDescription& description) {
+        SceneDescription parsed;
+        std::unordered_map<std::string, int> sphereLines;
+        std::string line;
+        for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+            size_t comment = line.find('#');
+            if (comment != std::string::npos) line.erase(comment);
+            std::istringstream in(line);
+            std::string keyword;
+            if (!(in >> keyword)) continue;
+
+            bool ok = true;
+            if (keyword == "background") {
+                ok = readVector(in, parsed.backgroundColor);
+            } else if (keyword == "material") {
+                std::string name;
+                Material material;
+                ok = bool(in >> name) && readVector(in, material.color);
+                if (ok && in >> material.ambient) {
+                    ok = bool(in >> material.diffuse >> material.specular >> material.shininess);
+                }
+                if (ok) parsed.materials[name] = material;
+            } else if (keyword == "sphere") {
+                SceneDescription::SphereEntry sphere;
+                ok = bool(in >> sphere.name) && readVector(in, sphere.center) &&
+                     bool(in >> sphere.radius >> sphere.material);
+                if (ok && !sphereLines.emplace(sphere.name, lineNumber).second) {
+                    std::cerr << source << ":" << lineNumber << ": duplicate sphere '" << sphere.name
+                              << "' (first defined on line " << sphereLines[sphere.name] << ")" << std::endl;
+                    return false;
+                }
+                if (ok) parsed.spheres.push_back(sphere);
+            } else if (keyword == "light") {
+                Light light(Vector3(0, 0, 0));
+                ok = readVector(in, light.position);
+                if (ok && readVector(in, light.color)) in >> light.intensity;
+                if (ok) parsed.lights.push_back(light);
+            } else {
+                std::cerr << source << ":" << lineNumber << ": unknown keyword '" << keyword << "'" << std::endl;
+                return false;
+            }
+            if (!ok) {
+                std::cerr << source << ":" << lineNumber << ": malformed '" << keyword << "' line" << std::endl;
+                return false;
+            }
+        }
+
+        for (const auto& sphere : parsed.spheres) {
+            if (!parsed.materials.count(sphere.material)) {
+                std::cerr << source << ": sphere '" << sphere.name << "' uses unknown material '"
+                          << sphere.material << "'" << std::endl;
+                return false;
+            }
+        }
+        description = std::move(parsed);
+        return true;
+    }
+
+    // Первая загрузка: заменяет сферы и источники сцены содержимым файла
+    bool load(const std::string& path, Scene& scene) {
+        SceneDescription description;
+        if (!parse(path, description)) return false;
+        this->path = path;
+        load(description, scene);
+        return true;
+    }
+
+    void load(const SceneDescription& description, Scene& scene) {
+        scene.spheres.clear();
+        scene.lights.clear();
+        scene.markChanged();
+        sphereNames.clear();
+        apply(description, scene);
+    }
+
+    // Перечитывает файл и применяет разницу к сцене. Если файл не
+    // разбирается (например, редактор ещё пишет его), сцена остаётся как была.
+    bool reload(Scene& scene, SceneReloadStats& stats) {
+        SceneDescription description;
+        if (!parse(path, description)) return false;
+        stats = apply(description, scene);
+        return true;
+    }
+
+    const std::string& filePath() const { return path; }
+
+private:
+    std::string path;
+    // Имя сферы для каждого элемента scene.spheres
+    std::vector<std::string> sphereNames;
+
+    static bool readVector(std::istringstream& in, Vector3& v) {
+        return bool(in >> v.x >> v.y >> v.z);
+    }
+
+    SceneReloadStats apply(const SceneDescription& description, Scene& scene) {
+        SceneReloadStats stats;
+        std::unordered_map<std::string, const SceneDescription::SphereEntry*> wanted;
+        for (const auto& entry : description.spheres) wanted[entry.name] = &entry;
+
+        // Удаление с конца: removeSphere переносит последнюю сферу на место
+        // удалённой, и уже просмотренные индексы не сдвигаются
+        for (size_t i = sphereNames.size(); i-- > 0;) {
+            if (wanted.count(sphereNames[i])) continue;
+            scene.removeSphere(i);
+            sphereNames[i] = sphereNames.back();
+            sphereNames.pop_back();
+            stats.removed++;
+        }
+
+        std::unordered_map<std::string, size_t> existing;
+        for (size_t i = 0; i < sphereNames.size(); i++) existing[sphereNames[i]] = i;
+
+        for (const auto& entry : description.spheres) {
+            const Material& material = description.materials.at(entry.material);
+            auto found = existing.find(entry.name);
+            if (found == existing.end()) {
+                scene.addSphere(Sphere(entry.center, entry.radius, material));
+                sphereNames.push_back(entry.name);
+                stats.added++;
+                continue;
+            }
+            size_t index = found->second;
+            Sphere& sphere = scene.spheres[index];
+            if (!(sphere.center == entry.center) || sphere.radius != entry.radius) {
+                scene.updateSphere(index, entry.center, entry.radius);
+                stats.moved++;
+            }
+            if (!(sphere.material == material)) {
+                sphere.material = material;
+                scene.markChanged();
+                stats.recolored++;
+            }
+        }
+
+        for (size_t i = 0; i < description.lights.size(); i++) {
+            if (i < scene.lights.size() && scene.lights[i] == description.lights[i]) continue;
+            stats.lightsChanged++;
+        }
+        stats.lightsChanged += int(scene.lights.size() > description.lights.size()
+                                   ? scene.lights.size() - description.lights.size() : 0);
+        if (stats.lightsChanged) {
+            scene.lights = description.lights;
+            scene.markChanged();
+        }
+
+        if (!(scene.backgroundColor == description.backgroundColor)) {
+            scene.backgroundColor = description.backgroundColor;
+            scene.markChanged();
+            stats.backgroundChanged = true;
+        }
+
+        scene.updateAccelerationStructure();
+        return stats;
+    }
+};
+
+#endif
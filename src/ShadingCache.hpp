@@ -0,0 +1,170 @@
+#ifndef SHADINGCACHE_HPP
+#define SHADINGCACHE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "Arena.hpp"
+#include "Scene.hpp"
+
+// Кэш независимой от взгляда видимости источников на сферах. Каждая сфера
+// параметризуется по широте и долготе; тексель хранит маску источников,
+// не закрытых из его центра. Тексели заполняются лениво при первом
+// попадании и переживают смену камеры, пока сцена не изменилась
+// (Scene::getRevision), поэтому при облёте статичной сцены теневые лучи
+// для сфер больше не пускаются.
+//
+// Маска берётся из ближайшего текселя, граница тени квантуется с шагом
+// texelSize в мировых единицах. Косинусы для diffuse и specular дёшевы и
+// считаются в точке попадания, иначе освещение шло бы гранями.
+class ShadingCache {
+public:
+    static constexpr int PageSize = 16;
+    // Старший бит маски отмечает заполненный тексель
+    static constexpr int MaxLights = 31;
+    static constexpr float Pi = 3.14159265359f;
+
+    float texelSize = 0.01f;
+    int maxResolution = 1 << 16;  // текселей по долготе на одну сферу
+    // При превышении кэш сбрасывается перед следующим кадром
+    size_t budgetBytes = size_t(256) << 20;
+
+    ShadingCache() = default;
+    ShadingCache(const ShadingCache&) = delete;
+    ShadingCache& operator=(const ShadingCache&) = delete;
+
+    // Вызывается из одного потока перед кадром. Сбрасывает кэш, если сцена
+    // сменилась или изменилась с прошлого кадра либо кэш вырос сверх бюджета.
+    // Память прежнего состояния остаётся в арене и заполняется заново.
+    void prepare(const Scene& scene) {
+        if (validFor(scene) && residentBytes() <= budgetBytes) return;
+        if (scene.lights.size() > size_t(MaxLights)) return;  // тени считаются без кэша
+        cachedScene = &scene;
+        revision = scene.getRevision();
+        layouts.clear();
+        layouts.resize(scene.spheres.size());
+        arena.reset();
+        pageCount.store(0, std::memory_order_relaxed);
+        blockCount.store(0, std::memory_order_relaxed);
+
+        for (size_t i = 0; i < scene.spheres.size(); i++) {
+            float circumference = 2.0f * Pi * scene.spheres[i].radius;
+            int width = int(std::ceil(circumference / texelSize));
+            width = std::clamp(width, 2 * PageSize, maxResolution);
+            SphereLayout& layout = layouts[i];
+            int pagesX = (width + PageSize - 1) / PageSize;
+            int pagesY = (pagesX + 1) / 2;
+            layout.width = pagesX * PageSize;
+            layout.height = pagesY * PageSize;
+            layout.blocksX = (pagesX + BlockSize - 1) / BlockSize;
+            layout.blockSlots = size_t(layout.blocksX) * ((pagesY + BlockSize - 1) / BlockSize);
+            layout.blocks = arena.createArray<std::atomic<Block*>>(layout.blockSlots);
+        }
+    }
+
+    // Кэш подготовлен для этой сцены в её текущем состоянии
+    bool validFor(const Scene& scene) const {
+        return &scene == cachedScene && scene.getRevision() == revision &&
+               layouts.size() == scene.spheres.size() && scene.lights.size() <= size_t(MaxLights);
+    }
+
+    // Маска источников (бит i — lights[i] не закрыт) для сферы sphere в
+    // направлении normal от её центра. Можно вызывать из нескольких потоков:
+    // гонка за пустой тексель безвредна, оба потока запишут одно и то же.
+    uint32_t lightMask(const Scene& scene, int sphere, const Vector3& normal) const {
+        const SphereLayout& layout = layouts[sphere];
+        float phi = std::atan2(normal.z, normal.x);
+        float theta = std::acos(std::clamp(normal.y, -1.0f, 1.0f));
+        int x = std::min(int((phi + Pi) * (0.5f / Pi) * layout.width), layout.width - 1);
+        int y = std::min(int(theta * (1.0f / Pi) * layout.height), layout.height - 1);
+
+        Page* page = pageAt(layout, x / PageSize, y / PageSize);
+        std::atomic<uint32_t>& texel = page->texels[(y % PageSize) * PageSize + x % PageSize];
+        uint32_t value = texel.load(std::memory_order_relaxed);
+        if (value & FilledBit) return value & ~FilledBit;
+
+        uint32_t mask = computeMask(scene, scene.spheres[sphere], layout, x, y);
+        texel.store(mask | FilledBit, std::memory_order_relaxed);
+        return mask;
+    }
+
+    size_t residentBytes() const {
+        return pageCount.load(std::memory_order_relaxed) * sizeof(Page) +
+               blockCount.load(std::memory_order_relaxed) * sizeof(Block);
+    }
+
+private:
+    static constexpr uint32_t FilledBit = 1u << 31;
+
+    struct Page {
+        std::atomic<uint32_t> texels[PageSize * PageSize] = {};
+    };
+
+    // Страницы собраны в блоки BlockSize x BlockSize, чтобы таблица страниц
+    // большой сферы (пол сцены) не занимала память там, куда никто не смотрит
+    static constexpr int BlockSize = 16;
+
+    struct Block {
+        std::atomic<Page*> pages[BlockSize * BlockSize] = {};
+    };
+
+    struct SphereLayout {
+        int width = 0, height = 0;
+        int blocksX = 0;
+        size_t blockSlots = 0;
+        std::atomic<Block*>* blocks = nullptr;  // в arena
+    };
+
+    const Scene* cachedScene = nullptr;
+    unsigned long long revision = 0;
+    std::vector<SphereLayout> layouts;
+    mutable std::atomic<size_t> pageCount{0};
+    mutable std::atomic<size_t> blockCount{0};
+    // Блоки и страницы; выделение под arenaMutex, чтение — без блокировки
+    mutable Arena arena{size_t(4) << 20};
+    mutable std::mutex arenaMutex;
+
+    // Блоки и страницы создаются при первом обращении. Новые страницы
+    // появляются редко по сравнению с чтениями, поэтому хватает мьютекса.
+    template <typename T>
+    T* acquire(std::atomic<T*>& slot, bool& created) const {
+        T* existing = slot.load(std::memory_order_acquire);
+        created = false;
+        if (existing) return existing;
+        std::lock_guard<std::mutex> lock(arenaMutex);
+        existing = slot.load(std::memory_order_relaxed);
+        if (existing) return existing;
+        T* fresh = arena.create<T>();
+        slot.store(fresh, std::memory_order_release);
+        created = true;
+        return fresh;
+    }
+
+    Page* pageAt(const SphereLayout& layout, int px, int py) const {
+        bool created;
+        Block* block = acquire(layout.blocks[size_t(py / BlockSize) * layout.blocksX + px / BlockSize], created);
+        if (created) blockCount.fetch_add(1, std::memory_order_relaxed);
+        Page* page = acquire(block->pages[(py % BlockSize) * BlockSize + px % BlockSize], created);
+        if (created) pageCount.fetch_add(1, std::memory_order_relaxed);
+        return page;
+    }
+
+    static uint32_t computeMask(const Scene& scene, const Sphere& sphere, const SphereLayout& layout,
+                                int x, int y) {
+        float phi = (float(x) + 0.5f) / float(layout.width) * 2.0f * Pi - Pi;
+        float theta = (float(y) + 0.5f) / float(layout.height) * Pi;
+        Vector3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+        Vector3 point = sphere.center + normal * sphere.radius;
+
+        uint32_t mask = 0;
+        for (size_t i = 0; i < scene.lights.size(); i++) {
+            if (!scene.isInShadow(point, scene.lights[i].position)) mask |= 1u << i;
+        }
+        return mask;
+    }
+};
+
+#endif
@@ -19,6 +19,22 @@ struct Material {
              float shininess = 32.0f)
             : color(color), ambient(ambient), diffuse(diffuse),
               specular(specular), shininess(shininess) {}
+
+    bool operator==(const Material& m) const {
+        return color == m.color && ambient == m.ambient && diffuse == m.diffuse &&
+               specular == m.specular && shininess == m.shininess;
+    }
+};
+
+struct HitRecord {
+    float t;
+    Vector3 point;
+    Vector3 normal;
+    Material material;
+    bool hit;
+    int sphere;  // индекс в Scene::spheres или -1 для остальной геометрии
+
+    HitRecord() : t(-1.0f), hit(false), sphere(-1) {}
 };
 
 class Sphere {
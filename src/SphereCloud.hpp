@@ -0,0 +1,638 @@
+#ifndef SPHERECLOUD_HPP
+#define SPHERECLOUD_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Vector3.hpp"
+#include "Ray.hpp"
+#include "Sphere.hpp"
+#include "BVH.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+// Облако из сотен миллионов сфер, которое не помещается в память целиком.
+//
+// Сферы хранятся 16-байтными записями (центр + радиус и индекс материала
+// по 16 бит) и группируются в кластеры по коду Мортона. У каждого кластера
+// свой 8-арный BVH с квантованными до байта границами детей; такой же BVH
+// над кластерами лежит в памяти постоянно. Данные кластеров читаются из
+// отображённого файла по требованию в кэш фиксированного размера (LRU),
+// а страницы отображения сразу отпускаются, поэтому резидентная память
+// ограничена бюджетом кэша, а не размером набора данных.
+
+// Запись сферы: радиус квантован относительно maxRadius кластера (с округлением вверх)
+struct CloudSphere {
+    float x, y, z;
+    uint16_t radius;
+    uint16_t material;
+};
+static_assert(sizeof(CloudSphere) == 16, "CloudSphere must stay 16 bytes");
+
+// Узел 8-арного BVH. Границы ребёнка i по оси a:
+// origin[a] + q{lo,hi}[a][i] * 2^exponent[a]. Ребёнок — либо индекс узла,
+// либо лист (LeafFlag | count << 24 | first) с диапазоном записей.
+struct WideNode {
+    float origin[3];
+    int8_t exponent[3];
+    uint8_t childCount;
+    uint8_t qlo[3][8];
+    uint8_t qhi[3][8];
+    uint32_t child[8];
+
+    static constexpr uint32_t LeafFlag = 0x80000000u;
+
+    static bool isLeaf(uint32_t child) { return (child & LeafFlag) != 0; }
+    static uint32_t leafFirst(uint32_t child) { return child & 0xFFFFFFu; }
+    static uint32_t leafCount(uint32_t child) { return (child >> 24) & 0x7Fu; }
+    static uint32_t makeLeaf(uint32_t first, uint32_t count) { return LeafFlag | (count << 24) | first; }
+};
+static_assert(sizeof(WideNode) == 96, "WideNode layout changed");
+
+class SphereCloud {
+public:
+    // Исходная сфера для записи файла
+    struct Source {
+        Vector3 center;
+        float radius;
+        uint16_t material;
+    };
+
+    static constexpr int ClusterSize = 4096;
+
+    // Пишет облако в файл: сортировка по Мортону, нарезка на кластеры,
+    // BVH каждого кластера строится параллельно
+    static bool write(const std::string& path, std::vector<Source> spheres,
+                      const std::vector<Material>& palette) {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open cloud file: " << path << std::endl;
+            return false;
+        }
+
+        sortByMorton(spheres);
+
+        size_t clusterCount = (spheres.size() + ClusterSize - 1) / ClusterSize;
+        std::vector<std::vector<char>> blobs(clusterCount);
+        std::vector<ClusterEntry> entries(clusterCount);
+        ThreadPool::shared().parallelFor(0, int(clusterCount), 1, [&](int begin, int end) {
+            for (int c = begin; c < end; c++) {
+                size_t first = size_t(c) * ClusterSize;
+                size_t count = std::min<size_t>(ClusterSize, spheres.size() - first);
+                buildCluster(spheres.data() + first, count, entries[c], blobs[c]);
+            }
+        });
+
+        // Верхний уровень над кластерами; порядок таблицы следует листам дерева
+        std::vector<AABB> clusterBounds(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) clusterBounds[c] = entries[c].box();
+        BVH top;
+        top.build(clusterBounds);
+        std::vector<WideNode> topNodes;
+        if (!top.isEmpty()) collapse(top, 0, topNodes);
+
+        Header header;
+        header.sphereCount = spheres.size();
+        header.clusterCount = uint32_t(clusterCount);
+        header.topNodeCount = uint32_t(topNodes.size());
+        header.paletteCount = uint32_t(palette.size());
+        header.paletteOffset = sizeof(Header);
+        header.topNodesOffset = header.paletteOffset + palette.size() * sizeof(PaletteEntry);
+        header.clusterTableOffset = header.topNodesOffset + topNodes.size() * sizeof(WideNode);
+        uint64_t offset = align(header.clusterTableOffset + clusterCount * sizeof(ClusterEntry));
+
+        std::vector<ClusterEntry> table(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+            table[c] = entries[top.primIndices[c]];
+            table[c].offset = offset;
+            offset = align(offset + blobs[top.primIndices[c]].size());
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const auto& material : palette) {
+            PaletteEntry entry = {material.color.x, material.color.y, material.color.z, material.ambient,
+                                  material.diffuse, material.specular, material.shininess, 0.0f};
+            file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        }
+        file.write(reinterpret_cast<const char*>(topNodes.data()), topNodes.size() * sizeof(WideNode));
+        file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(ClusterEntry));
+        for (size_t c = 0; c < clusterCount; c++) {
+            pad(file);
+            const std::vector<char>& blob = blobs[top.primIndices[c]];
+            file.write(blob.data(), blob.size());
+        }
+        pad(file);
+        if (!file) {
+            std::cerr << "Failed to write cloud file: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // cacheBytes — бюджет кэша кластеров
+    bool open(const std::string& path, size_t cacheBytes = size_t(256) << 20) {
+        if (!file.open(path, false)) return false;
+        if (file.size() < sizeof(Header)) {
+            std::cerr << "Not a sphere cloud file: " << path << std::endl;
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(Header));
+        if (std::memcmp(header.magic, "SPHC", 4) != 0 || header.version != 1 ||
+            header.clusterTableOffset + uint64_t(header.clusterCount) * sizeof(ClusterEntry) > file.size()) {
+            std::cerr << "Not a sphere cloud file: " << path << std::endl;
+            return false;
+        }
+
+        // Палитра, верхний BVH и таблица кластеров малы и копируются целиком
+        palette.clear();
+        for (uint32_t i = 0; i < header.paletteCount; i++) {
+            PaletteEntry entry;
+            std::memcpy(&entry, file.data() + header.paletteOffset + i * sizeof(PaletteEntry), sizeof(entry));
+            palette.push_back(Material(Vector3(entry.color[0], entry.color[1], entry.color[2]),
+                                       entry.ambient, entry.diffuse, entry.specular, entry.shininess));
+        }
+        if (palette.empty()) palette.push_back(Material());
+        topNodes.resize(header.topNodeCount);
+        std::memcpy(topNodes.data(), file.data() + header.topNodesOffset, topNodes.size() * sizeof(WideNode));
+        clusters.resize(header.clusterCount);
+        std::memcpy(clusters.data(), file.data() + header.clusterTableOffset,
+                    clusters.size() * sizeof(ClusterEntry));
+        for (const auto& cluster : clusters) {
+            if (cluster.offset + cluster.byteSize() > file.size()) {
+                std::cerr << "Truncated sphere cloud file: " << path << std::endl;
+                return false;
+            }
+        }
+
+        cache.reset(cacheBytes);
+        // Всё нужное скопировано, отображённые страницы можно отдать
+        file.release(0, file.size());
+        return true;
+    }
+
+    uint64_t sphereCount() const { return header.sphereCount; }
+    size_t clusterCount() const { return clusters.size(); }
+    size_t residentBytes() const { return cache.bytes(); }
+    uint64_t cacheHits() const { return cache.hits; }
+    uint64_t cacheMisses() const { return cache.misses; }
+
+    AABB bounds() const {
+        AABB box;
+        for (const auto& cluster : clusters) box.grow(cluster.box());
+        return box;
+    }
+
+    // Файл облака кусками по порядку; прочитанные страницы сразу отдаются,
+    // так что пройти можно и облако больше памяти (отпечатки содержимого)
+    template <typename Fn>
+    void forEachFileChunk(Fn&& fn) const {
+        const size_t chunk = size_t(64) << 20;
+        for (size_t offset = 0; offset < file.size(); offset += chunk) {
+            size_t count = std::min(chunk, file.size() - offset);
+            fn(file.data() + offset, count);
+            file.release(offset, count);
+        }
+    }
+
+    // Ближайшее попадание на (tMin, tMax); при успехе сужает tMax и заполняет hit
+    bool intersect(const Ray& ray, float tMin, float& tMax, HitRecord& hit) const {
+        int hitCluster = -1;
+        CloudSphere hitSphere = {};
+        float hitRadius = 0.0f;
+        traverse(ray, tMin, tMax, topNodes.data(), [&](uint32_t first, uint32_t count) {
+            for (uint32_t c = first; c < first + count; c++) {
+                const ClusterEntry& entry = clusters[c];
+                if (entry.box().intersect(ray, invDirection(ray), tMin, tMax) == FLT_MAX) continue;
+                std::shared_ptr<const Cluster> cluster = acquire(c);
+                traverse(ray, tMin, tMax, cluster->nodes.data(), [&](uint32_t sphereFirst, uint32_t sphereCount) {
+                    for (uint32_t i = sphereFirst; i < sphereFirst + sphereCount; i++) {
+                        const CloudSphere& sphere = cluster->spheres[i];
+                        float radius = decodeRadius(sphere, entry.maxRadius);
+                        float t = intersectSphere(ray, sphere, radius, tMin, tMax);
+                        if (t < tMax) {
+                            tMax = t;
+                            hitCluster = int(c);
+                            hitSphere = sphere;
+                            hitRadius = radius;
+                        }
+                    }
+                    return false;
+                });
+            }
+            return false;
+        });
+        if (hitCluster < 0) return false;
+
+        hit.hit = true;
+        hit.t = tMax;
+        hit.point = ray.pointAt(tMax);
+        hit.normal = (hit.point - Vector3(hitSphere.x, hitSphere.y, hitSphere.z)) / hitRadius;
+        hit.material = palette[std::min<size_t>(hitSphere.material, palette.size() - 1)];
+        return true;
+    }
+
+    bool occluded(const Ray& ray, float tMin, float tMax) const {
+        return traverse(ray, tMin, tMax, topNodes.data(), [&](uint32_t first, uint32_t count) {
+            for (uint32_t c = first; c < first + count; c++) {
+                const ClusterEntry& entry = clusters[c];
+                if (entry.box().intersect(ray, invDirection(ray), tMin, tMax) == FLT_MAX) continue;
+                std::shared_ptr<const Cluster> cluster = acquire(c);
+                bool blocked = traverse(ray, tMin, tMax, cluster->nodes.data(), [&](uint32_t sphereFirst,
+                                                                                   uint32_t sphereCount) {
+                    for (uint32_t i = sphereFirst; i < sphereFirst + sphereCount; i++) {
+                        const CloudSphere& sphere = cluster->spheres[i];
+                        if (intersectSphere(ray, sphere, decodeRadius(sphere, entry.maxRadius),
+                                            tMin, tMax) < tMax) {
+                            return true;
+                        }
+                    }
+                    return false;
+                });
+                if (blocked) return true;
+            }
+            return false;
+        });
+    }
+
+private:
+    struct Header {
+        char magic[4] = {'S', 'P', 'H', 'C'};
+        uint32_t version = 1;
+        uint64_t sphereCount = 0;
+        uint32_t clusterCount = 0;
+        uint32_t topNodeCount = 0;
+        uint32_t paletteCount = 0;
+        uint32_t reserved = 0;
+        uint64_t paletteOffset = 0;
+        uint64_t topNodesOffset = 0;
+        uint64_t clusterTableOffset = 0;
+    };
+
+    struct PaletteEntry {
+        float color[3];
+        float ambient, diffuse, specular, shininess;
+        float reserved;
+    };
+
+    struct ClusterEntry {
+        uint64_t offset;
+        uint32_t nodeCount;
+        uint32_t sphereCount;
+        float maxRadius;
+        float lo[3];
+        float hi[3];
+        uint32_t reserved;
+
+        AABB box() const { return AABB(Vector3(lo[0], lo[1], lo[2]), Vector3(hi[0], hi[1], hi[2])); }
+        size_t byteSize() const { return nodeCount * sizeof(WideNode) + sphereCount * sizeof(CloudSphere); }
+    };
+
+    struct Cluster {
+        std::vector<WideNode> nodes;
+        std::vector<CloudSphere> spheres;
+
+        size_t byteSize() const {
+            return nodes.size() * sizeof(WideNode) + spheres.size() * sizeof(CloudSphere) + sizeof(Cluster);
+        }
+    };
+
+    // LRU-кэш кластеров, разбитый на шарды по индексу, чтобы потоки
+    // рендера реже делили один мьютекс. Вытесненный кластер живёт, пока
+    // его держит хоть один луч, так что превышение бюджета ограничено
+    // числом потоков.
+    class ClusterCache {
+    public:
+        mutable std::atomic<uint64_t> hits{0};
+        mutable std::atomic<uint64_t> misses{0};
+
+        void reset(size_t budget) {
+            for (auto& shard : shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.entries.clear();
+                shard.order.clear();
+                shard.bytes = 0;
+                shard.budget = std::max<size_t>(1, budget / ShardCount);
+            }
+            hits = 0;
+            misses = 0;
+        }
+
+        std::shared_ptr<const Cluster> find(uint32_t index) const {
+            Shard& shard = shards[index % ShardCount];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entries.find(index);
+            if (it == shard.entries.end()) return nullptr;
+            shard.order.splice(shard.order.begin(), shard.order, it->second.position);
+            hits++;
+            return it->second.cluster;
+        }
+
+        std::shared_ptr<const Cluster> insert(uint32_t index, std::shared_ptr<const Cluster> cluster) const {
+            Shard& shard = shards[index % ShardCount];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            misses++;
+            auto it = shard.entries.find(index);
+            if (it != shard.entries.end()) return it->second.cluster;  // загрузил другой поток
+
+            shard.order.push_front(index);
+            shard.entries[index] = {cluster, shard.order.begin()};
+            shard.bytes += cluster->byteSize();
+            while (shard.bytes > shard.budget && shard.order.size() > 1) {
+                uint32_t victim = shard.order.back();
+                shard.order.pop_back();
+                auto entry = shard.entries.find(victim);
+                shard.bytes -= entry->second.cluster->byteSize();
+                shard.entries.erase(entry);
+            }
+            return cluster;
+        }
+
+        size_t bytes() const {
+            size_t total = 0;
+            for (auto& shard : shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                total += shard.bytes;
+            }
+            return total;
+        }
+
+    private:
+        static constexpr int ShardCount = 16;
+
+        struct Entry {
+            std::shared_ptr<const Cluster> cluster;
+            std::list<uint32_t>::iterator position;
+        };
+
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_map<uint32_t, Entry> entries;
+            std::list<uint32_t> order;
+            size_t bytes = 0;
+            size_t budget = 1;
+        };
+
+        mutable Shard shards[ShardCount];
+    };
+
+    MappedFile file;
+    Header header;
+    std::vector<Material> palette;
+    std::vector<WideNode> topNodes;
+    std::vector<ClusterEntry> clusters;
+    ClusterCache cache;
+
+    std::shared_ptr<const Cluster> acquire(uint32_t index) const {
+        if (auto cluster = cache.find(index)) return cluster;
+
+        const ClusterEntry& entry = clusters[index];
+        auto cluster = std::make_shared<Cluster>();
+        cluster->nodes.resize(entry.nodeCount);
+        cluster->spheres.resize(entry.sphereCount);
+        const char* source = file.data() + entry.offset;
+        std::memcpy(cluster->nodes.data(), source, entry.nodeCount * sizeof(WideNode));
+        std::memcpy(cluster->spheres.data(), source + entry.nodeCount * sizeof(WideNode),
+                    entry.sphereCount * sizeof(CloudSphere));
+        file.release(entry.offset, entry.byteSize());
+        return cache.insert(index, std::move(cluster));
+    }
+
+    static Vector3 invDirection(const Ray& ray) {
+        return Vector3(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+    }
+
+    static float decodeRadius(const CloudSphere& sphere, float maxRadius) {
+        return float(sphere.radius) * (maxRadius / 65535.0f);
+    }
+
+    // Расстояние до сферы на (tMin, tMax) или tMax при промахе; направление луча единичное
+    static float intersectSphere(const Ray& ray, const CloudSphere& sphere, float radius,
+                                 float tMin, float tMax) {
+        // Дискриминант через расстояние от центра до прямой луча: без
+        // вычитания близких больших чисел, важно для мелких далёких сфер
+        Vector3 oc = ray.origin - Vector3(sphere.x, sphere.y, sphere.z);
+        float b = oc.dot(ray.direction);
+        Vector3 offset = oc - ray.direction * b;
+        float discriminant = radius * radius - offset.dot(offset);
+        if (discriminant < 0.0f) return tMax;
+        float root = std::sqrt(discriminant);
+        float t = -b - root;
+        if (t <= tMin) t = -b + root;
+        return t > tMin && t < tMax ? t : tMax;
+    }
+
+    // Обход 8-арного дерева от корня nodes[0]: дети упорядочиваются по
+    // расстоянию входа, leafFn(first, count) вызывается для листов и может
+    // вернуть true, чтобы прервать обход (для теневых лучей)
+    template <typename LeafFn>
+    static bool traverse(const Ray& ray, float tMin, const float& tMax, const WideNode* nodes,
+                         LeafFn&& leafFn) {
+        if (!nodes) return false;
+        Vector3 invDir = invDirection(ray);
+        const float origin[3] = {ray.origin.x, ray.origin.y, ray.origin.z};
+        const float inv[3] = {invDir.x, invDir.y, invDir.z};
+
+        struct Entry {
+            uint32_t child;
+            float t;
+        };
+        Entry stack[256];
+        int stackSize = 0;
+        stack[stackSize++] = {0, tMin};
+
+        while (stackSize > 0) {
+            Entry entry = stack[--stackSize];
+            if (entry.t >= tMax) continue;
+            if (WideNode::isLeaf(entry.child)) {
+                if (leafFn(WideNode::leafFirst(entry.child), WideNode::leafCount(entry.child))) return true;
+                continue;
+            }
+
+            const WideNode& node = nodes[entry.child];
+            float scale[3];
+            for (int a = 0; a < 3; a++) scale[a] = std::ldexp(1.0f, node.exponent[a]);
+
+            Entry hits[8];
+            int hitCount = 0;
+            for (int i = 0; i < node.childCount; i++) {
+                float tNear = tMin, tFar = tMax;
+                for (int a = 0; a < 3; a++) {
+                    float lo = node.origin[a] + float(node.qlo[a][i]) * scale[a];
+                    float hi = node.origin[a] + float(node.qhi[a][i]) * scale[a];
+                    float t1 = (lo - origin[a]) * inv[a];
+                    float t2 = (hi - origin[a]) * inv[a];
+                    tNear = std::max(tNear, std::min(t1, t2));
+                    tFar = std::min(tFar, std::max(t1, t2));
+                }
+                if (tNear <= tFar) {
+                    // Вставка по убыванию: ближайший ребёнок окажется на вершине стека
+                    int k = hitCount++;
+                    while (k > 0 && hits[k - 1].t < tNear) {
+                        hits[k] = hits[k - 1];
+                        k--;
+                    }
+                    hits[k] = {node.child[i], tNear};
+                }
+            }
+            for (int i = 0; i < hitCount; i++) stack[stackSize++] = hits[i];
+        }
+        return false;
+    }
+
+    static uint64_t align(uint64_t offset) { return (offset + 15) & ~uint64_t(15); }
+
+    static void pad(std::ofstream& file) {
+        static const char zeros[16] = {};
+        uint64_t position = uint64_t(file.tellp());
+        file.write(zeros, std::streamsize(align(position) - position));
+    }
+
+    static uint32_t expandBits(uint32_t v) {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    static void sortByMorton(std::vector<Source>& spheres) {
+        AABB box;
+        for (const auto& sphere : spheres) box.grow(sphere.center);
+        Vector3 extent = box.max - box.min;
+        float size = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+
+        std::vector<std::pair<uint32_t, uint32_t>> keys(spheres.size());
+        ThreadPool::shared().parallelFor(0, int(spheres.size()), 65536, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                Vector3 p = (spheres[i].center - box.min) / size;
+                uint32_t x = uint32_t(std::min(1023.0f, std::max(0.0f, p.x * 1024.0f)));
+                uint32_t y = uint32_t(std::min(1023.0f, std::max(0.0f, p.y * 1024.0f)));
+                uint32_t z = uint32_t(std::min(1023.0f, std::max(0.0f, p.z * 1024.0f)));
+                keys[i] = {(expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z), uint32_t(i)};
+            }
+        });
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<Source> sorted(spheres.size());
+        for (size_t i = 0; i < keys.size(); i++) sorted[i] = spheres[keys[i].second];
+        spheres.swap(sorted);
+    }
+
+    static void buildCluster(const Source* spheres, size_t count, ClusterEntry& entry, std::vector<char>& blob) {
+        std::vector<AABB> bounds(count);
+        AABB box;
+        float maxRadius = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            Vector3 r(spheres[i].radius, spheres[i].radius, spheres[i].radius);
+            bounds[i] = AABB(spheres[i].center - r, spheres[i].center + r);
+            box.grow(bounds[i]);
+            maxRadius = std::max(maxRadius, spheres[i].radius);
+        }
+        if (maxRadius <= 0.0f) maxRadius = 1.0f;
+
+        BVH bvh;
+        bvh.build(bounds);
+        std::vector<WideNode> nodes;
+        collapse(bvh, 0, nodes);
+
+        // Записи в порядке листьев дерева, чтобы лист был непрерывным диапазоном
+        std::vector<CloudSphere> records(count);
+        for (size_t i = 0; i < count; i++) {
+            const Source& source = spheres[bvh.primIndices[i]];
+            float q = std::ceil(source.radius / maxRadius * 65535.0f);
+            records[i] = {source.center.x, source.center.y, source.center.z,
+                          uint16_t(std::min(65535.0f, std::max(0.0f, q))), source.material};
+        }
+
+        entry = ClusterEntry();
+        entry.nodeCount = uint32_t(nodes.size());
+        entry.sphereCount = uint32_t(count);
+        entry.maxRadius = maxRadius;
+        // Квантование радиуса вверх может чуть раздуть сферы, расширяем бокс с запасом
+        float margin = maxRadius / 65535.0f;
+        entry.lo[0] = box.min.x - margin; entry.lo[1] = box.min.y - margin; entry.lo[2] = box.min.z - margin;
+        entry.hi[0] = box.max.x + margin; entry.hi[1] = box.max.y + margin; entry.hi[2] = box.max.z + margin;
+
+        blob.resize(entry.byteSize());
+        std::memcpy(blob.data(), nodes.data(), nodes.size() * sizeof(WideNode));
+        std::memcpy(blob.data() + nodes.size() * sizeof(WideNode), records.data(), count * sizeof(CloudSphere));
+    }
+
+    // Сворачивает двоичный BVH в 8-арный: у каждого узла раскрываем ребёнка
+    // с наибольшей площадью, пока детей меньше восьми. Листья двоичного
+    // дерева становятся листами-диапазонами primIndices.
+    static uint32_t collapse(const BVH& bvh, int binaryIndex, std::vector<WideNode>& out) {
+        uint32_t wideIndex = uint32_t(out.size());
+        out.emplace_back();
+
+        std::vector<int> children;
+        const BVHNode& root = bvh.nodes[binaryIndex];
+        if (root.isLeaf()) {
+            children.push_back(binaryIndex);
+        } else {
+            children.push_back(root.leftFirst);
+            children.push_back(root.leftFirst + 1);
+        }
+        while (children.size() < 8) {
+            int best = -1;
+            float bestArea = -1.0f;
+            for (size_t i = 0; i < children.size(); i++) {
+                const BVHNode& node = bvh.nodes[children[i]];
+                if (!node.isLeaf() && node.bounds.surfaceArea() > bestArea) {
+                    bestArea = node.bounds.surfaceArea();
+                    best = int(i);
+                }
+            }
+            if (best < 0) break;
+            int expanded = children[best];
+            children[best] = bvh.nodes[expanded].leftFirst;
+            children.push_back(bvh.nodes[expanded].leftFirst + 1);
+        }
+
+        AABB box = root.bounds;
+        WideNode node = {};
+        node.childCount = uint8_t(children.size());
+        const float lo[3] = {box.min.x, box.min.y, box.min.z};
+        const float hi[3] = {box.max.x, box.max.y, box.max.z};
+        for (int a = 0; a < 3; a++) {
+            node.origin[a] = lo[a];
+            int exponent = int(std::ceil(std::log2(std::max((hi[a] - lo[a]) / 255.0f, 1e-30f))));
+            node.exponent[a] = int8_t(std::max(-127, std::min(127, exponent)));
+        }
+
+        for (size_t i = 0; i < children.size(); i++) {
+            const BVHNode& child = bvh.nodes[children[i]];
+            const float clo[3] = {child.bounds.min.x, child.bounds.min.y, child.bounds.min.z};
+            const float chi[3] = {child.bounds.max.x, child.bounds.max.y, child.bounds.max.z};
+            for (int a = 0; a < 3; a++) {
+                float scale = std::ldexp(1.0f, node.exponent[a]);
+                float qlo = std::floor((clo[a] - node.origin[a]) / scale);
+                float qhi = std::ceil((chi[a] - node.origin[a]) / scale);
+                // Проверяем округление в том же виде, в каком границы декодирует обход
+                while (qlo > 0.0f && node.origin[a] + qlo * scale > clo[a]) qlo -= 1.0f;
+                while (qhi < 255.0f && node.origin[a] + qhi * scale < chi[a]) qhi += 1.0f;
+                node.qlo[a][i] = uint8_t(std::max(0.0f, std::min(255.0f, qlo)));
+                node.qhi[a][i] = uint8_t(std::max(0.0f, std::min(255.0f, qhi)));
+            }
+            if (child.isLeaf()) {
+                node.child[i] = WideNode::makeLeaf(uint32_t(child.leftFirst), uint32_t(child.count));
+            } else {
+                node.child[i] = collapse(bvh, children[i], out);
+            }
+        }
+        out[wideIndex] = node;
+        return wideIndex;
+    }
+};
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "NumaTopology.hpp"
+
+// Пул рабочих потоков с общей очередью задач.
+// parallelFor делит диапазон на чанки, вызывающий поток тоже участвует в работе,
+// поэтому вложенные и одновременные вызовы из разных потоков не блокируют друг друга.
+//
+// После pinToNodes воркеры закреплены за ядрами узлов NUMA, и parallelForNodes
+// раздаёт каждому узлу свою часть диапазона: поток сначала разбирает чанки
+// своего узла и только потом доделывает чужие.
+class ThreadPool {
+private:
+    // Часть диапазона одного узла. Счётчики узлов в разных кэш-линиях, чтобы
+    // узлы не гоняли одну линию через межпроцессорную шину.
+    struct alignas(64) Partition {
+        int begin = 0, end = 0, chunkCount = 0;
+        std::atomic<int> nextChunk{0};
+    };
+
+    // Общее состояние одного вызова parallelFor. Живёт на стеке вызывающего:
+    // перед возвратом он снимает из очереди не начатые задачи помощников и
+    // ждёт запущенные, поэтому установившийся цикл кадра не выделяет память.
+    struct Job {
+        void (*invoke)(const void*, int, int) = nullptr;
+        const void* function = nullptr;
+        int grain = 1, chunkCount = 0;
+        int partitionCount = 1;
+        Partition partitions[NumaTopology::MaxNodes];
+        int outstandingHelpers = 0;  // под doneMutex
+        std::mutex doneMutex;
+        std::condition_variable doneCondition;
+
+        // Сначала своя часть home, затем остальные по порядку
+        void runChunks(int home) {
+            for (int k = 0; k < partitionCount; k++) {
+                Partition& partition = partitions[(home + k) % partitionCount];
+                for (;;) {
+                    int chunk = partition.nextChunk.fetch_add(1);
+                    if (chunk >= partition.chunkCount) break;
+                    int chunkBegin = partition.begin + chunk * grain;
+                    invoke(function, chunkBegin, std::min(partition.end, chunkBegin + grain));
+                }
+            }
+        }
+    };
+
+    // Элемент очереди: либо произвольная задача submit, либо помощник parallelFor
+    struct Task {
+        std::function<void()> function;
+        Job* job = nullptr;
+    };
+
+    std::vector<std::thread> workers;
+    // Кольцевой буфер: после прогрева ёмкость больше не меняется
+    std::vector<Task> tasks;
+    size_t taskHead = 0;
+    size_t taskCount = 0;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+    // Узел каждого воркера после pinToNodes; пусто — пул не закреплён
+    const NumaTopology* topology = nullptr;
+    std::vector<int> workerNodes;
+
+    static int& currentWorkerIndex() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    // Вызывается под mutex
+    void pushTask(Task&& task) {
+        if (taskCount == tasks.size()) {
+            std::vector<Task> grown(std::max<size_t>(16, tasks.size() * 2));
+            for (size_t i = 0; i < taskCount; i++) grown[i] = std::move(tasks[(taskHead + i) % tasks.size()]);
+            tasks.swap(grown);
+            taskHead = 0;
+        }
+        tasks[(taskHead + taskCount) % tasks.size()] = std::move(task);
+        taskCount++;
+    }
+
+    // Общая часть parallelFor и parallelForNodes: partitionCount частей,
+    // часть i — [bounds[i], bounds[i + 1])
+    template <typename Fn>
+    void run(const int* bounds, int partitionCount, int grain, const Fn& fn) {
+        if (bounds[partitionCount] <= bounds[0]) return;
+        grain = std::max(1, grain);
+
+        Job job;
+        job.grain = grain;
+        job.partitionCount = partitionCount;
+        for (int i = 0; i < partitionCount; i++) {
+            Partition& partition = job.partitions[i];
+            partition.begin = bounds[i];
+            partition.end = std::max(bounds[i], bounds[i + 1]);
+            partition.chunkCount = (partition.end - partition.begin + grain - 1) / grain;
+            job.chunkCount += partition.chunkCount;
+        }
+
+        if (job.chunkCount == 1 || workers.empty()) {
+            for (int i = 0; i < partitionCount; i++) {
+                if (bounds[i + 1] > bounds[i]) fn(bounds[i], bounds[i + 1]);
+            }
+            return;
+        }
+
+        job.invoke = [](const void* function, int chunkBegin, int chunkEnd) {
+            (*static_cast<const Fn*>(function))(chunkBegin, chunkEnd);
+        };
+        job.function = &fn;
+
+        int helpers = std::min(int(workers.size()), job.chunkCount - 1);
+        job.outstandingHelpers = helpers;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int i = 0; i < helpers; i++) pushTask(Task{{}, &job});
+        }
+        if (helpers == 1) condition.notify_one();
+        else condition.notify_all();
+
+        job.runChunks(currentNode() % partitionCount);
+
+        // Помощники, так и не взятые воркерами, больше не нужны: все чанки
+        // уже разобраны. Остаётся дождаться тех, что ещё выполняют свои.
+        int cancelled = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t kept = 0;
+            for (size_t i = 0; i < taskCount; i++) {
+                Task& task = tasks[(taskHead + i) % tasks.size()];
+                if (task.job == &job) {
+                    cancelled++;
+                    continue;
+                }
+                if (kept != i) tasks[(taskHead + kept) % tasks.size()] = std::move(task);
+                kept++;
+            }
+            for (size_t i = kept; i < taskCount; i++) tasks[(taskHead + i) % tasks.size()] = Task();
+            taskCount = kept;
+        }
+
+        std::unique_lock<std::mutex> lock(job.doneMutex);
+        job.outstandingHelpers -= cancelled;
+        job.doneCondition.wait(lock, [&] { return job.outstandingHelpers == 0; });
+    }
+
+    void workerLoop(int index) {
+        currentWorkerIndex() = index;
+        for (;;) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return stopping || taskCount > 0; });
+                if (stopping && taskCount == 0) return;
+                task = std::move(tasks[taskHead]);
+                taskHead = (taskHead + 1) % tasks.size();
+                taskCount--;
+            }
+            if (task.job) {
+                task.job->runChunks(currentNode() % task.job->partitionCount);
+                std::lock_guard<std::mutex> lock(task.job->doneMutex);
+                task.job->outstandingHelpers--;
+                task.job->doneCondition.notify_all();
+            } else {
+                task.function();
+            }
+        }
+    }
+
+public:
+    explicit ThreadPool(unsigned threadCount = std::thread::hardware_concurrency()) {
+        if (threadCount == 0) threadCount = 1;
+        // Вызывающий поток тоже выполняет чанки, поэтому отдельных воркеров на один меньше
+        for (unsigned i = 0; i + 1 < threadCount; i++) {
+            workers.emplace_back(&ThreadPool::workerLoop, this, int(i));
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Количество потоков, включая вызывающий
+    int size() const { return int(workers.size()) + 1; }
+
+    // Индекс текущего потока в [0, size()); внешние потоки получают size() - 1
+    int workerIndex() const {
+        int index = currentWorkerIndex();
+        return index >= 0 ? index : int(workers.size());
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pushTask(Task{std::move(task), nullptr});
+        }
+        condition.notify_one();
+    }
+
+    // Вызывает fn(chunkBegin, chunkEnd) для всех чанков [begin, end) размера grain
+    // и возвращается после завершения всех чанков. fn не копируется и не
+    // оборачивается в std::function, так что вызов не выделяет память.
+    template <typename Fn>
+    void parallelFor(int begin, int end, int grain, const Fn& fn) {
+        int bounds[2] = {begin, end};
+        run(bounds, 1, grain, fn);
+    }
+
+    // Как parallelFor по [nodeBegin[0], nodeBegin[nodeCount()]), но чанки из
+    // [nodeBegin[i], nodeBegin[i + 1]) достаются прежде всего потокам узла i.
+    // Когда своя часть разобрана, поток берёт чанки других узлов, так что
+    // неравные полосы не оставляют ядра без работы.
+    template <typename Fn>
+    void parallelForNodes(const int* nodeBegin, int grain, const Fn& fn) {
+        run(nodeBegin, nodeCount(), grain, fn);
+    }
+
+    // Закрепляет воркеров за ядрами topology: вызывающий поток считается
+    // занявшим первое ядро, воркеры идут за ним по узлам подряд. topology
+    // должна жить дольше пула. Вызывать, пока пул простаивает.
+    bool pinToNodes(const NumaTopology& nodes) {
+        std::vector<int> cpus, cpuNodes;
+        for (int i = 0; i < nodes.nodeCount(); i++) {
+            for (int cpu : nodes.nodes[i].cpus) {
+                cpus.push_back(cpu);
+                cpuNodes.push_back(i);
+            }
+        }
+        if (cpus.empty()) return false;
+        std::vector<int> assigned(workers.size());
+        bool pinned = true;
+        for (size_t i = 0; i < workers.size(); i++) {
+            size_t slot = (i + 1) % cpus.size();
+            assigned[i] = cpuNodes[slot];
+            if (!NumaTopology::pin(workers[i].native_handle(), cpus[slot])) pinned = false;
+        }
+        if (!pinned) {
+            std::cerr << "Failed to pin worker threads to CPU cores" << std::endl;
+            return false;
+        }
+        workerNodes = std::move(assigned);
+        topology = &nodes;
+        return true;
+    }
+
+    // Число узлов, между которыми делит работу parallelForNodes (1 без pinToNodes)
+    int nodeCount() const { return topology ? topology->nodeCount() : 1; }
+
+    // Границы полос для parallelForNodes: count элементов по узлам
+    // пропорционально их ядрам, nodeBegin — nodeCount() + 1 чисел
+    void splitByNodes(int count, int* nodeBegin) const {
+        if (topology) {
+            topology->split(count, nodeBegin);
+        } else {
+            nodeBegin[0] = 0;
+            nodeBegin[1] = count;
+        }
+    }
+
+    // Узел текущего потока: у воркера — узел его ядра, у внешнего потока —
+    // узел ядра, где он сейчас выполняется
+    int currentNode() const {
+        if (!topology) return 0;
+        int index = currentWorkerIndex();
+        if (index >= 0 && index < int(workerNodes.size())) return workerNodes[index];
+        return topology->currentNode();
+    }
+
+    // Размер общего пула; задаётся до первого обращения к shared()
+    static unsigned& sharedThreadCount() {
+        static unsigned count = std::thread::hardware_concurrency();
+        return count;
+    }
+
+    // Общий пул процесса
+    static ThreadPool& shared() {
+        static ThreadPool pool(sharedThreadCount());
+        return pool;
+    }
+};
+
+#endif
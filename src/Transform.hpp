@@ -0,0 +1,123 @@
+#ifndef TRANSFORM_HPP
+#define TRANSFORM_HPP
+
+#include <cmath>
+#include "Vector3.hpp"
+#include "BVH.hpp"
+
+// Аффинное преобразование 3x4: линейная часть m[i][0..2] и перенос m[i][3]
+struct Transform {
+    float m[3][4];
+
+    Transform() : m{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}} {}
+
+    static Transform identity() { return Transform(); }
+
+    static Transform translation(const Vector3& offset) {
+        Transform t;
+        t.m[0][3] = offset.x;
+        t.m[1][3] = offset.y;
+        t.m[2][3] = offset.z;
+        return t;
+    }
+
+    static Transform scaling(const Vector3& scale) {
+        Transform t;
+        t.m[0][0] = scale.x;
+        t.m[1][1] = scale.y;
+        t.m[2][2] = scale.z;
+        return t;
+    }
+
+    static Transform scaling(float scale) { return scaling(Vector3(scale, scale, scale)); }
+
+    // Поворот вокруг оси (нормализуется) на угол в радианах
+    static Transform rotation(const Vector3& axis, float angle) {
+        Vector3 a = axis.normalize();
+        float c = std::cos(angle), s = std::sin(angle), k = 1.0f - c;
+        Transform t;
+        t.m[0][0] = c + a.x * a.x * k;
+        t.m[0][1] = a.x * a.y * k - a.z * s;
+        t.m[0][2] = a.x * a.z * k + a.y * s;
+        t.m[1][0] = a.y * a.x * k + a.z * s;
+        t.m[1][1] = c + a.y * a.y * k;
+        t.m[1][2] = a.y * a.z * k - a.x * s;
+        t.m[2][0] = a.z * a.x * k - a.y * s;
+        t.m[2][1] = a.z * a.y * k + a.x * s;
+        t.m[2][2] = c + a.z * a.z * k;
+        return t;
+    }
+
+    // (a * b)(p) = a(b(p))
+    Transform operator*(const Transform& b) const {
+        Transform r;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 4; j++) {
+                r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j];
+            }
+            r.m[i][3] += m[i][3];
+        }
+        return r;
+    }
+
+    Vector3 point(const Vector3& p) const {
+        return Vector3(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                       m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                       m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+    }
+
+    Vector3 vector(const Vector3& v) const {
+        return Vector3(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                       m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                       m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+    }
+
+    // Умножение на транспонированную линейную часть. Для обратного
+    // преобразования это переводит нормаль из локального пространства в мировое.
+    Vector3 transposedVector(const Vector3& v) const {
+        return Vector3(m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+                       m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+                       m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z);
+    }
+
+    Transform inverse() const {
+        float a = m[0][0], b = m[0][1], c = m[0][2];
+        float d = m[1][0], e = m[1][1], f = m[1][2];
+        float g = m[2][0], h = m[2][1], i = m[2][2];
+        float c00 = e * i - f * h, c01 = c * h - b * i, c02 = b * f - c * e;
+        float c10 = f * g - d * i, c11 = a * i - c * g, c12 = c * d - a * f;
+        float c20 = d * h - e * g, c21 = b * g - a * h, c22 = a * e - b * d;
+        float det = a * c00 + b * c10 + c * c20;
+        float invDet = det != 0.0f ? 1.0f / det : 0.0f;
+
+        Transform r;
+        r.m[0][0] = c00 * invDet; r.m[0][1] = c01 * invDet; r.m[0][2] = c02 * invDet;
+        r.m[1][0] = c10 * invDet; r.m[1][1] = c11 * invDet; r.m[1][2] = c12 * invDet;
+        r.m[2][0] = c20 * invDet; r.m[2][1] = c21 * invDet; r.m[2][2] = c22 * invDet;
+        Vector3 t = r.vector(Vector3(m[0][3], m[1][3], m[2][3]));
+        r.m[0][3] = -t.x;
+        r.m[1][3] = -t.y;
+        r.m[2][3] = -t.z;
+        return r;
+    }
+
+    // Мировой AABB преобразованного бокса (Arvo): по строкам матрицы
+    // берём меньшее и большее из произведений с min/max
+    AABB bounds(const AABB& box) const {
+        if (box.isEmpty()) return box;
+        float lo[3], hi[3];
+        const float bmin[3] = {box.min.x, box.min.y, box.min.z};
+        const float bmax[3] = {box.max.x, box.max.y, box.max.z};
+        for (int i = 0; i < 3; i++) {
+            lo[i] = hi[i] = m[i][3];
+            for (int j = 0; j < 3; j++) {
+                float p = m[i][j] * bmin[j], q = m[i][j] * bmax[j];
+                lo[i] += std::min(p, q);
+                hi[i] += std::max(p, q);
+            }
+        }
+        return AABB(Vector3(lo[0], lo[1], lo[2]), Vector3(hi[0], hi[1], hi[2]));
+    }
+};
+
+#endif
@@ -31,6 +31,10 @@ public:
         return Vector3(x * v.x, y * v.y, z * v.z);
     }
 
+    bool operator==(const Vector3& v) const {
+        return x == v.x && y == v.y && z == v.z;
+    }
+
     float dot(const Vector3& v) const {
         return x * v.x + y * v.y + z * v.z;
     }
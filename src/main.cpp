@@ -10,6 +10,28 @@
 #include "Scene.hpp"
 #include "Renderer.hpp"
 #include "ImageUtils.hpp"
+#include "FrameBuffer.hpp"
+#include "Denoiser.hpp"
+#include "PostProcess.hpp"
+#include "FrameStats.hpp"
+#include "RenderTrace.hpp"
+#include "ResolutionController.hpp"
+#include "MeshLoader.hpp"
+#include "SceneFile.hpp"
+#include "FileWatcher.hpp"
+#include "RenderDaemon.hpp"
+#include "AllocationCounter.hpp"
+#include "AsyncImageWriter.hpp"
+#include "NumaTopology.hpp"
+#include "RenderCheckpoint.hpp"
+#include "ThreadPool.hpp"
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <functional>
 
 const int WINDOW_WIDTH = 1280;
 const int WINDOW_HEIGHT = 720;
@@ -18,7 +40,58 @@ const char* WINDOW_TITLE = "GPU Ray Tracer";
 Scene scene;
 Camera camera;
 Renderer* renderer = nullptr;
+PostProcess postProcess;
+ImageFormat screenshotFormat = ImageFormat::PNG;
+FrameStats frameStats;
+ResolutionController resolutionController;
+bool dynamicResolution = true;
+// Время последнего движения камеры: пока камера движется, разрешение может снижаться
+double lastCameraMoveTime = -1.0;
 bool useComputeShader = true;
+std::vector<std::string> meshPaths;
+int instanceGrid = 0;
+std::vector<std::string> cloudPaths;
+size_t cloudCacheMB = 256;
+bool shadingCache = false;
+// Тени; без них — быстрый предпросмотр (H)
+bool shadows = true;
+// Сцена из файла с перезагрузкой при сохранении
+std::string sceneFilePath;
+SceneFile sceneFile;
+FileWatcher sceneWatcher;
+// Режим сервера рендера: без окна и OpenGL
+std::string daemonSocket;
+size_t daemonCacheMB = 256;
+std::string daemonRoot;
+// Проверка, что установившийся цикл CPU-рендера не выделяет память
+int allocCheckFrames = 0;
+// Проверка инкрементального перерендера против полного: число правок сцены
+int incrementalCheckEdits = 0;
+// CPU-рендер по узлам NUMA с закреплёнными потоками; замер по узлам без окна
+bool numaRendering = false;
+int numaBenchmarkFrames = 0;
+// Долгий офлайн-рендер без окна с контрольными точками в файле
+int offlineWidth = 0, offlineHeight = 0, offlineSamples = 1;
+std::string checkpointPath;
+double checkpointIntervalSeconds = 60.0;
+bool resumeRender = false;
+// Вариант compute-трассировщика и его форма
+ComputeKernel computeKernel = ComputeKernel::Dispatch;
+int persistentWorkgroupSize = 64;
+int persistentGroups = 256;
+// Сравнение вариантов: число замеряемых кадров на вариант
+int kernelBenchmarkFrames = 0;
+// Формат итоговой текстуры compute-режима и вывод её в окно
+OutputFormat outputFormat = OutputFormat::RGBA32F;
+PresentMode presentMode = PresentMode::Quad;
+int outputBenchmarkFrames = 0;
+// Пакетный рендер без окна: "cubemap" или "stereo" и размер вида в пикселях
+std::string batchViews;
+int batchViewSize = 512;
+// Буфер скриншотов переиспользуется между нажатиями
+FrameBuffer screenshotFrame;
+// Запись снимков и последовательностей кадров, прочитанных с GPU
+AsyncImageWriter* imageWriter = nullptr;
 
 struct CameraController {
     float radius = 5.0f;
@@ -58,17 +131,94 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 
     if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
         useComputeShader = !useComputeShader;
+        bool capturing = renderer->isCapturing();
         delete renderer;
         renderer = new Renderer(WINDOW_WIDTH, WINDOW_HEIGHT, useComputeShader);
+        renderer->setFrameStats(&frameStats);
+        renderer->setImageWriter(imageWriter);
+        renderer->setPersistentKernelShape(persistentWorkgroupSize, persistentGroups);
+        renderer->setComputeKernel(computeKernel);
+        renderer->setOutputFormat(outputFormat);
+        renderer->setPresentMode(presentMode);
+        renderer->setShadows(shadows);
+        renderer->setContinuousCapture(capturing, screenshotFormat);
+        renderer->getCpuRenderer().cacheShading = shadingCache;
+        renderer->getCpuRenderer().numaAware = numaRendering;
         std::cout << "Switched to " << (useComputeShader ? "Compute" : "Fragment")
                   << " Shader mode" << std::endl;
     }
 
-    if (key == GLFW_KEY_S && action == GLFW_PRESS) {
+    // S — снимок того кадра, что уже на GPU; Shift+S — эталонный рендер на CPU
+    if (key == GLFW_KEY_S && action == GLFW_PRESS && !(mods & GLFW_MOD_SHIFT)) {
+        renderer->requestScreenshot(screenshotFormat);
+    }
+
+    if (key == GLFW_KEY_S && action == GLFW_PRESS && (mods & GLFW_MOD_SHIFT)) {
         std::cout << "Rendering screenshot..." << std::endl;
-        std::vector<unsigned char> pixels;
-        renderer->renderCPU(scene, camera, pixels);
-        ImageUtils::saveImage(pixels, WINDOW_WIDTH, WINDOW_HEIGHT);
+        screenshotFrame.hasAux = false;
+        renderer->renderCPU(scene, camera, screenshotFrame);
+        ImageUtils::saveImage(screenshotFrame, postProcess, "output", "screenshot", {screenshotFormat});
+    }
+
+    if (key == GLFW_KEY_D && action == GLFW_PRESS) {
+        std::cout << "Rendering denoised screenshot (1 spp)..." << std::endl;
+        screenshotFrame.hasAux = true;
+        renderer->renderCPU(scene, camera, screenshotFrame, 1);
+        Denoiser denoiser;
+        denoiser.denoise(screenshotFrame);
+        ImageUtils::saveImage(screenshotFrame, postProcess, "output", "denoised", {screenshotFormat});
+    }
+
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+#ifdef RAYTRACER_TRACE
+        std::cout << "Tracing CPU render..." << std::endl;
+        FrameBuffer& frame = screenshotFrame;
+        frame.hasAux = false;
+        renderer->renderCPU(scene, camera, frame);
+
+        const RenderTrace& trace = RenderTrace::instance();
+        TraceCounters totals = trace.totals();
+        std::cout << "Rays: " << totals.raysCast << ", sphere tests: " << totals.sphereTests
+                  << ", shadow rays: " << totals.shadowRays
+                  << ", occluded: " << totals.occludedHits << std::endl;
+        trace.writeChromeTrace("output/cpu_trace.json");
+
+        std::vector<unsigned char> heatmap;
+        trace.tileHeatmap(frame.width, frame.height, heatmap);
+        ImageUtils::saveImage(heatmap, frame.width, frame.height, "output", "tile_heatmap");
+        std::cout << "Trace written to output/cpu_trace.json" << std::endl;
+#else
+        std::cout << "Tracing is compiled out (configure with -DRAYTRACER_ENABLE_TRACE=ON)" << std::endl;
+#endif
+    }
+
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        if (!renderer->isCapturing()) {
+            if (imageWriter->startSequence()) {
+                renderer->setContinuousCapture(true, screenshotFormat);
+                std::cout << "Capturing frames to " << imageWriter->currentSequence() << std::endl;
+            }
+        } else {
+            renderer->setContinuousCapture(false, screenshotFormat);
+            std::cout << "Capture stopped (" << imageWriter->written() << " frames written, "
+                      << imageWriter->dropped() << " dropped so far)" << std::endl;
+        }
+    }
+
+    if (key == GLFW_KEY_F && action == GLFW_PRESS) {
+        switch (screenshotFormat) {
+            case ImageFormat::PNG: screenshotFormat = ImageFormat::QOI; break;
+            case ImageFormat::QOI: screenshotFormat = ImageFormat::BMP; break;
+            case ImageFormat::BMP: screenshotFormat = ImageFormat::PPM; break;
+            case ImageFormat::PPM: screenshotFormat = ImageFormat::PNG; break;
+        }
+        std::cout << "Screenshot format: " << ImageEncoder::formatName(screenshotFormat) << std::endl;
+    }
+
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        shadows = !shadows;
+        renderer->setShadows(shadows);
+        std::cout << "Shadows " << (shadows ? "on" : "off") << std::endl;
     }
 
     if (key == GLFW_KEY_R && action == GLFW_PRESS) {
@@ -76,6 +226,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         cameraController.theta = 0.0f;
         cameraController.phi = 60.0f;
         cameraController.updateCamera(camera);
+        lastCameraMoveTime = glfwGetTime();
         std::cout << "Camera reset" << std::endl;
     }
 }
@@ -108,6 +259,7 @@ void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
         while (cameraController.theta < 0.0f) cameraController.theta += 360.0f;
 
         cameraController.updateCamera(camera);
+        lastCameraMoveTime = glfwGetTime();
 
         cameraController.lastMouseX = xpos;
         cameraController.lastMouseY = ypos;
@@ -121,9 +273,39 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
     if (cameraController.radius > 15.0f) cameraController.radius = 15.0f;
 
     cameraController.updateCamera(camera);
+    lastCameraMoveTime = glfwGetTime();
 }
 
-void setupScene() {
+// Тестовое облако: холмистая поверхность из мелких сфер с шумом по высоте
+bool generateCloud(size_t count, const std::string& path) {
+    std::vector<SphereCloud::Source> spheres(count);
+    uint32_t state = 0x12345678u;
+    auto next = [&state]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return float(state) / 4294967296.0f;
+    };
+    float extent = 2.0f * std::sqrt(float(count)) * 0.02f;
+    for (auto& sphere : spheres) {
+        float x = (next() - 0.5f) * extent;
+        float z = (next() - 0.5f) * extent;
+        float height = 0.3f * std::sin(x * 1.7f) * std::cos(z * 1.3f) + 0.05f * next();
+        sphere.center = Vector3(x, height - 0.5f, z - extent * 0.5f);
+        sphere.radius = 0.01f + 0.02f * next();
+        sphere.material = uint16_t(height > 0.15f ? 2 : height > -0.1f ? 1 : 0);
+    }
+    std::vector<Material> palette = {
+            Material(Vector3(0.2f, 0.3f, 0.7f), 0.1f, 0.7f, 0.3f, 32.0f),
+            Material(Vector3(0.3f, 0.6f, 0.2f), 0.1f, 0.7f, 0.1f, 8.0f),
+            Material(Vector3(0.9f, 0.9f, 0.9f), 0.1f, 0.7f, 0.4f, 64.0f)
+    };
+    if (!SphereCloud::write(path, std::move(spheres), palette)) return false;
+    std::cout << "Generated sphere cloud: " << path << " (" << count << " spheres)" << std::endl;
+    return true;
+}
+
+void setupBuiltinScene() {
     scene.addSphere(Sphere(
             Vector3(0, -100.5, 0),
             100.0f,
@@ -159,8 +341,80 @@ void setupScene() {
             Vector3(1, 1, 1),
             1.0f
     ));
+}
+
+void setupScene() {
+    if (sceneFilePath.empty() || !sceneFile.load(sceneFilePath, scene)) {
+        setupBuiltinScene();
+        scene.backgroundColor = Vector3(0.5f, 0.7f, 1.0f);
+    } else {
+        sceneWatcher.watch(sceneFilePath);
+        std::cout << "Loaded scene " << sceneFilePath << ": " << scene.spheres.size() << " spheres, "
+                  << scene.lights.size() << " lights (watching for changes)" << std::endl;
+    }
+
+    // Сетки, экземпляры и облака из командной строки видит только CPU-трассировщик (S, D, T)
+    for (const auto& path : meshPaths) {
+        Mesh mesh;
+        mesh.material = Material(Vector3(0.8f, 0.8f, 0.8f), 0.1f, 0.7f, 0.3f, 32.0f);
+        if (MeshLoader::load(path, mesh)) scene.addMesh(std::move(mesh));
+    }
+
+    // Роща из одинаковых групп сфер: геометрия одна, меняются только
+    // преобразование и каждый третий материал
+    if (instanceGrid > 0) {
+        GeometryGroup cluster;
+        cluster.spheres.push_back(Sphere(Vector3(0, 0.35f, 0), 0.35f,
+                                         Material(Vector3(0.3f, 0.7f, 0.3f), 0.1f, 0.7f, 0.2f, 16.0f)));
+        cluster.spheres.push_back(Sphere(Vector3(0, 0.8f, 0), 0.22f,
+                                         Material(Vector3(0.4f, 0.8f, 0.4f), 0.1f, 0.7f, 0.2f, 16.0f)));
+        cluster.spheres.push_back(Sphere(Vector3(0, 1.1f, 0), 0.12f,
+                                         Material(Vector3(0.5f, 0.9f, 0.5f), 0.1f, 0.7f, 0.2f, 16.0f)));
+        int group = scene.addGeometryGroup(cluster);
+        Material autumn(Vector3(0.9f, 0.5f, 0.1f), 0.1f, 0.7f, 0.2f, 16.0f);
+        for (int z = 0; z < instanceGrid; z++) {
+            for (int x = 0; x < instanceGrid; x++) {
+                float scale = 0.3f + 0.1f * float((x * 7 + z * 3) % 5);
+                Transform transform = Transform::translation(Vector3(2.5f + 0.8f * x, -0.5f, -2.0f - 0.8f * z)) *
+                                      Transform::rotation(Vector3(0, 1, 0), 0.7f * float(x + z)) *
+                                      Transform::scaling(scale);
+                if ((x + z) % 3 == 0) {
+                    scene.addInstance(Instance(group, transform, autumn));
+                } else {
+                    scene.addInstance(Instance(group, transform));
+                }
+            }
+        }
+    }
 
-    scene.backgroundColor = Vector3(0.5f, 0.7f, 1.0f);
+    for (const auto& path : cloudPaths) {
+        auto cloud = std::make_shared<SphereCloud>();
+        if (cloud->open(path, cloudCacheMB << 20)) {
+            std::cout << "Opened sphere cloud " << path << ": " << cloud->sphereCount() << " spheres in "
+                      << cloud->clusterCount() << " clusters" << std::endl;
+            scene.addCloud(cloud);
+        }
+    }
+
+    scene.updateAccelerationStructure();
+}
+
+// Применяет сохранённые правки файла сцены: меняются только затронутые
+// сферы, BVH обновляется refit-ом, в GPU уходят только они же
+void reloadSceneIfChanged() {
+    if (sceneFilePath.empty() || !sceneWatcher.changed()) return;
+    auto start = std::chrono::steady_clock::now();
+    SceneReloadStats stats;
+    if (!sceneFile.reload(scene, stats)) {
+        std::cerr << "Scene file not applied, keeping the previous scene" << std::endl;
+        return;
+    }
+    if (!stats.any()) return;
+    std::cout << "Reloaded " << sceneFilePath << ": " << stats.moved << " moved, " << stats.recolored
+              << " recolored, " << stats.added << " added, " << stats.removed << " removed, "
+              << stats.lightsChanged << " lights changed ("
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << " ms)" << std::endl;
 }
 
 void setupCamera() {
@@ -173,7 +427,444 @@ void setupCamera() {
     );
 }
 
-int main() {
+// Сцена с неравномерной работой на пиксель: все сферы, которые видит GPU,
+// собраны в тесную кучу в углу кадра. Там каждый пиксель платит за
+// попадание и теневой луч, остальная часть кадра — только фон.
+void setupUnevenScene(Scene& uneven) {
+    Material material(Vector3(0.9f, 0.6f, 0.3f), 0.1f, 0.7f, 0.4f, 32.0f);
+    for (int i = 0; i < Renderer::MaxGpuSpheres; i++) {
+        float x = -2.2f + 0.18f * float(i % 6);
+        float y = -0.9f + 0.18f * float(i / 6);
+        uneven.addSphere(Sphere(Vector3(x, y, 1.0f - 0.05f * float(i % 3)), 0.11f, material));
+    }
+    uneven.addLight(Light(Vector3(-1, 3, 4), Vector3(1, 1, 1), 1.0f));
+    uneven.backgroundColor = scene.backgroundColor;
+    uneven.updateAccelerationStructure();
+}
+
+// GPU-время трассировки (фаза Dispatch из GpuTimer) для каждого варианта
+// compute-ядра на текущей и на неравномерной сцене
+void runKernelBenchmark(GLFWwindow* window, int frames) {
+    if (!useComputeShader) {
+        std::cerr << "Kernel benchmark needs compute shaders" << std::endl;
+        return;
+    }
+    Scene uneven;
+    setupUnevenScene(uneven);
+
+    struct Case { const char* name; const Scene* scene; };
+    const Case cases[] = {{"scene", &scene}, {"uneven", &uneven}};
+    const ComputeKernel kernels[] = {ComputeKernel::Dispatch, ComputeKernel::Persistent};
+
+    std::cout << "Kernel benchmark, " << frames << " frames per variant, persistent: "
+              << persistentWorkgroupSize << " threads x " << persistentGroups << " groups" << std::endl;
+    for (const Case& benchmarkCase : cases) {
+        for (ComputeKernel kernel : kernels) {
+            FrameStats stats;
+            renderer->setComputeKernel(kernel);
+            renderer->setFrameStats(&stats);
+            // Несколько лишних кадров, чтобы GpuTimer успел отдать замеры последних
+            for (int i = 0; i < frames + GpuTimer::Latency; i++) {
+                glfwPollEvents();
+                renderer->render(*benchmarkCase.scene, camera);
+                glfwSwapBuffers(window);
+            }
+            glFinish();
+            renderer->render(*benchmarkCase.scene, camera);
+
+            char line[160];
+            std::snprintf(line, sizeof(line), "%-7s %-10s dispatch p50 %7.3f ms  p95 %7.3f ms  (%lld frames)",
+                          benchmarkCase.name, kernel == ComputeKernel::Persistent ? "persistent" : "dispatch",
+                          stats.dispatchMs.percentile(50), stats.dispatchMs.percentile(95),
+                          stats.completedFrames);
+            std::cout << line << std::endl;
+        }
+    }
+    renderer->setFrameStats(&frameStats);
+    renderer->setComputeKernel(computeKernel);
+}
+
+// GPU-время трассировки и вывода для каждого формата итоговой текстуры и
+// способа вывода. Запись кадра — imageStore по байтам формата на пиксель,
+// вывод — их чтение (выборка в четырёхугольнике или blit).
+void runOutputBenchmark(GLFWwindow* window, int frames) {
+    if (!useComputeShader) {
+        std::cerr << "Output benchmark needs compute shaders" << std::endl;
+        return;
+    }
+    const OutputFormat formats[] = {OutputFormat::RGBA32F, OutputFormat::RGBA16F, OutputFormat::RGBA8,
+                                    OutputFormat::SRGB8_ALPHA8, OutputFormat::RGB10_A2};
+    const PresentMode modes[] = {PresentMode::Quad, PresentMode::Blit};
+
+    std::cout << "Output benchmark, " << frames << " frames per variant" << std::endl;
+    for (OutputFormat format : formats) {
+        for (PresentMode mode : modes) {
+            FrameStats stats;
+            renderer->setOutputFormat(format);
+            renderer->setPresentMode(mode);
+            renderer->setFrameStats(&stats);
+            for (int i = 0; i < frames + GpuTimer::Latency; i++) {
+                glfwPollEvents();
+                renderer->render(scene, camera);
+                glfwSwapBuffers(window);
+            }
+            glFinish();
+            renderer->render(scene, camera);
+
+            char line[160];
+            std::snprintf(line, sizeof(line), "%-8s %-5s dispatch p50 %7.3f ms  present p50 %7.3f ms  (%lld frames)",
+                          outputFormatName(format), mode == PresentMode::Blit ? "blit" : "quad",
+                          stats.dispatchMs.percentile(50), stats.drawMs.percentile(50), stats.completedFrames);
+            std::cout << line << std::endl;
+        }
+    }
+    renderer->setFrameStats(&frameStats);
+    renderer->setOutputFormat(outputFormat);
+    renderer->setPresentMode(presentMode);
+}
+
+// Без окна: шесть граней кубической карты из позиции камеры (по файлу на
+// грань, порядок GL_TEXTURE_CUBE_MAP_POSITIVE_X...) или стереопара бок о
+// бок в одном файле. Все виды трассируются одним вызовом renderViews.
+bool renderBatchViews(const std::string& kind, int size) {
+    if (size <= 0) return false;
+    setupScene();
+    setupCamera();
+    CpuRenderer cpuRenderer;
+    cpuRenderer.cacheShading = shadingCache;
+    cpuRenderer.numaAware = numaRendering;
+    auto start = std::chrono::steady_clock::now();
+
+    if (kind == "cubemap") {
+        static const char* faceNames[6] = {"px", "nx", "py", "ny", "pz", "nz"};
+        FrameBuffer faces[6];
+        RenderView views[6];
+        for (int face = 0; face < 6; face++) {
+            faces[face].resize(size, size, false);
+            views[face].camera = Camera::cubemapFace(camera.position, face);
+            views[face].frame = &faces[face];
+        }
+        cpuRenderer.renderViews(scene, views, 6);
+        std::cout << "Cubemap rendered in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                  << " ms" << std::endl;
+        for (int face = 0; face < 6; face++) {
+            ImageUtils::saveImage(faces[face], postProcess, "output", std::string("cubemap_") + faceNames[face],
+                                  {screenshotFormat});
+        }
+        return true;
+    }
+
+    if (kind == "stereo") {
+        int eyeWidth = size * WINDOW_WIDTH / WINDOW_HEIGHT;
+        FrameBuffer frame(2 * eyeWidth, size, false);
+        RenderView views[2];
+        Camera::stereoPair(camera.position, Vector3(0, 0, 0), 0.065f, 45.0f,
+                           float(eyeWidth) / float(size), views[0].camera, views[1].camera);
+        for (int eye = 0; eye < 2; eye++) {
+            views[eye].frame = &frame;
+            views[eye].x = eye * eyeWidth;
+            views[eye].width = eyeWidth;
+            views[eye].height = size;
+        }
+        cpuRenderer.renderViews(scene, views, 2);
+        std::cout << "Stereo pair rendered in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                  << " ms" << std::endl;
+        return ImageUtils::saveImage(frame, postProcess, "output", "stereo", {screenshotFormat});
+    }
+
+    std::cerr << "Unknown view batch '" << kind << "' (expected cubemap or stereo)" << std::endl;
+    return false;
+}
+
+// Без окна: дважды проходит один и тот же облёт камеры из frames кадров
+// CPU-пути (трассировка, постобработка в 8 бит, опрос файла сцены) и во
+// втором проходе считает вызовы operator new. Первый проход прогревает
+// буферы и кэши, поэтому любое выделение во втором — ошибка.
+bool checkSteadyStateAllocations(int frames) {
+    setupScene();
+    CpuRenderer cpuRenderer;
+    cpuRenderer.cacheShading = shadingCache;
+    cpuRenderer.numaAware = numaRendering;
+    FrameBuffer frame(WINDOW_WIDTH, WINDOW_HEIGHT, false);
+    std::vector<unsigned char> pixels;
+
+    auto renderFrame = [&](int index) {
+        cameraController.theta = float(index);
+        cameraController.updateCamera(camera);
+        reloadSceneIfChanged();
+        cpuRenderer.render(scene, camera, frame);
+        postProcess.process(frame, OutputLayout::rgb(), pixels);
+    };
+
+    for (int i = 0; i < frames; i++) renderFrame(i);
+
+    size_t allocations, bytes;
+    auto start = std::chrono::steady_clock::now();
+    {
+        AllocationScope scope;
+        for (int i = 0; i < frames; i++) renderFrame(i);
+        allocations = scope.count();
+        bytes = scope.bytes();
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Allocation check: " << frames << " frames (" << ms / frames << " ms/frame), "
+              << allocations << " allocations, " << bytes << " bytes" << std::endl;
+    if (allocations > 0) {
+        std::cerr << "Steady-state frame loop allocated memory" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Без окна: edits правок сцены (сдвиг, перекраска, добавление и удаление
+// сферы), после каждой кадр renderIncremental сравнивается с полным рендером
+// бит в бит. Тайлы идут через общий пул, поэтому проверка осмысленна с
+// --threads больше 1 и на одноядерной машине.
+bool checkIncrementalRender(int edits) {
+    setupScene();
+    setupCamera();
+    CpuRenderer cpuRenderer;
+    cpuRenderer.cacheShading = shadingCache;
+    FrameBuffer incremental(WINDOW_WIDTH, WINDOW_HEIGHT, false);
+    FrameBuffer full(WINDOW_WIDTH, WINDOW_HEIGHT, false);
+    DirtyRegions regions;
+    cpuRenderer.renderIncremental(scene, camera, incremental, regions);
+
+    int mismatches = 0;
+    long long retraced = 0;
+    for (int i = 0; i < edits && !scene.spheres.empty(); i++) {
+        size_t index = size_t(i) % scene.spheres.size();
+        const Sphere& sphere = scene.spheres[index];
+        switch (i % 4) {
+            case 0:
+                scene.updateSphere(index, sphere.center + Vector3(0.1f, 0.05f, 0.0f), sphere.radius);
+                break;
+            case 1:
+                scene.spheres[index].material.color = Vector3(0.9f, 0.2f, 0.1f * float(i % 10));
+                scene.markChanged();
+                break;
+            case 2:
+                scene.addSphere(Sphere(Vector3(-0.5f + 0.1f * float(i % 10), 0.3f, 0.5f), 0.2f,
+                                       Material(Vector3(0.2f, 0.8f, 0.3f))));
+                break;
+            default:
+                scene.removeSphere(scene.spheres.size() - 1);
+                break;
+        }
+        scene.updateAccelerationStructure();
+        retraced += cpuRenderer.renderIncremental(scene, camera, incremental, regions);
+        cpuRenderer.render(scene, camera, full);
+        if (incremental.color != full.color) mismatches++;
+    }
+
+    std::cout << "Incremental check: " << edits << " edits, " << ThreadPool::shared().size() << " threads, "
+              << retraced << " tiles retraced, " << mismatches << " mismatching frames" << std::endl;
+    if (mismatches > 0) {
+        std::cerr << "Incremental render differs from a full render" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Без окна: облёт камеры из frames кадров CPU-рендером в NUMA-режиме и
+// отчёт по узлам: тайлы, доля взятых из чужих полос, пиксели в секунду
+bool runNumaBenchmark(int frames) {
+    setupScene();
+    CpuRenderer cpuRenderer;
+    cpuRenderer.cacheShading = shadingCache;
+    cpuRenderer.numaAware = true;
+    FrameBuffer frame;
+    cpuRenderer.resizeFrame(frame, WINDOW_WIDTH, WINDOW_HEIGHT, false);
+
+    // Первый кадр строит копии сцены и кэши, он не замеряется
+    cameraController.updateCamera(camera);
+    cpuRenderer.render(scene, camera, frame);
+    cpuRenderer.resetNodeStats();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        cameraController.theta = float(i);
+        cameraController.updateCamera(camera);
+        cpuRenderer.render(scene, camera, frame);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const NumaTopology& topology = NumaTopology::system();
+    int nodes = ThreadPool::shared().nodeCount();
+    std::cout << "NUMA benchmark: " << frames << " frames, " << nodes << " node(s), "
+              << ThreadPool::shared().size() << " threads, " << seconds * 1000.0 / frames << " ms/frame" << std::endl;
+    for (int node = 0; node < nodes; node++) {
+        CpuRenderer::NodeStats stats = cpuRenderer.nodeStats(node);
+        double remote = stats.tiles > 0 ? 100.0 * double(stats.remoteTiles) / double(stats.tiles) : 0.0;
+        std::printf("  node %d (%zu cpus): %lld tiles, %.1f%% stolen, %.2f Mpix/s, %.2f s busy\n",
+                    topology.nodes[node].id, topology.nodes[node].cpus.size(), stats.tiles, remote,
+                    double(stats.pixels) / seconds * 1e-6, stats.busySeconds);
+    }
+    return true;
+}
+
+// Без окна: кадр width x height по samples сэмплов на пиксель в
+// output/offline.*. С --checkpoint готовые тайлы периодически сохраняются в
+// файл, а с --resume рендер продолжается с места остановки и даёт тот же
+// результат, что и без перерыва.
+bool renderOffline(int width, int height, int samples) {
+    if (width <= 0 || height <= 0 || samples <= 0) return false;
+    setupScene();
+    camera = Camera(Vector3(0, 1, 5), Vector3(0, 0, 0), 45.0f, float(width) / float(height));
+    CpuRenderer cpuRenderer;
+    cpuRenderer.cacheShading = shadingCache;
+    cpuRenderer.numaAware = numaRendering;
+    cpuRenderer.shadows = shadows;
+    FrameBuffer frame;
+    cpuRenderer.resizeFrame(frame, width, height, false);
+
+    int tileSize = cpuRenderer.tileSize;
+    std::vector<int> tiles(size_t((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize));
+    std::iota(tiles.begin(), tiles.end(), 0);
+
+    RenderCheckpoint checkpoint;
+    if (!checkpointPath.empty()) {
+        RenderCheckpoint::Job job;
+        job.width = width;
+        job.height = height;
+        job.tileSize = tileSize;
+        job.samplesPerPixel = samples;
+        job.samplerType = cpuRenderer.samplerType;
+        job.samplerSeed = cpuRenderer.samplerSeed;
+        job.shadows = cpuRenderer.shadows;
+        job.cacheShading = cpuRenderer.cacheShading;
+        job.sceneHash = RenderCheckpoint::sceneFingerprint(scene, camera);
+        if (!checkpoint.open(checkpointPath, job, resumeRender)) return false;
+        if (resumeRender) {
+            checkpoint.restore(frame);
+            tiles.erase(std::remove_if(tiles.begin(), tiles.end(), [&](int tile) { return checkpoint.isDone(tile); }),
+                        tiles.end());
+            std::cout << "Resuming " << checkpointPath << ": " << checkpoint.doneCount() << " of "
+                      << checkpoint.tileCount() << " tiles done" << std::endl;
+        }
+        double interval = std::max(0.1, checkpointIntervalSeconds);
+        checkpoint.startPeriodic(std::chrono::milliseconds(int64_t(interval * 1000.0)));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::function<void(int)> tileDone;
+    if (checkpoint.isOpen()) tileDone = [&](int tile) { checkpoint.tileDone(frame, tile); };
+    cpuRenderer.renderTiles(scene, camera, frame, tiles, samples, tileDone);
+    checkpoint.stopPeriodic();
+    std::cout << "Offline render: " << tiles.size() << " tiles at " << samples << " spp in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+    return ImageUtils::saveImage(frame, postProcess, "output", "offline", {screenshotFormat});
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--stats-csv" && i + 1 < argc) {
+            frameStats.openCsv(argv[++i]);
+        } else if (arg == "--target-ms" && i + 1 < argc) {
+            resolutionController.targetFrameMs = std::atof(argv[++i]);
+        } else if (arg == "--no-dynamic-resolution") {
+            dynamicResolution = false;
+        } else if (arg == "--mesh" && i + 1 < argc) {
+            meshPaths.push_back(argv[++i]);
+        } else if (arg == "--instances" && i + 1 < argc) {
+            instanceGrid = std::atoi(argv[++i]);
+        } else if (arg == "--cloud" && i + 1 < argc) {
+            cloudPaths.push_back(argv[++i]);
+        } else if (arg == "--cloud-cache-mb" && i + 1 < argc) {
+            cloudCacheMB = size_t(std::atoll(argv[++i]));
+        } else if (arg == "--scene" && i + 1 < argc) {
+            sceneFilePath = argv[++i];
+        } else if (arg == "--daemon" && i + 1 < argc) {
+            daemonSocket = argv[++i];
+        } else if (arg == "--daemon-cache-mb" && i + 1 < argc) {
+            daemonCacheMB = size_t(std::atoll(argv[++i]));
+        } else if (arg == "--daemon-root" && i + 1 < argc) {
+            daemonRoot = argv[++i];
+        } else if (arg == "--kernel" && i + 1 < argc) {
+            std::string kernel = argv[++i];
+            computeKernel = kernel == "persistent" ? ComputeKernel::Persistent : ComputeKernel::Dispatch;
+        } else if (arg == "--workgroup-size" && i + 1 < argc) {
+            persistentWorkgroupSize = std::atoi(argv[++i]);
+        } else if (arg == "--persistent-groups" && i + 1 < argc) {
+            persistentGroups = std::atoi(argv[++i]);
+        } else if (arg == "--benchmark-kernels" && i + 1 < argc) {
+            kernelBenchmarkFrames = std::atoi(argv[++i]);
+        } else if (arg == "--output-format" && i + 1 < argc) {
+            std::string name = argv[++i];
+            for (OutputFormat format : {OutputFormat::RGBA32F, OutputFormat::RGBA16F, OutputFormat::RGBA8,
+                                        OutputFormat::SRGB8_ALPHA8, OutputFormat::RGB10_A2}) {
+                if (name == outputFormatName(format)) outputFormat = format;
+            }
+        } else if (arg == "--present" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            presentMode = mode == "blit" ? PresentMode::Blit : PresentMode::Quad;
+        } else if (arg == "--benchmark-output" && i + 1 < argc) {
+            outputBenchmarkFrames = std::atoi(argv[++i]);
+        } else if (arg == "--render-views" && i + 2 < argc) {
+            batchViews = argv[++i];
+            batchViewSize = std::atoi(argv[++i]);
+        } else if (arg == "--alloc-check" && i + 1 < argc) {
+            allocCheckFrames = std::atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            ThreadPool::sharedThreadCount() = unsigned(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--numa") {
+            numaRendering = true;
+        } else if (arg == "--numa-benchmark" && i + 1 < argc) {
+            numaRendering = true;
+            numaBenchmarkFrames = std::atoi(argv[++i]);
+        } else if (arg == "--offline" && i + 3 < argc) {
+            offlineWidth = std::atoi(argv[++i]);
+            offlineHeight = std::atoi(argv[++i]);
+            offlineSamples = std::atoi(argv[++i]);
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        } else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+            checkpointIntervalSeconds = std::atof(argv[++i]);
+        } else if (arg == "--resume") {
+            resumeRender = true;
+        } else if (arg == "--check-incremental" && i + 1 < argc) {
+            incrementalCheckEdits = std::atoi(argv[++i]);
+        } else if (arg == "--shading-cache") {
+            shadingCache = true;
+        } else if (arg == "--generate-cloud" && i + 2 < argc) {
+            long long count = std::atoll(argv[i + 1]);
+            return generateCloud(size_t(count), argv[i + 2]) ? 0 : 1;
+        }
+    }
+
+    // Без закрепления потоков узлы неразличимы, и режим ничего не даёт
+    if (numaRendering && !ThreadPool::shared().pinToNodes(NumaTopology::system())) numaRendering = false;
+
+    if (incrementalCheckEdits > 0) {
+        return checkIncrementalRender(incrementalCheckEdits) ? 0 : 1;
+    }
+
+    if (numaBenchmarkFrames > 0) {
+        return runNumaBenchmark(numaBenchmarkFrames) ? 0 : 1;
+    }
+
+    if (offlineWidth > 0) {
+        return renderOffline(offlineWidth, offlineHeight, offlineSamples) ? 0 : 1;
+    }
+
+    if (!daemonSocket.empty()) {
+        RenderDaemon daemon(daemonCacheMB << 20);
+        daemon.rootDirectory = daemonRoot;
+        return daemon.run(daemonSocket) ? 0 : 1;
+    }
+
+    if (!batchViews.empty()) {
+        return renderBatchViews(batchViews, batchViewSize) ? 0 : 1;
+    }
+
+    if (allocCheckFrames > 0) {
+        return checkSteadyStateAllocations(allocCheckFrames) ? 0 : 1;
+    }
+
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
         return -1;
@@ -220,29 +911,80 @@ int main() {
     setupScene();
     setupCamera();
 
+    imageWriter = new AsyncImageWriter();
     renderer = new Renderer(WINDOW_WIDTH, WINDOW_HEIGHT, useComputeShader);
+    renderer->setFrameStats(&frameStats);
+    renderer->setImageWriter(imageWriter);
+    renderer->setPersistentKernelShape(persistentWorkgroupSize, persistentGroups);
+    renderer->setComputeKernel(computeKernel);
+    renderer->setOutputFormat(outputFormat);
+    renderer->setPresentMode(presentMode);
+    renderer->setShadows(shadows);
+    renderer->getCpuRenderer().cacheShading = shadingCache;
+    renderer->getCpuRenderer().numaAware = numaRendering;
+
+    if (kernelBenchmarkFrames > 0 || outputBenchmarkFrames > 0) {
+        if (kernelBenchmarkFrames > 0) runKernelBenchmark(window, kernelBenchmarkFrames);
+        if (outputBenchmarkFrames > 0) runOutputBenchmark(window, outputBenchmarkFrames);
+        delete renderer;
+        delete imageWriter;
+        glfwTerminate();
+        return 0;
+    }
 
     std::cout << "\n=== Controls ===" << std::endl;
     std::cout << "LEFT MOUSE + DRAG - Rotate camera around scene" << std::endl;
     std::cout << "SCROLL WHEEL      - Zoom in/out" << std::endl;
     std::cout << "SPACE             - Switch between Compute and Fragment Shader" << std::endl;
-    std::cout << "S                 - Save screenshot (output/*.bmp)" << std::endl;
+    std::cout << "S                 - Save screenshot of the GPU frame (output/*.png)" << std::endl;
+    std::cout << "SHIFT + S         - Save CPU-rendered reference screenshot" << std::endl;
+    std::cout << "C                 - Start/stop capturing every frame (output/capture_*/)" << std::endl;
+    std::cout << "D                 - Save denoised 1 spp screenshot" << std::endl;
+    std::cout << "F                 - Cycle screenshot format (PNG/QOI/BMP/PPM)" << std::endl;
+    std::cout << "T                 - Trace CPU render (output/cpu_trace.json + heatmap)" << std::endl;
+    std::cout << "H                 - Toggle shadows (GPU and CPU)" << std::endl;
     std::cout << "R                 - Reset camera position" << std::endl;
     std::cout << "ESC               - Exit" << std::endl;
     std::cout << "===============\n" << std::endl;
 
+    double lastTitleUpdate = glfwGetTime();
+    long long lastMeasuredFrame = 0;
+    char title[320];
+
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
 
+        // Статистика в заголовке окна дважды в секунду
+        double now = glfwGetTime();
+        if (now - lastTitleUpdate > 0.5 && !frameStats.frameMs.empty()) {
+            int prefix = std::snprintf(title, sizeof(title), "%s | ", WINDOW_TITLE);
+            frameStats.summary(title + prefix, sizeof(title) - size_t(prefix));
+            glfwSetWindowTitle(window, title);
+            lastTitleUpdate = now;
+        }
+
+        if (dynamicResolution) {
+            bool cameraMoving = lastCameraMoveTime >= 0.0 && now - lastCameraMoveTime < 0.15;
+            if (!cameraMoving) {
+                renderer->setRenderScale(resolutionController.update(0.0, 1.0f, false));
+            } else if (frameStats.completedFrames != lastMeasuredFrame) {
+                lastMeasuredFrame = frameStats.completedFrames;
+                double gpuMs = frameStats.latest.dispatchMs + frameStats.latest.drawMs;
+                renderer->setRenderScale(resolutionController.update(gpuMs, frameStats.latest.renderScale, true));
+            }
+        }
+
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
+        reloadSceneIfChanged();
         renderer->render(scene, camera);
 
         glfwSwapBuffers(window);
     }
 
     delete renderer;
+    delete imageWriter;
     glfwTerminate();
 
     return 0;